@@ -0,0 +1,999 @@
+/* bench-search.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "BAZAAR::BENCH-SEARCH"
+
+#include <errno.h>
+#include <json-glib/json-glib.h>
+#include <math.h>
+
+#include "bz-application-map-factory.h"
+#include "bz-entry-group.h"
+#include "bz-env.h"
+#include "bz-finished-search-query.h"
+#include "bz-linear-function.h"
+#include "bz-search-bias.h"
+#include "bz-search-engine.h"
+#include "bz-substring.h"
+#include "bz-util.h"
+
+/* Exercises `BzSearchEngine` against synthetic catalogs without ever
+   touching a display, so it can run in CI. Catalogs are generated from a
+   fixed seed, which keeps runs comparable across commits */
+
+#define DEFAULT_SIZES      "1000,10000,100000"
+#define SUBSTRING_SIZES    "50000"
+#define DEFAULT_ITERATIONS 20
+#define DEFAULT_SECONDS    2.0
+#define DEFAULT_SEED       1
+
+#ifdef __GLIBC__
+/* Every allocation in the process goes through these, including those of
+   the thread pool workers, so the deltas around a query are what it cost */
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+#define HAVE_ALLOCATION_COUNTS
+
+static gint64 n_allocations     = 0;
+static gint64 n_allocated_bytes = 0;
+
+#define COUNT_ALLOCATION(_size)                                         \
+  G_STMT_START                                                          \
+  {                                                                     \
+    __atomic_add_fetch (&n_allocations, 1, __ATOMIC_RELAXED);           \
+    __atomic_add_fetch (&n_allocated_bytes, (_size), __ATOMIC_RELAXED); \
+  }                                                                     \
+  G_STMT_END
+
+void *
+malloc (size_t size)
+{
+  COUNT_ALLOCATION (size);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb,
+        size_t size)
+{
+  COUNT_ALLOCATION (nmemb * size);
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void  *ptr,
+         size_t size)
+{
+  COUNT_ALLOCATION (size);
+  return __libc_realloc (ptr, size);
+}
+
+/* GLib's slices and SIMD friendly buffers come from these */
+int
+posix_memalign (void **memptr,
+                size_t alignment,
+                size_t size)
+{
+  void *ptr = NULL;
+
+  if (alignment % sizeof (void *) != 0 ||
+      (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+
+  COUNT_ALLOCATION (size);
+  ptr = __libc_memalign (alignment, size);
+  if (ptr == NULL)
+    return ENOMEM;
+
+  *memptr = ptr;
+  return 0;
+}
+
+void *
+aligned_alloc (size_t alignment,
+               size_t size)
+{
+  COUNT_ALLOCATION (size);
+  return __libc_memalign (alignment, size);
+}
+
+void *
+memalign (size_t alignment,
+          size_t size)
+{
+  COUNT_ALLOCATION (size);
+  return __libc_memalign (alignment, size);
+}
+#endif
+
+#define BENCH_TYPE_ENTRY (bench_entry_get_type ())
+G_DECLARE_FINAL_TYPE (BenchEntry, bench_entry, BENCH, ENTRY, BzEntry)
+
+struct _BenchEntry
+{
+  BzEntry parent_instance;
+};
+
+G_DEFINE_FINAL_TYPE (BenchEntry, bench_entry, BZ_TYPE_ENTRY)
+
+static void
+bench_entry_class_init (BenchEntryClass *klass)
+{
+}
+
+static void
+bench_entry_init (BenchEntry *self)
+{
+}
+
+typedef struct
+{
+  const char *kind;
+  const char *text;
+} CorpusQuery;
+
+/* Consecutive entries never extend each other, except for the "typing"
+   run, which is meant to hit the refinement path */
+static const CorpusQuery corpus[] = {
+  { "short", "vi" },
+  { "short", "ed" },
+  { "short", "mus" },
+  { "long", "lightweight privacy focused web browser" },
+  { "long", "professional vector drawing and painting suite" },
+  { "multi-token", "video editor" },
+  { "multi-token", "music player" },
+  { "multi-token", "password manager sync" },
+  { "unicode", "café" },
+  { "unicode", "übersicht" },
+  { "unicode", "日本語" },
+  { "bias", "browser" },
+  { "bias", "vm" },
+  { "bias", "dl manager" },
+  { "exact", "io.example.App42" },
+  { "typing", "d" },
+  { "typing", "do" },
+  { "typing", "doc" },
+  { "typing", "docu" },
+  { "typing", "document" },
+  { "typing", "document edi" },
+  { "typing", "document editor" },
+};
+
+static const char *const words[] = {
+  "video", "editor", "audio", "music", "player", "photo", "image",
+  "viewer", "browser", "web", "mail", "client", "chat", "messenger",
+  "game", "puzzle", "strategy", "office", "document", "spreadsheet",
+  "presentation", "notes", "calendar", "terminal", "code", "developer",
+  "integrated", "virtual", "machine", "download", "manager", "backup",
+  "sync", "file", "system", "monitor", "network", "screen", "recorder",
+  "painting", "drawing", "vector", "modeling", "camera", "podcast",
+  "radio", "weather", "map", "translator", "dictionary", "ebook",
+  "reader", "password", "vault", "torrent", "emulator", "console",
+  "launcher", "streaming", "fast", "simple", "modern", "lightweight",
+  "powerful", "open", "source", "privacy", "focused", "professional",
+  "suite", "tool", "studio", "center", "companion", "tracker", "and",
+  "for", "with", "your", "the", "café", "naïve", "übersicht",
+  "ελληνικά", "日本語", "한국어", "русский",
+};
+
+BZ_DEFINE_DATA (
+    main,
+    Main,
+    {
+      GMainLoop *loop;
+      char      *sizes;
+      int        iterations;
+      double     seconds;
+      int        seed;
+      gboolean   json;
+      gboolean   substring;
+      int        rv;
+    },
+    BZ_RELEASE_DATA (loop, g_main_loop_unref);
+    BZ_RELEASE_DATA (sizes, g_free));
+
+BZ_DEFINE_DATA (
+    client,
+    Client,
+    {
+      BzSearchEngine *engine;
+      gint64          deadline;
+      guint           n_done;
+    },
+    BZ_RELEASE_DATA (engine, g_object_unref));
+
+static DexFuture *
+run (MainData *data);
+
+static DexFuture *
+client_fiber (ClientData *data);
+
+static void
+bench_substring (MainData    *data,
+                 guint        n_groups,
+                 JsonBuilder *builder);
+
+typedef const char *(*FindFunc) (const char *haystack,
+                                 gsize       haystack_len,
+                                 const char *needle,
+                                 gsize       needle_len);
+
+static guint
+count_token_hits (FindFunc    find,
+                  const char *field,
+                  gsize       field_len,
+                  const char *needle,
+                  gsize       needle_len);
+
+static guint
+count_token_hits_utf8 (const char *field,
+                       gsize       field_len,
+                       const char *needle,
+                       gsize       needle_len);
+
+static GListModel *
+build_catalog (guint  n_groups,
+               GRand *rand);
+
+static GListModel *
+build_biases (void);
+
+static char *
+random_phrase (GRand *rand,
+               guint  min_words,
+               guint  max_words);
+
+static BzFinishedSearchQuery *
+run_query (BzSearchEngine *engine,
+           const char     *text,
+           GError        **error);
+
+static double
+percentile (GArray *sorted,
+            double  p);
+
+static gint
+cmp_double (const double *a,
+            const double *b);
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr (GError) local_error     = NULL;
+  g_autofree char *sizes             = NULL;
+  int              iterations        = DEFAULT_ITERATIONS;
+  double           seconds           = DEFAULT_SECONDS;
+  int              seed              = DEFAULT_SEED;
+  gboolean         json              = FALSE;
+  gboolean         substring         = FALSE;
+  g_autoptr (GOptionContext) context = NULL;
+  g_autoptr (GApplication) app       = NULL;
+  g_autoptr (GMainLoop) main_loop    = NULL;
+  g_autoptr (MainData) data          = NULL;
+  g_autoptr (DexFuture) future       = NULL;
+
+  GOptionEntry main_entries[] = {
+    { "sizes", 0, 0, G_OPTION_ARG_STRING, &sizes, "Comma separated catalog sizes (default: " DEFAULT_SIZES ")", "N,..." },
+    { "iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Times to run each query of the corpus", "N" },
+    { "seconds", 0, 0, G_OPTION_ARG_DOUBLE, &seconds, "Duration of each throughput run", "SECONDS" },
+    { "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed for the synthetic catalogs", "N" },
+    { "json", 0, 0, G_OPTION_ARG_NONE, &json, "Print machine readable results", NULL },
+    { "substring", 0, 0, G_OPTION_ARG_NONE, &substring, "Only time the token matching kernels (default sizes: " SUBSTRING_SIZES ")", NULL },
+    { NULL }
+  };
+
+  context = g_option_context_new ("- benchmark the Bazaar search engine");
+  g_option_context_add_main_entries (context, main_entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &local_error))
+    {
+      g_printerr ("%s\n", local_error->message);
+      return EXIT_FAILURE;
+    }
+  if (iterations <= 0 || seconds <= 0.0)
+    {
+      g_printerr ("--iterations and --seconds must be positive\n");
+      return EXIT_FAILURE;
+    }
+
+  g_log_writer_default_set_use_stderr (TRUE);
+  dex_init ();
+
+  /* Entry groups look up the default application */
+  app = g_application_new ("io.github.kolunmi.Bazaar.BenchSearch", G_APPLICATION_NON_UNIQUE);
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+
+  data             = main_data_new ();
+  data->loop       = g_main_loop_ref (main_loop);
+  data->sizes      = g_strdup (sizes != NULL ? sizes : substring ? SUBSTRING_SIZES : DEFAULT_SIZES);
+  data->iterations = iterations;
+  data->seconds    = seconds;
+  data->seed       = seed;
+  data->json       = json;
+  data->substring  = substring;
+  data->rv         = EXIT_SUCCESS;
+
+  future = dex_scheduler_spawn (
+      dex_scheduler_get_default (),
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) run,
+      main_data_ref (data), main_data_unref);
+  g_main_loop_run (main_loop);
+
+  return data->rv;
+}
+
+static DexFuture *
+run (MainData *data)
+{
+  g_autoptr (GError) local_error      = NULL;
+  g_auto (GStrv) sizes                = NULL;
+  g_autoptr (GListModel) biases       = NULL;
+  g_autoptr (JsonBuilder) builder     = NULL;
+  g_autoptr (JsonGenerator) generator = NULL;
+  g_autofree char *json_data          = NULL;
+
+  sizes  = g_strsplit (data->sizes, ",", -1);
+  biases = build_biases ();
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "seed");
+  json_builder_add_int_value (builder, data->seed);
+  json_builder_set_member_name (builder, "iterations");
+  json_builder_add_int_value (builder, data->iterations);
+  json_builder_set_member_name (builder, "processors");
+  json_builder_add_int_value (builder, g_get_num_processors ());
+  json_builder_set_member_name (builder, "catalogs");
+  json_builder_begin_array (builder);
+
+  for (char **size = sizes; *size != NULL; size++)
+    {
+      guint64 n_groups                         = 0;
+      g_autoptr (GRand) rand                   = NULL;
+      g_autoptr (GListModel) catalog           = NULL;
+      g_autoptr (BzSearchEngine) engine        = NULL;
+      g_autoptr (BzFinishedSearchQuery) warmup = NULL;
+      gint64 setup_start                       = 0;
+      double setup_ms                          = 0.0;
+      g_autoptr (GPtrArray) kinds              = NULL;
+      g_autoptr (GHashTable) samples           = NULL;
+      g_autoptr (GHashTable) allocations       = NULL;
+      g_autoptr (GHashTable) bytes             = NULL;
+      g_autoptr (GHashTable) results           = NULL;
+
+      if (!g_ascii_string_to_unsigned (*size, 10, 1, G_MAXUINT, &n_groups, &local_error))
+        {
+          g_printerr ("Invalid catalog size \"%s\": %s\n", *size, local_error->message);
+          data->rv = EXIT_FAILURE;
+          g_main_loop_quit (data->loop);
+          return dex_future_new_for_error (g_steal_pointer (&local_error));
+        }
+
+      if (data->substring)
+        {
+          bench_substring (data, n_groups, builder);
+          continue;
+        }
+
+      rand    = g_rand_new_with_seed (data->seed);
+      catalog = build_catalog (n_groups, rand);
+
+      /* Indexing is finished lazily by the first query */
+      setup_start = g_get_monotonic_time ();
+      engine      = bz_search_engine_new ();
+      bz_search_engine_set_biases (engine, biases);
+      bz_search_engine_set_model (engine, catalog);
+      warmup      = run_query (engine, "warmup", NULL);
+      setup_ms = (g_get_monotonic_time () - setup_start) / 1000.0;
+
+      kinds       = g_ptr_array_new ();
+      samples     = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_array_unref);
+      allocations = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_array_unref);
+      bytes       = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_array_unref);
+      results     = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_array_unref);
+      for (guint i = 0; i < G_N_ELEMENTS (corpus); i++)
+        {
+          if (g_hash_table_contains (samples, corpus[i].kind))
+            continue;
+
+          g_ptr_array_add (kinds, (gpointer) corpus[i].kind);
+          g_hash_table_replace (samples, (gpointer) corpus[i].kind, g_array_new (FALSE, FALSE, sizeof (double)));
+          g_hash_table_replace (allocations, (gpointer) corpus[i].kind, g_array_new (FALSE, FALSE, sizeof (double)));
+          g_hash_table_replace (bytes, (gpointer) corpus[i].kind, g_array_new (FALSE, FALSE, sizeof (double)));
+          g_hash_table_replace (results, (gpointer) corpus[i].kind, g_array_new (FALSE, FALSE, sizeof (double)));
+        }
+      g_ptr_array_add (kinds, (gpointer) "all");
+      g_hash_table_replace (samples, (gpointer) "all", g_array_new (FALSE, FALSE, sizeof (double)));
+      g_hash_table_replace (allocations, (gpointer) "all", g_array_new (FALSE, FALSE, sizeof (double)));
+      g_hash_table_replace (bytes, (gpointer) "all", g_array_new (FALSE, FALSE, sizeof (double)));
+      g_hash_table_replace (results, (gpointer) "all", g_array_new (FALSE, FALSE, sizeof (double)));
+
+      for (int iteration = 0; iteration < data->iterations; iteration++)
+        {
+          for (guint i = 0; i < G_N_ELEMENTS (corpus); i++)
+            {
+              gint64 allocations_before                  = 0;
+              gint64 bytes_before                        = 0;
+              gint64 start                               = 0;
+              g_autoptr (BzFinishedSearchQuery) finished = NULL;
+              double elapsed_ms                          = 0.0;
+              double n_allocs                            = 0.0;
+              double n_bytes                             = 0.0;
+              double n_results                           = 0.0;
+              const char *const keys[]                   = { corpus[i].kind, "all" };
+
+#ifdef HAVE_ALLOCATION_COUNTS
+              allocations_before = __atomic_load_n (&n_allocations, __ATOMIC_RELAXED);
+              bytes_before       = __atomic_load_n (&n_allocated_bytes, __ATOMIC_RELAXED);
+#endif
+              start    = g_get_monotonic_time ();
+              finished = run_query (engine, corpus[i].text, &local_error);
+              if (finished == NULL)
+                {
+                  g_printerr ("Query \"%s\" failed: %s\n", corpus[i].text, local_error->message);
+                  data->rv = EXIT_FAILURE;
+                  g_main_loop_quit (data->loop);
+                  return dex_future_new_for_error (g_steal_pointer (&local_error));
+                }
+              elapsed_ms = (g_get_monotonic_time () - start) / 1000.0;
+#ifdef HAVE_ALLOCATION_COUNTS
+              n_allocs = __atomic_load_n (&n_allocations, __ATOMIC_RELAXED) - allocations_before;
+              n_bytes  = __atomic_load_n (&n_allocated_bytes, __ATOMIC_RELAXED) - bytes_before;
+#endif
+              n_results = bz_finished_search_query_get_n_results (finished);
+
+              for (guint j = 0; j < G_N_ELEMENTS (keys); j++)
+                {
+                  g_array_append_val ((GArray *) g_hash_table_lookup (samples, keys[j]), elapsed_ms);
+                  g_array_append_val ((GArray *) g_hash_table_lookup (allocations, keys[j]), n_allocs);
+                  g_array_append_val ((GArray *) g_hash_table_lookup (bytes, keys[j]), n_bytes);
+                  g_array_append_val ((GArray *) g_hash_table_lookup (results, keys[j]), n_results);
+                }
+            }
+        }
+
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "size");
+      json_builder_add_int_value (builder, n_groups);
+      json_builder_set_member_name (builder, "setup_ms");
+      json_builder_add_double_value (builder, setup_ms);
+
+      if (!data->json)
+        {
+          g_print ("catalog of %" G_GUINT64_FORMAT " groups, setup %.1f ms\n", n_groups, setup_ms);
+          g_print ("  %-12s %8s %9s %9s %9s %12s %12s %9s\n",
+                   "kind", "samples", "p50 ms", "p95 ms", "p99 ms", "allocs", "KiB", "results");
+        }
+
+      json_builder_set_member_name (builder, "latency");
+      json_builder_begin_array (builder);
+      for (guint i = 0; i < kinds->len; i++)
+        {
+          const char *kind         = NULL;
+          GArray     *kind_samples = NULL;
+          double      p50          = 0.0;
+          double      p95          = 0.0;
+          double      p99          = 0.0;
+          double      mean_allocs  = 0.0;
+          double      mean_bytes   = 0.0;
+          double      mean_results = 0.0;
+
+          kind         = g_ptr_array_index (kinds, i);
+          kind_samples = g_hash_table_lookup (samples, kind);
+          g_array_sort (kind_samples, (GCompareFunc) cmp_double);
+
+          p50 = percentile (kind_samples, 50.0);
+          p95 = percentile (kind_samples, 95.0);
+          p99 = percentile (kind_samples, 99.0);
+
+#define MEAN(_table, _out)                                          \
+  G_STMT_START                                                      \
+  {                                                                 \
+    GArray *_values = g_hash_table_lookup ((_table), kind);         \
+                                                                    \
+    for (guint _i = 0; _i < _values->len; _i++)                     \
+      (_out) += g_array_index (_values, double, _i) / _values->len; \
+  }                                                                 \
+  G_STMT_END
+
+          MEAN (allocations, mean_allocs);
+          MEAN (bytes, mean_bytes);
+          MEAN (results, mean_results);
+
+#undef MEAN
+
+          json_builder_begin_object (builder);
+          json_builder_set_member_name (builder, "kind");
+          json_builder_add_string_value (builder, kind);
+          json_builder_set_member_name (builder, "samples");
+          json_builder_add_int_value (builder, kind_samples->len);
+          json_builder_set_member_name (builder, "p50_ms");
+          json_builder_add_double_value (builder, p50);
+          json_builder_set_member_name (builder, "p95_ms");
+          json_builder_add_double_value (builder, p95);
+          json_builder_set_member_name (builder, "p99_ms");
+          json_builder_add_double_value (builder, p99);
+          json_builder_set_member_name (builder, "mean_allocations");
+#ifdef HAVE_ALLOCATION_COUNTS
+          json_builder_add_double_value (builder, mean_allocs);
+#else
+          json_builder_add_null_value (builder);
+#endif
+          json_builder_set_member_name (builder, "mean_allocated_bytes");
+#ifdef HAVE_ALLOCATION_COUNTS
+          json_builder_add_double_value (builder, mean_bytes);
+#else
+          json_builder_add_null_value (builder);
+#endif
+          json_builder_set_member_name (builder, "mean_results");
+          json_builder_add_double_value (builder, mean_results);
+          json_builder_end_object (builder);
+
+          if (!data->json)
+            g_print ("  %-12s %8u %9.2f %9.2f %9.2f %12.0f %12.1f %9.0f\n",
+                     kind, kind_samples->len, p50, p95, p99,
+                     mean_allocs, mean_bytes / 1024.0, mean_results);
+        }
+      json_builder_end_array (builder);
+
+      /* Throughput of back to back queries with scoring spread over a
+         fixed number of threads, to see how well a query scales with the
+         processors it gets */
+      json_builder_set_member_name (builder, "throughput");
+      json_builder_begin_array (builder);
+      for (guint n_threads = 1;; n_threads = MIN (n_threads * 2, g_get_num_processors ()))
+        {
+          g_autoptr (ClientData) client = NULL;
+          gint64 start                  = 0;
+          double elapsed                = 0.0;
+
+          bz_search_engine_set_max_threads (engine, n_threads);
+
+          start            = g_get_monotonic_time ();
+          client           = client_data_new ();
+          client->engine   = g_object_ref (engine);
+          client->deadline = start + (gint64) (data->seconds * G_USEC_PER_SEC);
+
+          if (!dex_await (
+                  dex_scheduler_spawn (
+                      dex_scheduler_get_default (),
+                      bz_get_dex_stack_size (),
+                      (DexFiberFunc) client_fiber,
+                      client_data_ref (client), client_data_unref),
+                  &local_error))
+            {
+              g_printerr ("Throughput run failed: %s\n", local_error->message);
+              data->rv = EXIT_FAILURE;
+              g_main_loop_quit (data->loop);
+              return dex_future_new_for_error (g_steal_pointer (&local_error));
+            }
+          elapsed = (g_get_monotonic_time () - start) / (double) G_USEC_PER_SEC;
+
+          json_builder_begin_object (builder);
+          json_builder_set_member_name (builder, "threads");
+          json_builder_add_int_value (builder, n_threads);
+          json_builder_set_member_name (builder, "queries");
+          json_builder_add_int_value (builder, client->n_done);
+          json_builder_set_member_name (builder, "queries_per_second");
+          json_builder_add_double_value (builder, client->n_done / elapsed);
+          json_builder_end_object (builder);
+
+          if (!data->json)
+            g_print ("  %u threads: %.1f queries/s\n", n_threads, client->n_done / elapsed);
+
+          if (n_threads >= g_get_num_processors ())
+            break;
+        }
+      bz_search_engine_set_max_threads (engine, 0);
+      json_builder_end_array (builder);
+
+      json_builder_end_object (builder);
+    }
+
+  json_builder_end_array (builder);
+  json_builder_end_object (builder);
+
+  if (data->json)
+    {
+      generator = json_generator_new ();
+      json_generator_set_pretty (generator, TRUE);
+      json_generator_set_root (generator, json_builder_get_root (builder));
+      json_data = json_generator_to_data (generator, NULL);
+      g_print ("%s\n", json_data);
+    }
+
+  g_main_loop_quit (data->loop);
+  return dex_future_new_true ();
+}
+
+static DexFuture *
+client_fiber (ClientData *data)
+{
+  g_autoptr (GError) local_error = NULL;
+
+  for (guint i = 0; g_get_monotonic_time () < data->deadline; i++)
+    {
+      g_autoptr (BzFinishedSearchQuery) finished = NULL;
+
+      finished = run_query (data->engine, corpus[i % G_N_ELEMENTS (corpus)].text, &local_error);
+      if (finished == NULL)
+        return dex_future_new_for_error (g_steal_pointer (&local_error));
+      data->n_done++;
+    }
+
+  return dex_future_new_true ();
+}
+
+/* Times one pass of every corpus token over the folded descriptions of a
+   synthetic catalog, once per way of matching tokens: the vectorized
+   kernel the engine uses, its memchr based fallback, and the character by
+   character walk the engine did before either existed */
+static void
+bench_substring (MainData    *data,
+                 guint        n_groups,
+                 JsonBuilder *builder)
+{
+  g_autoptr (GRand) rand       = NULL;
+  g_autoptr (GPtrArray) fields = NULL;
+  g_autoptr (GPtrArray) tokens = NULL;
+  double p50[3]                = { 0 };
+  guint  hits[3]               = { 0 };
+
+  const char *const names[] = { "simd", "scalar", "utf8" };
+
+  rand   = g_rand_new_with_seed (data->seed);
+  fields = g_ptr_array_new_with_free_func (g_free);
+  for (guint i = 0; i < n_groups; i++)
+    {
+      g_autofree char *description = NULL;
+
+      description = random_phrase (rand, 12, 60);
+      g_ptr_array_add (fields, g_utf8_casefold (description, -1));
+    }
+
+  tokens = g_ptr_array_new_with_free_func ((GDestroyNotify) g_strfreev);
+  for (guint i = 0; i < G_N_ELEMENTS (corpus); i++)
+    {
+      g_autofree char *folded = NULL;
+
+      folded = g_utf8_casefold (corpus[i].text, -1);
+      g_ptr_array_add (tokens, g_strsplit (folded, " ", -1));
+    }
+
+  for (guint kernel = 0; kernel < G_N_ELEMENTS (names); kernel++)
+    {
+      g_autoptr (GArray) samples = NULL;
+
+      samples = g_array_new (FALSE, FALSE, sizeof (double));
+      for (int iteration = 0; iteration < data->iterations; iteration++)
+        {
+          gint64 start      = 0;
+          guint  n_hits     = 0;
+          double elapsed_ms = 0.0;
+
+          start = g_get_monotonic_time ();
+          for (guint i = 0; i < tokens->len; i++)
+            {
+              for (char **token = g_ptr_array_index (tokens, i); *token != NULL; token++)
+                {
+                  gsize token_len = 0;
+
+                  token_len = strlen (*token);
+                  if (token_len == 0)
+                    continue;
+
+                  for (guint j = 0; j < fields->len; j++)
+                    {
+                      const char *field = g_ptr_array_index (fields, j);
+
+                      switch (kernel)
+                        {
+                        case 0:
+                          n_hits += count_token_hits (bz_find_substring, field, strlen (field), *token, token_len);
+                          break;
+                        case 1:
+                          n_hits += count_token_hits (bz_find_substring_scalar, field, strlen (field), *token, token_len);
+                          break;
+                        default:
+                          n_hits += count_token_hits_utf8 (field, strlen (field), *token, token_len);
+                          break;
+                        }
+                    }
+                }
+            }
+          elapsed_ms = (g_get_monotonic_time () - start) / 1000.0;
+
+          g_array_append_val (samples, elapsed_ms);
+          hits[kernel] = n_hits;
+        }
+
+      g_array_sort (samples, (GCompareFunc) cmp_double);
+      p50[kernel] = percentile (samples, 50.0);
+    }
+
+  /* The kernels are only comparable if they agree */
+  if (hits[0] != hits[2] || hits[1] != hits[2])
+    {
+      g_printerr ("Token matching kernels disagree: %u, %u and %u hits\n",
+                  hits[0], hits[1], hits[2]);
+      data->rv = EXIT_FAILURE;
+    }
+
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "size");
+  json_builder_add_int_value (builder, n_groups);
+  json_builder_set_member_name (builder, "hits");
+  json_builder_add_int_value (builder, hits[0]);
+  json_builder_set_member_name (builder, "substring");
+  json_builder_begin_array (builder);
+  for (guint kernel = 0; kernel < G_N_ELEMENTS (names); kernel++)
+    {
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "kernel");
+      json_builder_add_string_value (builder, names[kernel]);
+      json_builder_set_member_name (builder, "p50_ms");
+      json_builder_add_double_value (builder, p50[kernel]);
+      json_builder_set_member_name (builder, "speedup");
+      json_builder_add_double_value (builder, p50[kernel] > 0.0 ? p50[2] / p50[kernel] : 0.0);
+      json_builder_end_object (builder);
+    }
+  json_builder_end_array (builder);
+  json_builder_end_object (builder);
+
+  if (!data->json)
+    {
+      g_print ("catalog of %u descriptions, %u token hits per pass\n", n_groups, hits[0]);
+      g_print ("  %-12s %9s %9s\n", "kernel", "p50 ms", "speedup");
+      for (guint kernel = 0; kernel < G_N_ELEMENTS (names); kernel++)
+        g_print ("  %-12s %9.2f %8.1fx\n",
+                 names[kernel], p50[kernel],
+                 p50[kernel] > 0.0 ? p50[2] / p50[kernel] : 0.0);
+    }
+}
+
+/* Counts the space separated tokens of `field` containing `needle`, the
+   way the engine's `test_tokens` attributes hits */
+static guint
+count_token_hits (FindFunc    find,
+                  const char *field,
+                  gsize       field_len,
+                  const char *needle,
+                  gsize       needle_len)
+{
+  const char *cursor    = field;
+  const char *field_end = field + field_len;
+  guint       n_hits    = 0;
+
+  while (cursor < field_end)
+    {
+      const char *hit       = NULL;
+      const char *token_end = NULL;
+
+      hit = find (cursor, field_end - cursor, needle, needle_len);
+      if (hit == NULL)
+        break;
+      n_hits++;
+
+      token_end = memchr (hit, ' ', field_end - hit);
+      if (token_end == NULL)
+        break;
+      cursor = token_end + 1;
+    }
+
+  return n_hits;
+}
+
+static guint
+count_token_hits_utf8 (const char *field,
+                       gsize       field_len,
+                       const char *needle,
+                       gsize       needle_len)
+{
+  const char *field_end = field + field_len;
+  guint       n_hits    = 0;
+
+  for (const char *token = field; token < field_end;)
+    {
+      const char *token_end = NULL;
+
+      token_end = memchr (token, ' ', field_end - token);
+      if (token_end == NULL)
+        token_end = field_end;
+
+      for (const char *p = token; p < token_end; p = g_utf8_next_char (p))
+        {
+          if ((gsize) (token_end - p) < needle_len)
+            break;
+          if (memcmp (p, needle, needle_len) == 0)
+            {
+              n_hits++;
+              break;
+            }
+        }
+
+      token = token_end + 1;
+    }
+
+  return n_hits;
+}
+
+static BzFinishedSearchQuery *
+run_query (BzSearchEngine *engine,
+           const char     *text,
+           GError        **error)
+{
+  g_auto (GStrv) terms = NULL;
+
+  terms = g_strsplit (text, " ", -1);
+  return dex_await_object (
+      bz_search_engine_query (engine, (const char *const *) terms, 0, NULL),
+      error);
+}
+
+static GListModel *
+build_catalog (guint  n_groups,
+               GRand *rand)
+{
+  g_autoptr (BzApplicationMapFactory) factory = NULL;
+  g_autoptr (GListStore) store                = NULL;
+
+  /* Groups only use the factory to create UI entries, which never happens
+     here */
+  factory = bz_application_map_factory_new (
+      (GtkMapListModelMapFunc) g_object_ref,
+      NULL, NULL, NULL, NULL);
+  store = g_list_store_new (BZ_TYPE_ENTRY_GROUP);
+
+  for (guint i = 0; i < n_groups; i++)
+    {
+      g_autofree char *id            = NULL;
+      g_autofree char *unique_id     = NULL;
+      g_autofree char *title         = NULL;
+      g_autofree char *developer     = NULL;
+      g_autofree char *description   = NULL;
+      g_autofree char *search_tokens = NULL;
+      g_autoptr (BzEntry) entry      = NULL;
+      g_autoptr (BzEntryGroup) group = NULL;
+
+      id            = g_strdup_printf ("io.example.App%u", i);
+      unique_id     = g_strdup_printf ("bench/app/%s/x86_64/stable", id);
+      title         = random_phrase (rand, 1, 3);
+      developer     = random_phrase (rand, 1, 2);
+      description   = random_phrase (rand, 12, 60);
+      search_tokens = g_rand_boolean (rand) ? random_phrase (rand, 2, 8) : NULL;
+
+      entry = g_object_new (
+          BENCH_TYPE_ENTRY,
+          "kinds", BZ_ENTRY_KIND_APPLICATION,
+          "searchable", TRUE,
+          "id", id,
+          "unique-id", unique_id,
+          "title", title,
+          "developer", developer,
+          "description", description,
+          "search-tokens", search_tokens,
+          NULL);
+
+      group = bz_entry_group_new (factory);
+      bz_entry_group_add (group, entry, NULL, TRUE);
+      g_list_store_append (store, group);
+    }
+
+  return G_LIST_MODEL (g_steal_pointer (&store));
+}
+
+/* Mirrors the shape of the biases Bazaar ships with */
+static GListModel *
+build_biases (void)
+{
+  g_autoptr (GListStore) store = NULL;
+
+  const struct
+  {
+    const char *regex;
+    const char *convert_to;
+    const char *boost_appids[4];
+    double      slope;
+    double      y_intercept;
+  } specs[] = {
+    { "^(?i)browser$", "web browser", { "io.example.App1", "io.example.App2", "io.example.App3", NULL }, 1.333, 40.0 },
+    { "\\b(?i)vm\\b", "virtual machine", { "io.example.App4", "io.example.App5", NULL }, 1.0, 50.0 },
+    { "\\b(?i)ide\\b", "develop", { "io.example.App6", NULL }, 1.0, 30.0 },
+    { "\\b(?i)dl\\b", "download", { NULL }, 0.0, 0.0 },
+    { "\\b(?i)yt\\b", "youtube", { NULL }, 0.0, 0.0 },
+    { "\\b(?i)vids?\\b", "video", { NULL }, 0.0, 0.0 },
+  };
+
+  store = g_list_store_new (BZ_TYPE_SEARCH_BIAS);
+  for (guint i = 0; i < G_N_ELEMENTS (specs); i++)
+    {
+      g_autoptr (BzSearchBias) bias = NULL;
+
+      bias = bz_search_bias_new ();
+      bz_search_bias_set_regex (bias, specs[i].regex);
+      bz_search_bias_set_convert_to (bias, specs[i].convert_to);
+
+      if (specs[i].boost_appids[0] != NULL)
+        {
+          g_autoptr (GtkStringList) appids    = NULL;
+          g_autoptr (BzLinearFunction) linear = NULL;
+
+          appids = gtk_string_list_new (specs[i].boost_appids);
+          linear = bz_linear_function_new ();
+          bz_linear_function_set_slope (linear, specs[i].slope);
+          bz_linear_function_set_y_intercept (linear, specs[i].y_intercept);
+
+          bz_search_bias_set_boost_appids (bias, G_LIST_MODEL (appids));
+          bz_search_bias_set_linear_boost (bias, linear);
+        }
+
+      g_list_store_append (store, bias);
+    }
+
+  return G_LIST_MODEL (g_steal_pointer (&store));
+}
+
+static char *
+random_phrase (GRand *rand,
+               guint  min_words,
+               guint  max_words)
+{
+  guint n_words           = 0;
+  g_autoptr (GString) out = NULL;
+
+  n_words = g_rand_int_range (rand, min_words, max_words + 1);
+  out     = g_string_new (NULL);
+  for (guint i = 0; i < n_words; i++)
+    {
+      if (i > 0)
+        g_string_append_c (out, ' ');
+      g_string_append (out, words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))]);
+    }
+
+  return g_string_free (g_steal_pointer (&out), FALSE);
+}
+
+/* Nearest rank, `sorted` must be in ascending order */
+static double
+percentile (GArray *sorted,
+            double  p)
+{
+  guint rank = 0;
+
+  if (sorted->len == 0)
+    return 0.0;
+
+  rank = (guint) ceil (p / 100.0 * sorted->len);
+  return g_array_index (sorted, double, CLAMP (rank, 1, sorted->len) - 1);
+}
+
+static gint
+cmp_double (const double *a,
+            const double *b)
+{
+  return (*a > *b) - (*a < *b);
+}
+
+/* End of bench-search.c */
@@ -22,6 +22,8 @@
 #define BAZAAR_MODULE "core"
 
 #define MAX_IDS_PER_BLOCKLIST 2048
+/* How many streamed entries to apply between filter updates */
+#define STREAM_FILTER_BATCH 256
 
 #include "config.h"
 
@@ -34,6 +36,7 @@
 #include "bz-auth-state.h"
 #include "bz-backend-notification.h"
 #include "bz-bundle-install-dialog.h"
+#include "bz-catalog-snapshot.h"
 #include "bz-content-provider.h"
 #include "bz-donations-dialog.h"
 #include "bz-download-worker.h"
@@ -57,6 +60,7 @@
 #include "bz-newline-parser.h"
 #include "bz-parser.h"
 #include "bz-preferences-dialog.h"
+#include "bz-refresh-frame.h"
 #include "bz-result.h"
 #include "bz-root-blocklist.h"
 #include "bz-root-curated-config.h"
@@ -100,6 +104,7 @@ struct _BzApplication
   GHashTable                 *ids_to_groups;
   GHashTable                 *ignore_eol_set;
   GHashTable                 *installed_set;
+  GHashTable                 *runtimes_to_group_ids;
   GHashTable                 *sys_name_to_addons;
   GHashTable                 *sys_ref_to_addon_group_ids;
   GHashTable                 *usr_name_to_addons;
@@ -184,6 +189,19 @@ BZ_DEFINE_DATA (
     BZ_RELEASE_DATA (self, bz_weak_release);
     BZ_RELEASE_DATA (id, g_free))
 
+BZ_DEFINE_DATA (
+    refresh_stream,
+    RefreshStream,
+    {
+      GWeakRef     *self;
+      GInputStream *stream;
+      GPtrArray    *entries;
+      gboolean      complete;
+    },
+    BZ_RELEASE_DATA (self, bz_weak_release);
+    BZ_RELEASE_DATA (stream, g_object_unref);
+    BZ_RELEASE_DATA (entries, g_ptr_array_unref))
+
 static DexFuture *
 init_fiber (GWeakRef *wr);
 
@@ -203,8 +221,11 @@ static DexFuture *
 open_flatpakref_fiber (OpenFlatpakrefData *data);
 
 static DexFuture *
-backend_sync_finally (DexFuture *future,
-                      GWeakRef  *wr);
+refresh_stream_fiber (RefreshStreamData *data);
+
+static DexFuture *
+backend_sync_finally (DexFuture         *future,
+                      RefreshStreamData *data);
 
 static DexFuture *
 init_fiber_finally (DexFuture *future,
@@ -242,6 +263,30 @@ static void
 fiber_replace_entry (BzApplication *self,
                      BzEntry       *entry);
 
+static void
+fiber_remove_entry (BzApplication *self,
+                    const char    *unique_id);
+
+static void
+fiber_link_addon (BzApplication *self,
+                  const char    *extension_of_what,
+                  gboolean       user,
+                  const char    *addon_id,
+                  gboolean       link);
+
+static void
+fiber_unlink_removed_entry (BzApplication *self,
+                            BzEntry       *entry);
+
+static void
+unlink_addon_group (BzApplication *self,
+                    BzEntry       *entry,
+                    const char    *id);
+
+static void
+sync_entry_addons (BzApplication *self,
+                   BzEntry       *entry);
+
 static void
 fiber_check_for_updates (BzApplication *self);
 
@@ -333,6 +378,10 @@ static gpointer
 map_ids_to_entries (GtkStringObject *string,
                     BzApplication   *self);
 
+static DexFuture *
+sync_entry_addons_then (DexFuture *future,
+                        GWeakRef  *wr);
+
 static gboolean
 filter_application_ids (GtkStringObject *string,
                         BzApplication   *self);
@@ -414,6 +463,7 @@ bz_application_dispose (GObject *object)
   g_clear_pointer (&self->ignore_eol_set, g_hash_table_unref);
   g_clear_pointer (&self->init_timer, g_timer_destroy);
   g_clear_pointer (&self->installed_set, g_hash_table_unref);
+  g_clear_pointer (&self->runtimes_to_group_ids, g_hash_table_unref);
   g_clear_pointer (&self->sys_name_to_addons, g_hash_table_unref);
   g_clear_pointer (&self->txt_blocked_id_sets, g_ptr_array_unref);
   g_clear_pointer (&self->usr_name_to_addons, g_hash_table_unref);
@@ -446,6 +496,8 @@ bz_application_command_line (GApplication            *app,
   g_auto (GStrv) content_configs_strv = NULL;
   g_auto (GStrv) locations            = NULL;
   gboolean preview_metainfo           = FALSE;
+  g_autofree char *export_catalog     = NULL;
+  g_autofree char *import_catalog     = NULL;
 
   GOptionEntry main_entries[] = {
     { "help", 0, 0, G_OPTION_ARG_NONE, &help, "Print help" },
@@ -455,6 +507,8 @@ bz_application_command_line (GApplication            *app,
     /* Here for backwards compat */
     { "extra-content-config", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &content_configs_strv, "Add an extra yaml file with which to configure the app browser (backwards compat)" },
     { "preview-metainfo", 0, 0, G_OPTION_ARG_NONE, &preview_metainfo, "Preview a metainfo file by selecting it via file dialog" },
+    { "export-catalog", 0, 0, G_OPTION_ARG_FILENAME, &export_catalog, "Write the cached catalog to a file and exit", "FILE" },
+    { "import-catalog", 0, 0, G_OPTION_ARG_FILENAME, &import_catalog, "Seed the cache with a catalog written by --export-catalog before starting", "FILE" },
     { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &locations, "flatpakref file to open" },
     { NULL }
   };
@@ -497,6 +551,42 @@ bz_application_command_line (GApplication            *app,
         }
     }
 
+  if (export_catalog != NULL)
+    {
+      g_autoptr (GFile) file = NULL;
+      g_autofree char *path  = NULL;
+
+      file = g_application_command_line_create_file_for_arg (cmdline, export_catalog);
+      path = g_file_get_path (file);
+      if (!bz_catalog_snapshot_export (path, &local_error))
+        {
+          g_application_command_line_printerr (cmdline, "Failed to export catalog: %s\n", local_error->message);
+          return EXIT_FAILURE;
+        }
+      return EXIT_SUCCESS;
+    }
+
+  if (import_catalog != NULL)
+    {
+      g_autoptr (GFile) file = NULL;
+      g_autofree char *path  = NULL;
+
+      /* The cache is swapped out from under us */
+      if (self->running)
+        {
+          g_application_command_line_printerr (cmdline, "Cannot import a catalog while the Bazaar service is running\n");
+          return EXIT_FAILURE;
+        }
+
+      file = g_application_command_line_create_file_for_arg (cmdline, import_catalog);
+      path = g_file_get_path (file);
+      if (!bz_catalog_snapshot_import (path, &local_error))
+        {
+          g_application_command_line_printerr (cmdline, "Failed to import catalog: %s\n", local_error->message);
+          return EXIT_FAILURE;
+        }
+    }
+
   if (!self->running)
     {
       g_autoptr (GtkStringList) blocklists      = NULL;
@@ -1148,20 +1238,11 @@ init_fiber (GWeakRef *wr)
               &local_error);
           if (bytes != NULL)
             {
-              g_autoptr (GVariant) variant       = NULL;
               g_autoptr (BzFlathubState) flathub = NULL;
 
-              variant = g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, bytes, FALSE);
-              if (variant == NULL)
-                {
-                  g_warning ("Failed to interpret cached flathub state from %s: %s",
-                             flathub_cache, local_error->message);
-                  g_clear_error (&local_error);
-                }
-
               flathub = bz_flathub_state_new ();
-              result  = bz_serializable_deserialize (
-                  BZ_SERIALIZABLE (flathub), variant, &local_error);
+              result  = bz_serializable_load_bytes (
+                  BZ_SERIALIZABLE (flathub), bytes, NULL, &local_error);
               if (result)
                 {
                   self->flathub = g_steal_pointer (&flathub);
@@ -1306,14 +1387,9 @@ cache_flathub_fiber (GWeakRef *wr)
   flathub_cache_file = fiber_dup_flathub_cache_file (&flathub_cache, &local_error);
   if (flathub_cache_file != NULL)
     {
-      g_autoptr (GVariantBuilder) builder = NULL;
-      g_autoptr (GVariant) variant        = NULL;
-      g_autoptr (GBytes) bytes            = NULL;
+      g_autoptr (GBytes) bytes = NULL;
 
-      builder = g_variant_builder_new (G_VARIANT_TYPE_VARDICT);
-      bz_serializable_serialize (BZ_SERIALIZABLE (self->flathub), builder);
-      variant = g_variant_builder_end (builder);
-      bytes   = g_variant_get_data_as_bytes (variant);
+      bytes = bz_serializable_dup_bytes (BZ_SERIALIZABLE (self->flathub));
 
       result = dex_await (
           dex_file_replace_contents_bytes (
@@ -1443,6 +1519,15 @@ respond_to_flatpak_fiber (RespondToFlatpakData *data)
             update_labels = TRUE;
           }
           break;
+        case BZ_BACKEND_NOTIFICATION_KIND_KEEP_ENTRY:
+          /* We already have it */
+          self->n_entries_incoming--;
+          update_labels = TRUE;
+          break;
+        case BZ_BACKEND_NOTIFICATION_KIND_REMOVE_ENTRY:
+          fiber_remove_entry (self, bz_backend_notification_get_unique_id (notif));
+          update_filters = TRUE;
+          break;
         case BZ_BACKEND_NOTIFICATION_KIND_REMOTE_SYNC_START:
           {
             const char *remote_name = NULL;
@@ -1578,6 +1663,8 @@ respond_to_flatpak_fiber (RespondToFlatpakData *data)
               case BZ_BACKEND_NOTIFICATION_KIND_REMOTE_SYNC_START:
               case BZ_BACKEND_NOTIFICATION_KIND_REPLACE_ENTRY:
               case BZ_BACKEND_NOTIFICATION_KIND_TELL_INCOMING:
+              case BZ_BACKEND_NOTIFICATION_KIND_KEEP_ENTRY:
+              case BZ_BACKEND_NOTIFICATION_KIND_REMOVE_ENTRY:
               default:
                 g_assert_not_reached ();
               };
@@ -1949,22 +2036,160 @@ init_sync_finally (DexFuture *future,
 }
 
 static DexFuture *
-backend_sync_finally (DexFuture *future,
-                      GWeakRef  *wr)
+backend_sync_finally (DexFuture         *future,
+                      RefreshStreamData *data)
 {
   g_autoptr (BzApplication) self = NULL;
 
-  bz_weak_get_or_return_reject (self, wr);
+  bz_weak_get_or_return_reject (self, data->self);
 
-  if (dex_future_is_resolved (future))
-    return dex_scheduler_spawn (
-        dex_scheduler_get_default (),
-        bz_get_dex_stack_size (),
-        (DexFiberFunc) enumerate_disk_entries_fiber,
-        bz_track_weak (self),
-        bz_weak_release);
-  else
+  if (!dex_future_is_resolved (future))
     return dex_ref (future);
+
+  /* The worker has published its cache generation by now, so the cache
+   * manager can take over handing out these entries */
+  if (data->complete)
+    {
+      g_ptr_array_set_size (data->entries, 0);
+      return dex_future_new_true ();
+    }
+
+  return dex_scheduler_spawn (
+      dex_scheduler_get_default (),
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) enumerate_disk_entries_fiber,
+      bz_track_weak (self),
+      bz_weak_release);
+}
+
+static GBytes *
+fiber_read_exactly (GInputStream *stream,
+                    gsize         count,
+                    GError      **error)
+{
+  g_autoptr (GByteArray) buffer = NULL;
+
+  buffer = g_byte_array_sized_new (count);
+  while (buffer->len < count)
+    {
+      g_autoptr (GBytes) bytes = NULL;
+      gsize         size       = 0;
+      gconstpointer data       = NULL;
+
+      bytes = dex_await_boxed (
+          dex_input_stream_read_bytes (
+              stream, count - buffer->len, G_PRIORITY_DEFAULT),
+          error);
+      if (bytes == NULL)
+        return NULL;
+
+      data = g_bytes_get_data (bytes, &size);
+      if (size == 0)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                       "Unexpected end of stream");
+          return NULL;
+        }
+      if (buffer->len == 0 && size == count)
+        return g_steal_pointer (&bytes);
+
+      g_byte_array_append (buffer, data, size);
+    }
+
+  return g_byte_array_free_to_bytes (g_steal_pointer (&buffer));
+}
+
+/* Applies entries as the refresh worker produces them. See write_frame ()
+ * in refresh-worker.c for the framing. The worker persists the same
+ * entries in parallel, so until it exits we keep them alive and have the
+ * cache manager hand them out in place of whatever is on disk */
+static DexFuture *
+refresh_stream_fiber (RefreshStreamData *data)
+{
+  g_autoptr (BzApplication) self = NULL;
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GPtrArray) adopts   = NULL;
+  guint n_applied                = 0;
+
+  bz_weak_get_or_return_reject (self, data->self);
+
+  adopts = g_ptr_array_new_with_free_func (dex_unref);
+  for (;;)
+    {
+      g_autoptr (GBytes) header  = NULL;
+      g_autoptr (GBytes) payload = NULL;
+      g_autoptr (BzEntry) entry  = NULL;
+      guint32  length            = 0;
+      gboolean tombstone         = FALSE;
+      gboolean result            = FALSE;
+
+      header = fiber_read_exactly (data->stream, sizeof (length), &local_error);
+      if (header == NULL)
+        break;
+      memcpy (&length, g_bytes_get_data (header, NULL), sizeof (length));
+      length    = GUINT32_FROM_LE (length);
+      tombstone = (length & BZ_REFRESH_FRAME_TOMBSTONE) != 0;
+      length &= BZ_REFRESH_FRAME_LENGTH_MASK;
+      if (length == 0)
+        {
+          data->complete = TRUE;
+          break;
+        }
+
+      payload = fiber_read_exactly (data->stream, length, &local_error);
+      if (payload == NULL)
+        break;
+
+      if (tombstone)
+        {
+          g_autofree char *unique_id = NULL;
+
+          unique_id = g_strndup (g_bytes_get_data (payload, NULL), length);
+          fiber_remove_entry (self, unique_id);
+          continue;
+        }
+
+      entry  = g_object_new (BZ_TYPE_FLATPAK_ENTRY, NULL);
+      result = bz_serializable_load_bytes (
+          BZ_SERIALIZABLE (entry), payload, NULL, &local_error);
+      if (!result)
+        break;
+
+      fiber_replace_entry (self, entry);
+      g_ptr_array_add (adopts, bz_entry_cache_manager_adopt (self->cache, entry));
+      g_ptr_array_add (data->entries, g_steal_pointer (&entry));
+
+      if (++n_applied % STREAM_FILTER_BATCH == 0)
+        {
+          gtk_filter_changed (GTK_FILTER (self->group_filter), GTK_FILTER_CHANGE_LESS_STRICT);
+          gtk_filter_changed (GTK_FILTER (self->appid_filter), GTK_FILTER_CHANGE_LESS_STRICT);
+        }
+    }
+
+  if (!data->complete)
+    {
+      if (local_error != NULL)
+        g_warning ("Entry stream from the refresh worker was interrupted, "
+                   "falling back to reading the cache: %s",
+                   local_error->message);
+
+      /* Keep the worker from blocking on a full pipe */
+      while (dex_await_int64 (
+                 dex_input_stream_skip (data->stream, G_MAXUINT16, G_PRIORITY_DEFAULT),
+                 NULL) > 0)
+        ;
+    }
+
+  if (adopts->len > 0)
+    dex_await (dex_future_allv (
+                   (DexFuture *const *) adopts->pdata,
+                   adopts->len),
+               NULL);
+
+  gtk_filter_changed (GTK_FILTER (self->group_filter), GTK_FILTER_CHANGE_LESS_STRICT);
+  gtk_filter_changed (GTK_FILTER (self->appid_filter), GTK_FILTER_CHANGE_LESS_STRICT);
+
+  return dex_future_new_true ();
 }
 
 static DexFuture *
@@ -2072,6 +2297,50 @@ watch_backend_notifs_then_loop_cb (DexFuture *future,
   return g_steal_pointer (&ret_future);
 }
 
+/* Takes an entry whose ref left its remote out of its group, and the group
+ * out of the catalog once nothing is left in it. Installed refs stay, since
+ * they can still be run and removed */
+static void
+fiber_remove_entry (BzApplication *self,
+                    const char    *unique_id)
+{
+  g_autoptr (BzEntry) entry      = NULL;
+  g_autoptr (BzEntryGroup) group = NULL;
+  const char *id                 = NULL;
+  guint       position           = 0;
+
+  if (unique_id == NULL ||
+      g_hash_table_contains (self->installed_set, unique_id))
+    return;
+
+  entry = dex_await_object (
+      bz_entry_cache_manager_get (self->cache, unique_id),
+      NULL);
+  if (entry == NULL)
+    return;
+
+  fiber_unlink_removed_entry (self, entry);
+
+  id    = bz_entry_get_id (entry);
+  group = bz_object_maybe_ref (g_hash_table_lookup (self->ids_to_groups, id));
+  if (group == NULL)
+    return;
+
+  g_debug ("Removing %s from application group %s", unique_id, id);
+  bz_entry_group_remove (group, unique_id);
+  if (g_list_model_get_n_items (bz_entry_group_get_model (group)) > 0)
+    return;
+
+  if (bz_entry_group_is_addon (group))
+    unlink_addon_group (self, entry, id);
+
+  if (g_list_store_find (self->groups, group, &position))
+    g_list_store_remove (self->groups, position);
+  if (g_list_store_find (self->installed_apps, group, &position))
+    g_list_store_remove (self->installed_apps, position);
+  g_hash_table_remove (self->ids_to_groups, id);
+}
+
 static BzEntryGroup *
 ensure_group_and_add (BzApplication *self,
                       const char    *id,
@@ -2139,25 +2408,7 @@ fiber_replace_entry (BzApplication *self,
     bz_entry_set_installed_version (entry, version);
 
   flatpak_id = bz_flatpak_entry_get_flatpak_id (BZ_FLATPAK_ENTRY (entry));
-  if (flatpak_id != NULL)
-    {
-      GPtrArray *addons = NULL;
-
-      addons = g_hash_table_lookup (name_to_addons, flatpak_id);
-      if (addons != NULL)
-        {
-          g_debug ("Appending %d addons to %s", addons->len, unique_id);
-          for (guint i = 0; i < addons->len; i++)
-            {
-              const char *addon_id = NULL;
-
-              addon_id = g_ptr_array_index (addons, i);
-              bz_entry_append_addon (entry, addon_id);
-            }
-          g_hash_table_remove (name_to_addons, flatpak_id);
-          addons = NULL;
-        }
-    }
+  sync_entry_addons (self, entry);
 
   if (bz_entry_is_of_kinds (entry, BZ_ENTRY_KIND_APPLICATION))
     {
@@ -2188,6 +2439,23 @@ fiber_replace_entry (BzApplication *self,
 
       group = ensure_group_and_add (self, id, entry, eol_runtime, ignore_eol, installed);
 
+      /* Remembered so a runtime reaching its end of life later on still
+       * marks groups whose apps did not change */
+      if (!ignore_eol &&
+          runtime_name != NULL)
+        {
+          GHashTable *group_ids = NULL;
+
+          group_ids = g_hash_table_lookup (self->runtimes_to_group_ids, runtime_name);
+          if (group_ids == NULL)
+            {
+              group_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+              g_hash_table_replace (self->runtimes_to_group_ids,
+                                    g_strdup (runtime_name), group_ids);
+            }
+          g_hash_table_add (group_ids, g_strdup (id));
+        }
+
       ref_to_addon_group_ids =
           user
               ? self->usr_ref_to_addon_group_ids
@@ -2212,10 +2480,30 @@ fiber_replace_entry (BzApplication *self,
 
       eol = bz_entry_get_eol (entry);
       if (eol != NULL)
-        g_hash_table_replace (
-            self->eol_runtimes,
-            g_strdup (stripped),
-            g_strdup (unique_id_checksum));
+        {
+          GHashTable    *group_ids = NULL;
+          GHashTableIter iter      = { 0 };
+          const char    *group_id  = NULL;
+
+          g_hash_table_replace (
+              self->eol_runtimes,
+              g_strdup (stripped),
+              g_strdup (unique_id_checksum));
+
+          group_ids = g_hash_table_lookup (self->runtimes_to_group_ids, stripped);
+          if (group_ids != NULL)
+            {
+              g_hash_table_iter_init (&iter, group_ids);
+              while (g_hash_table_iter_next (&iter, (gpointer *) &group_id, NULL))
+                {
+                  BzEntryGroup *group = NULL;
+
+                  group = g_hash_table_lookup (self->ids_to_groups, group_id);
+                  if (group != NULL)
+                    bz_entry_group_set_eol (group, eol);
+                }
+            }
+        }
       else
         g_hash_table_remove (self->eol_runtimes, stripped);
     }
@@ -2267,7 +2555,8 @@ fiber_replace_entry (BzApplication *self,
         {
           GPtrArray *addons = NULL;
 
-          /* BzFlatpakInstance ensures addons come before applications */
+          /* Kept for good, since an app which changes later on has to
+           * inherit addons which did not */
           addons = g_hash_table_lookup (name_to_addons, extension_of_what);
           if (addons == NULL)
             {
@@ -2276,7 +2565,11 @@ fiber_replace_entry (BzApplication *self,
                   name_to_addons,
                   g_strdup (extension_of_what), addons);
             }
-          g_ptr_array_add (addons, g_strdup (unique_id));
+          if (!g_ptr_array_find_with_equal_func (addons, unique_id, g_str_equal, NULL))
+            {
+              g_ptr_array_add (addons, g_strdup (unique_id));
+              fiber_link_addon (self, extension_of_what, user, unique_id, TRUE);
+            }
         }
       else
         g_warning ("Entry with unique id %s is an addon but "
@@ -2285,6 +2578,204 @@ fiber_replace_entry (BzApplication *self,
     }
 }
 
+/* Hands a new addon to the entries of its app which are already out
+ * there, since those are not going to be replaced, or takes a removed
+ * one back from them */
+static void
+fiber_link_addon (BzApplication *self,
+                  const char    *extension_of_what,
+                  gboolean       user,
+                  const char    *addon_id,
+                  gboolean       link)
+{
+  g_auto (GStrv) parts           = NULL;
+  g_autoptr (BzEntryGroup) group = NULL;
+  g_autoptr (GPtrArray) ids      = NULL;
+  GListModel *model              = NULL;
+  guint       n_items            = 0;
+
+  parts = g_strsplit (extension_of_what, "/", -1);
+  if (parts[0] == NULL || parts[1] == NULL)
+    return;
+
+  group = bz_object_maybe_ref (g_hash_table_lookup (self->ids_to_groups, parts[1]));
+  if (group == NULL)
+    return;
+
+  model   = bz_entry_group_get_model (group);
+  n_items = g_list_model_get_n_items (model);
+  ids     = g_ptr_array_new_with_free_func (g_free);
+  for (guint i = 0; i < n_items; i++)
+    g_ptr_array_add (ids, g_strdup (gtk_string_list_get_string (GTK_STRING_LIST (model), i)));
+
+  for (guint i = 0; i < ids->len; i++)
+    {
+      g_autoptr (BzEntry) entry = NULL;
+
+      entry = dex_await_object (
+          bz_entry_cache_manager_get_living (self->cache, g_ptr_array_index (ids, i)),
+          NULL);
+      if (entry == NULL ||
+          !BZ_IS_FLATPAK_ENTRY (entry) ||
+          !!bz_flatpak_entry_is_user (BZ_FLATPAK_ENTRY (entry)) != !!user ||
+          g_strcmp0 (bz_flatpak_entry_get_flatpak_id (BZ_FLATPAK_ENTRY (entry)),
+                     extension_of_what) != 0)
+        continue;
+
+      if (link)
+        bz_entry_append_addon (entry, addon_id);
+      else
+        bz_entry_remove_addon (entry, addon_id);
+    }
+}
+
+static void
+sync_entry_addons (BzApplication *self,
+                   BzEntry       *entry)
+{
+  const char *flatpak_id     = NULL;
+  GHashTable *name_to_addons = NULL;
+  GPtrArray  *addons         = NULL;
+  GListModel *entry_addons   = NULL;
+
+  if (!BZ_IS_FLATPAK_ENTRY (entry))
+    return;
+
+  flatpak_id = bz_flatpak_entry_get_flatpak_id (BZ_FLATPAK_ENTRY (entry));
+  if (flatpak_id == NULL)
+    return;
+
+  name_to_addons = bz_flatpak_entry_is_user (BZ_FLATPAK_ENTRY (entry))
+                       ? self->usr_name_to_addons
+                       : self->sys_name_to_addons;
+  addons         = g_hash_table_lookup (name_to_addons, flatpak_id);
+
+  /* Copies on the disk may still list addons which were removed since */
+  entry_addons = bz_entry_get_addons (entry);
+  if (entry_addons != NULL)
+    {
+      for (guint i = g_list_model_get_n_items (entry_addons); i > 0; i--)
+        {
+          g_autoptr (GtkStringObject) string = NULL;
+          const char *addon_id               = NULL;
+
+          string   = g_list_model_get_item (entry_addons, i - 1);
+          addon_id = gtk_string_object_get_string (string);
+          if (addons == NULL ||
+              !g_ptr_array_find_with_equal_func (addons, addon_id, g_str_equal, NULL))
+            bz_entry_remove_addon (entry, addon_id);
+        }
+    }
+
+  if (addons == NULL)
+    return;
+
+  for (guint i = 0; i < addons->len; i++)
+    bz_entry_append_addon (entry, g_ptr_array_index (addons, i));
+}
+
+/* Forgets whatever links the rest of the catalog had to an entry which
+ * is gone */
+static void
+fiber_unlink_removed_entry (BzApplication *self,
+                            BzEntry       *entry)
+{
+  const char *unique_id          = NULL;
+  const char *unique_id_checksum = NULL;
+  const char *flatpak_id         = NULL;
+  gboolean    user               = FALSE;
+
+  if (!BZ_IS_FLATPAK_ENTRY (entry))
+    return;
+
+  unique_id          = bz_entry_get_unique_id (entry);
+  unique_id_checksum = bz_entry_get_unique_id_checksum (entry);
+  flatpak_id         = bz_flatpak_entry_get_flatpak_id (BZ_FLATPAK_ENTRY (entry));
+  user               = bz_flatpak_entry_is_user (BZ_FLATPAK_ENTRY (entry));
+
+  if (flatpak_id != NULL &&
+      unique_id_checksum != NULL &&
+      bz_entry_is_of_kinds (entry, BZ_ENTRY_KIND_RUNTIME) &&
+      g_str_has_prefix (flatpak_id, "runtime/"))
+    {
+      const char *stripped = NULL;
+
+      stripped = flatpak_id + strlen ("runtime/");
+      if (g_strcmp0 (g_hash_table_lookup (self->eol_runtimes, stripped),
+                     unique_id_checksum) == 0)
+        g_hash_table_remove (self->eol_runtimes, stripped);
+    }
+
+  if (unique_id != NULL &&
+      bz_entry_is_of_kinds (entry, BZ_ENTRY_KIND_ADDON))
+    {
+      const char *extension_of_what = NULL;
+      GHashTable *name_to_addons    = NULL;
+      GPtrArray  *addons            = NULL;
+      guint       index             = 0;
+
+      extension_of_what = bz_flatpak_entry_get_addon_extension_of_ref (
+          BZ_FLATPAK_ENTRY (entry));
+      if (extension_of_what == NULL)
+        return;
+
+      name_to_addons = user ? self->usr_name_to_addons : self->sys_name_to_addons;
+      addons         = g_hash_table_lookup (name_to_addons, extension_of_what);
+      if (addons != NULL &&
+          g_ptr_array_find_with_equal_func (addons, unique_id, g_str_equal, &index))
+        {
+          g_ptr_array_remove_index (addons, index);
+          if (addons->len == 0)
+            g_hash_table_remove (name_to_addons, extension_of_what);
+        }
+
+      fiber_link_addon (self, extension_of_what, user, unique_id, FALSE);
+    }
+}
+
+/* Takes the group of an addon which is gone for good
+ * out of the list of addons its app offers */
+static void
+unlink_addon_group (BzApplication *self,
+                    BzEntry       *entry,
+                    const char    *id)
+{
+  const char *extension_of_what  = NULL;
+  g_auto (GStrv) parts           = NULL;
+  BzEntryGroup *app_group        = NULL;
+  GHashTable   *ref_to_group_ids = NULL;
+  GPtrArray    *pending          = NULL;
+  guint         index            = 0;
+
+  if (!BZ_IS_FLATPAK_ENTRY (entry))
+    return;
+
+  extension_of_what = bz_flatpak_entry_get_addon_extension_of_ref (
+      BZ_FLATPAK_ENTRY (entry));
+  if (extension_of_what == NULL)
+    return;
+
+  parts = g_strsplit (extension_of_what, "/", -1);
+  if (parts[0] == NULL || parts[1] == NULL)
+    return;
+
+  app_group = g_hash_table_lookup (self->ids_to_groups, parts[1]);
+  if (app_group != NULL)
+    bz_entry_group_remove_addon_group_id (app_group, id);
+
+  ref_to_group_ids = bz_flatpak_entry_is_user (BZ_FLATPAK_ENTRY (entry))
+                         ? self->usr_ref_to_addon_group_ids
+                         : self->sys_ref_to_addon_group_ids;
+  pending          = g_hash_table_lookup (ref_to_group_ids, parts[1]);
+  if (pending != NULL &&
+      g_ptr_array_find_with_equal_func (pending, id, g_str_equal, &index))
+    {
+      g_ptr_array_remove_index (pending, index);
+      if (pending->len == 0)
+        g_hash_table_remove (ref_to_group_ids, parts[1]);
+    }
+}
+
 static void
 fiber_check_for_updates (BzApplication *self)
 {
@@ -3147,6 +3638,8 @@ init_service_struct (BzApplication *self,
       g_str_hash, g_str_equal, g_free, g_object_unref);
   self->eol_runtimes = g_hash_table_new_full (
       g_str_hash, g_str_equal, g_free, g_free);
+  self->runtimes_to_group_ids = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_hash_table_unref);
   self->sys_name_to_addons = g_hash_table_new_full (
       g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
   self->usr_name_to_addons = g_hash_table_new_full (
@@ -3564,12 +4057,34 @@ map_ids_to_entries (GtkStringObject *string,
 
   id     = gtk_string_object_get_string (string);
   future = bz_entry_cache_manager_get (self->cache, id);
+  /* Entries coming back from the disk know nothing
+   * of addons which are attached on our side */
+  future = dex_future_then (
+      g_steal_pointer (&future),
+      (DexFutureCallback) sync_entry_addons_then,
+      bz_track_weak (self),
+      bz_weak_release);
   result = bz_result_new (future);
 
   g_object_unref (string);
   return g_steal_pointer (&result);
 }
 
+static DexFuture *
+sync_entry_addons_then (DexFuture *future,
+                        GWeakRef  *wr)
+{
+  g_autoptr (BzApplication) self = NULL;
+  const GValue *value            = NULL;
+
+  bz_weak_get_or_return_reject (self, wr);
+
+  value = dex_future_get_value (future, NULL);
+  sync_entry_addons (self, g_value_get_object (value));
+
+  return dex_ref (future);
+}
+
 static gboolean
 filter_application_ids (GtkStringObject *string,
                         BzApplication   *self)
@@ -3713,6 +4228,8 @@ make_sync_future (BzApplication *self)
 {
   g_autoptr (GError) local_error         = NULL;
   g_autoptr (GSubprocess) refresh_worker = NULL;
+  g_autoptr (RefreshStreamData) stream   = NULL;
+  g_autoptr (DexFuture) stream_future    = NULL;
   g_autoptr (DexFuture) backend_future   = NULL;
   g_autoptr (DexFuture) flathub_future   = NULL;
   g_autoptr (DexFuture) ret_future       = NULL;
@@ -3723,7 +4240,7 @@ make_sync_future (BzApplication *self)
   finish_with_background_task_label (self);
 
   refresh_worker = g_subprocess_new (
-      G_SUBPROCESS_FLAGS_NONE,
+      G_SUBPROCESS_FLAGS_STDOUT_PIPE,
       &local_error,
       REFRESH_WORKER_BIN_NAME,
       NULL);
@@ -3732,11 +4249,27 @@ make_sync_future (BzApplication *self)
                 local_error->message);
   g_assert (refresh_worker != NULL);
 
-  backend_future = dex_subprocess_wait_check (refresh_worker);
+  stream          = refresh_stream_data_new ();
+  stream->self    = bz_track_weak (self);
+  stream->stream  = g_object_ref (g_subprocess_get_stdout_pipe (refresh_worker));
+  stream->entries = g_ptr_array_new_with_free_func (g_object_unref);
+
+  stream_future = dex_scheduler_spawn (
+      dex_scheduler_get_default (),
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) refresh_stream_fiber,
+      refresh_stream_data_ref (stream),
+      refresh_stream_data_unref);
+
+  backend_future = dex_future_all (
+      dex_subprocess_wait_check (refresh_worker),
+      g_steal_pointer (&stream_future),
+      NULL);
   backend_future = dex_future_finally (
       backend_future,
       (DexFutureCallback) backend_sync_finally,
-      bz_track_weak (self), bz_weak_release);
+      refresh_stream_data_ref (stream),
+      refresh_stream_data_unref);
 
   g_clear_object (&self->tmp_flathub);
   self->tmp_flathub = bz_flathub_state_new ();
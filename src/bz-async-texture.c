@@ -604,7 +604,6 @@ load_fiber_work (LoadData *data)
   gboolean is_http                      = FALSE;
   g_autoptr (GDateTime) now             = NULL;
   g_autofree char *async_tex_data_path  = NULL;
-  g_autoptr (GFile) async_tex_data_file = NULL;
   g_autoptr (GdkTexture) texture        = NULL;
   g_autoptr (GlyFrame) frame            = NULL;
 
@@ -674,25 +673,26 @@ load_fiber_work (LoadData *data)
   is_http = g_str_has_prefix (source_uri, "http");
   now     = g_date_time_new_now_utc ();
   if (cache_into != NULL)
-    {
-      async_tex_data_path = g_strdup_printf ("%s.bz-async-texture-data", cache_into_path);
-      async_tex_data_file = g_file_new_for_path (async_tex_data_path);
-    }
+    async_tex_data_path = g_strdup_printf ("%s.bz-async-texture-data", cache_into_path);
 
   if (cache_into != NULL)
     {
+      g_autoptr (GBytes) bytes = NULL;
+
       RATE_LIMIT_BEGIN (io);
 
-      if (g_file_query_exists (cache_into, NULL) &&
-          g_file_query_exists (async_tex_data_file, NULL))
+      /* A missing metadata file just means nothing was cached yet */
+      bytes = bz_read_path_bytes (async_tex_data_path, &local_error);
+      if (bytes == NULL &&
+          g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        g_clear_pointer (&local_error, g_error_free);
+      else if (g_file_query_exists (cache_into, NULL))
         {
-          g_autoptr (GBytes) bytes     = NULL;
           g_autoptr (GVariant) variant = NULL;
           GTimeSpan age_span           = 0;
           g_autoptr (GlyLoader) loader = NULL;
           g_autoptr (GlyImage) image   = NULL;
 
-          bytes = g_file_load_bytes (async_tex_data_file, NULL, NULL, &local_error);
           if (bytes != NULL)
             variant = g_variant_new_from_bytes (G_VARIANT_TYPE ("a{sv}"), bytes, FALSE);
           if (variant != NULL)
@@ -762,6 +762,7 @@ load_fiber_work (LoadData *data)
                 }
             }
         }
+      g_clear_pointer (&local_error, g_error_free);
 
       RATE_LIMIT_END ();
     }
@@ -889,12 +890,11 @@ load_fiber_work (LoadData *data)
 
       RATE_LIMIT_END ();
 
-      if (async_tex_data_file != NULL)
+      if (async_tex_data_path != NULL)
         {
           g_autoptr (GVariantBuilder) builder  = NULL;
           g_autoptr (GVariant) variant         = NULL;
           g_autoptr (GBytes) bytes             = NULL;
-          g_autoptr (GFileOutputStream) output = NULL;
 
           builder = g_variant_builder_new (G_VARIANT_TYPE ("a{sv}"));
           g_variant_builder_add (
@@ -908,21 +908,7 @@ load_fiber_work (LoadData *data)
 
           RATE_LIMIT_BEGIN (io);
 
-          output = g_file_replace (
-              async_tex_data_file,
-              NULL,
-              FALSE,
-              G_FILE_CREATE_REPLACE_DESTINATION,
-              NULL,
-              &local_error);
-          if (output != NULL)
-            {
-              gssize bytes_written = 0;
-
-              bytes_written = g_output_stream_write_bytes (G_OUTPUT_STREAM (output), bytes, NULL, &local_error);
-              if (bytes_written > 0)
-                g_output_stream_close (G_OUTPUT_STREAM (output), NULL, &local_error);
-            }
+          bz_write_path_bytes (async_tex_data_path, bytes, &local_error);
 
           RATE_LIMIT_END ();
 
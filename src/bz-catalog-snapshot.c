@@ -0,0 +1,377 @@
+/* bz-catalog-snapshot.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "BAZAAR::CATALOG-SNAPSHOT"
+
+#define SNAPSHOT_MAGIC "bazaar-catalog"
+/* magic, bazaar version, exporting cache dir, then (path, contents, mtime) */
+#define SNAPSHOT_TYPE "(sssa(sayx))"
+
+#include "config.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include "bz-catalog-snapshot.h"
+#include "bz-io.h"
+
+/* Relative to the root cache dir */
+static const char *const skip_paths[] = {
+  "core/bundle-staging",
+  /* Keyed on local appstream mtimes, so useless elsewhere */
+  "flatpak-silos",
+  BZ_CATALOG_ORIGIN_FILE,
+  NULL,
+};
+
+static gboolean
+collect_files (const char      *root,
+               const char      *relative,
+               GVariantBuilder *builder,
+               GError         **error)
+{
+  g_autofree char *dir_path = NULL;
+  g_autoptr (GDir) dir      = NULL;
+  const char *name          = NULL;
+
+  dir_path = relative != NULL
+                 ? g_build_filename (root, relative, NULL)
+                 : g_strdup (root);
+  dir = g_dir_open (dir_path, 0, error);
+  if (dir == NULL)
+    return FALSE;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree char *child_relative = NULL;
+      g_autofree char *child_path     = NULL;
+      GStatBuf         st             = { 0 };
+      g_autoptr (GMappedFile) mapped  = NULL;
+      g_autoptr (GBytes) bytes        = NULL;
+
+      child_relative = relative != NULL
+                           ? g_build_filename (relative, name, NULL)
+                           : g_strdup (name);
+      if (g_strv_contains (skip_paths, child_relative))
+        continue;
+
+      child_path = g_build_filename (root, child_relative, NULL);
+      if (g_lstat (child_path, &st) != 0)
+        /* Removed while we were looking */
+        continue;
+
+      if (S_ISDIR (st.st_mode))
+        {
+          if (!collect_files (root, child_relative, builder, error))
+            return FALSE;
+          continue;
+        }
+      else if (!S_ISREG (st.st_mode))
+        continue;
+
+      /* Mapped so nothing is copied until the snapshot is serialized */
+      mapped = g_mapped_file_new (child_path, FALSE, error);
+      if (mapped == NULL)
+        return FALSE;
+      bytes = g_mapped_file_get_bytes (mapped);
+
+      g_variant_builder_add (
+          builder, "(s@ayx)",
+          child_relative,
+          g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, bytes, TRUE),
+          (gint64) st.st_mtime);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+is_safe_relative_path (const char *path)
+{
+  g_auto (GStrv) components = NULL;
+
+  if (*path == '\0' || g_path_is_absolute (path))
+    return FALSE;
+
+  components = g_strsplit (path, G_DIR_SEPARATOR_S, -1);
+  for (guint i = 0; components[i] != NULL; i++)
+    {
+      if (*components[i] == '\0' ||
+          g_strcmp0 (components[i], ".") == 0 ||
+          g_strcmp0 (components[i], "..") == 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+extract_files (const char *into,
+               GVariant   *files,
+               GError    **error)
+{
+  gsize n_files = 0;
+
+  n_files = g_variant_n_children (files);
+  for (gsize i = 0; i < n_files; i++)
+    {
+      const char *relative          = NULL;
+      g_autoptr (GVariant) contents = NULL;
+      gint64           mtime        = 0;
+      g_autofree char *path         = NULL;
+      g_autofree char *parent       = NULL;
+      gconstpointer    data         = NULL;
+      gsize            size         = 0;
+      struct utimbuf   times        = { 0 };
+      gboolean         result       = FALSE;
+
+      g_variant_get_child (files, i, "(&s@ayx)", &relative, &contents, &mtime);
+      if (!is_safe_relative_path (relative))
+        {
+          g_set_error (
+              error,
+              G_IO_ERROR,
+              G_IO_ERROR_INVALID_DATA,
+              "Catalog snapshot contains an invalid path '%s'",
+              relative);
+          return FALSE;
+        }
+
+      path   = g_build_filename (into, relative, NULL);
+      parent = g_path_get_dirname (path);
+      if (g_mkdir_with_parents (parent, 0755) != 0)
+        {
+          int errsv = errno;
+
+          g_set_error (
+              error,
+              G_IO_ERROR,
+              g_io_error_from_errno (errsv),
+              "Failed to create directory %s: %s",
+              parent, g_strerror (errsv));
+          return FALSE;
+        }
+
+      data   = g_variant_get_fixed_array (contents, &size, sizeof (guint8));
+      result = g_file_set_contents_full (
+          path, data, size,
+          G_FILE_SET_CONTENTS_NONE,
+          0644, error);
+      if (!result)
+        return FALSE;
+
+      /* Keep recency information for cache trimming */
+      times.actime  = mtime;
+      times.modtime = mtime;
+      g_utime (path, &times);
+    }
+
+  return TRUE;
+}
+
+/* Writes everything Bazaar has cached (entries, the flathub state,
+ * textures and their metadata) into a single file which can seed the
+ * cache of another machine. This blocks, so it is only meant for the
+ * command line */
+gboolean
+bz_catalog_snapshot_export (const char *path,
+                            GError    **error)
+{
+  g_autofree char *root          = NULL;
+  g_auto (GVariantBuilder) files = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("a(sayx)"));
+  g_autoptr (GVariant) snapshot  = NULL;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  root = bz_dup_root_cache_dir ();
+  if (!g_file_test (root, G_FILE_TEST_IS_DIR))
+    {
+      g_set_error (
+          error,
+          G_IO_ERROR,
+          G_IO_ERROR_NOT_FOUND,
+          "There is no catalog to export at %s, "
+          "Bazaar must complete a refresh first",
+          root);
+      return FALSE;
+    }
+
+  if (!collect_files (root, NULL, &files, error))
+    return FALSE;
+
+  snapshot = g_variant_ref_sink (g_variant_new (
+      "(sss@a(sayx))",
+      SNAPSHOT_MAGIC,
+      PACKAGE_VERSION,
+      root,
+      g_variant_builder_end (&files)));
+  /* Stored little endian so images can be moved between architectures */
+  if (G_BYTE_ORDER == G_BIG_ENDIAN)
+    {
+      GVariant *swapped = NULL;
+
+      swapped = g_variant_byteswap (snapshot);
+      g_variant_unref (snapshot);
+      snapshot = swapped;
+    }
+
+  return g_file_set_contents_full (
+      path,
+      g_variant_get_data (snapshot),
+      g_variant_get_size (snapshot),
+      G_FILE_SET_CONTENTS_CONSISTENT,
+      0644, error);
+}
+
+/* Replaces the cache with the contents of a snapshot. The next startup
+ * revives the catalog from it and refreshes in the background as usual.
+ * Bazaar must not be running, since the cache is swapped out entirely */
+gboolean
+bz_catalog_snapshot_import (const char *path,
+                            GError    **error)
+{
+  g_autoptr (GMappedFile) mapped = NULL;
+  g_autoptr (GBytes) bytes       = NULL;
+  g_autoptr (GVariant) snapshot  = NULL;
+  const char *magic              = NULL;
+  const char *version            = NULL;
+  const char *origin             = NULL;
+  g_autoptr (GVariant) files     = NULL;
+  g_autofree char *root          = NULL;
+  g_autofree char *root_parent   = NULL;
+  g_autofree char *staging       = NULL;
+  g_autofree char *origin_path   = NULL;
+  g_autofree char *old           = NULL;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  mapped = g_mapped_file_new (path, FALSE, error);
+  if (mapped == NULL)
+    return FALSE;
+  bytes = g_mapped_file_get_bytes (mapped);
+
+  snapshot = g_variant_ref_sink (g_variant_new_from_bytes (
+      G_VARIANT_TYPE (SNAPSHOT_TYPE), bytes, FALSE));
+  if (G_BYTE_ORDER == G_BIG_ENDIAN)
+    {
+      GVariant *swapped = NULL;
+
+      swapped = g_variant_byteswap (snapshot);
+      g_variant_unref (snapshot);
+      snapshot = swapped;
+    }
+
+  g_variant_get (snapshot, "(&s&s&s@a(sayx))", &magic, &version, &origin, &files);
+  if (g_strcmp0 (magic, SNAPSHOT_MAGIC) != 0)
+    {
+      g_set_error (
+          error,
+          G_IO_ERROR,
+          G_IO_ERROR_INVALID_DATA,
+          "%s is not a Bazaar catalog snapshot",
+          path);
+      return FALSE;
+    }
+  /* Any other version would be wiped on startup anyway */
+  if (g_strcmp0 (version, PACKAGE_VERSION) != 0)
+    {
+      g_set_error (
+          error,
+          G_IO_ERROR,
+          G_IO_ERROR_NOT_SUPPORTED,
+          "Catalog snapshot was exported by Bazaar %s, "
+          "but this is Bazaar %s",
+          version, PACKAGE_VERSION);
+      return FALSE;
+    }
+
+  root        = bz_dup_root_cache_dir ();
+  root_parent = g_path_get_dirname (root);
+  g_mkdir_with_parents (root_parent, 0755);
+
+  /* Extract next to the cache, then swap it in, so a failed import leaves
+   * the old cache alone */
+  staging = g_strdup_printf ("%s.import-XXXXXX", root);
+  if (g_mkdtemp (staging) == NULL)
+    {
+      int errsv = errno;
+
+      g_set_error (
+          error,
+          G_IO_ERROR,
+          g_io_error_from_errno (errsv),
+          "Failed to create staging directory for %s: %s",
+          root, g_strerror (errsv));
+      return FALSE;
+    }
+
+  if (!extract_files (staging, files, error))
+    goto err;
+
+  /* Cached entries reference files by absolute path */
+  origin_path = g_build_filename (staging, BZ_CATALOG_ORIGIN_FILE, NULL);
+  if (!g_file_set_contents (origin_path, origin, -1, error))
+    goto err;
+
+  if (g_file_test (root, G_FILE_TEST_EXISTS))
+    {
+      old = g_strdup_printf ("%s.old-XXXXXX", root);
+      if (g_mkdtemp (old) == NULL ||
+          g_rename (root, old) != 0)
+        {
+          int errsv = errno;
+
+          g_set_error (
+              error,
+              G_IO_ERROR,
+              g_io_error_from_errno (errsv),
+              "Failed to move existing cache at %s out of the way: %s",
+              root, g_strerror (errsv));
+          goto err;
+        }
+    }
+
+  if (g_rename (staging, root) != 0)
+    {
+      int errsv = errno;
+
+      g_set_error (
+          error,
+          G_IO_ERROR,
+          g_io_error_from_errno (errsv),
+          "Failed to move imported catalog into %s: %s",
+          root, g_strerror (errsv));
+      if (old != NULL)
+        g_rename (old, root);
+      goto err;
+    }
+
+  if (old != NULL)
+    bz_reap_path (old);
+  return TRUE;
+
+err:
+  bz_reap_path (staging);
+  return FALSE;
+}
+
+/* End of bz-catalog-snapshot.c */
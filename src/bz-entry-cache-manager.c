@@ -22,8 +22,29 @@
 #define BAZAAR_MODULE "entry-cache"
 
 #define MAX_CONCURRENT_WRITES       16
-#define WATCH_CLEANUP_INTERVAL_MSEC 5000
-
+#define TRIM_DELAY_MSEC             5000
+
+#define PACK_FILENAME   "entries.pack"
+#define PACK_MAGIC      "BZPACK\0\0"
+#define PACK_VERSION    3
+#define PACK_ALIGNMENT  8
+#define CHECKSUM_LENGTH 32
+#define DIGEST_LENGTH   16
+
+/* How many catalog generations an entry may go unseen before it is
+ * evicted, so a remote which fails to refresh once isn't wiped out */
+#define MAX_UNSEEN_GENERATIONS 3
+
+#define LOOSE_FILE_ATTRIBUTES                 \
+  G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK        \
+  "," G_FILE_ATTRIBUTE_STANDARD_NAME          \
+  "," G_FILE_ATTRIBUTE_STANDARD_TYPE          \
+  "," G_FILE_ATTRIBUTE_STANDARD_SIZE          \
+  "," G_FILE_ATTRIBUTE_TIME_MODIFIED          \
+  "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC     \
+  "," G_FILE_ATTRIBUTE_UNIX_INODE
+
+#include <glib/gstdio.h>
 #include <malloc.h>
 
 #include "bz-entry-cache-manager.h"
@@ -37,6 +58,71 @@
 G_DEFINE_QUARK (bz-entry-cache-error-quark, bz_entry_cache_error);
 /* clang-format on */
 
+/* The pack is a single file holding every entry which was cached as of the
+ * last compaction, so startup can map it once and walk the index instead of
+ * opening a file per entry. Layout, all integers little endian:
+ *
+ *   PackHeader
+ *   PackRecord[n_records]   sorted by checksum
+ *   serialized entries      each aligned to PACK_ALIGNMENT
+ *
+ * Writers keep writing one loose file per entry. A loose file always
+ * supersedes the pack, since compaction deletes the loose files it folds
+ * in. The refresh worker (a separate process) instead stages everything in
+ * memory for the duration of a generation, so a refresh is published with
+ * a single atomic replacement of the pack, or not at all.
+ *
+ * Each record also carries the MD5 digest of its entry, which is what lets
+ * a refresh skip unchanged entries without reading them back.
+ *
+ * Every compaction which is told what the current catalog looks like starts
+ * a new generation. Records remember the last generation their entry was
+ * part of the catalog, and are evicted along with their assets once that
+ * is too long ago.
+ */
+typedef struct
+{
+  char    magic[8];
+  guint32 version;
+  guint32 n_records;
+  guint64 generation;
+} PackHeader;
+
+typedef struct
+{
+  char    checksum[CHECKSUM_LENGTH];
+  guint64 offset;
+  guint64 size;
+  guint8  digest[DIGEST_LENGTH];
+  guint64 last_seen;
+} PackRecord;
+
+/* Digest of a loose file as of when it was last written or compared,
+ * only trusted as long as the file still looks the same */
+typedef struct
+{
+  guint8  digest[DIGEST_LENGTH];
+  goffset size;
+  guint64 mtime_usec;
+  guint64 inode;
+} DigestRecord;
+
+G_STATIC_ASSERT (sizeof (PackHeader) % PACK_ALIGNMENT == 0);
+G_STATIC_ASSERT (sizeof (PackRecord) % PACK_ALIGNMENT == 0);
+
+BZ_DEFINE_DATA (
+    pack,
+    Pack,
+    {
+      GBytes           *bytes;
+      const PackRecord *records;
+      guint             n_records;
+      guint64           generation;
+      guint64           device;
+      guint64           inode;
+    },
+    BZ_RELEASE_DATA (bytes, g_bytes_unref));
+
 BZ_DEFINE_DATA (
     ongoing_task,
     OngoingTask,
@@ -61,6 +147,20 @@ BZ_DEFINE_DATA (
       GMutex   reading_mutex;
       BzGuard *writing_gate;
       GMutex   writing_mutex;
+
+      PackData *pack;
+      GMutex    pack_mutex;
+      BzGuard  *compact_gate;
+      GMutex    compact_mutex;
+
+      GHashTable *digests;
+      GMutex      digests_mutex;
+
+      gboolean    staging;
+      GHashTable *staged;
+      GMutex      staged_mutex;
+
+      gint trim_queued;
     },
     BZ_RELEASE_DATA (self, bz_weak_release);
     BZ_RELEASE_DATA (scheduler, dex_unref);
@@ -78,20 +178,29 @@ BZ_DEFINE_DATA (
     BZ_RELEASE_DATA (writing_gate, bz_guard_destroy);
     g_mutex_clear (&self->alive_mutex);
     g_mutex_clear (&self->reading_mutex);
-    g_mutex_clear (&self->writing_mutex););
+    g_mutex_clear (&self->writing_mutex);
+    BZ_RELEASE_DATA (pack, pack_data_unref);
+    g_mutex_clear (&self->pack_mutex);
+    BZ_RELEASE_DATA (compact_gate, bz_guard_destroy);
+    g_mutex_clear (&self->compact_mutex);
+    BZ_RELEASE_DATA (digests, g_hash_table_unref);
+    g_mutex_clear (&self->digests_mutex);
+    BZ_RELEASE_DATA (staged, g_hash_table_unref);
+    g_mutex_clear (&self->staged_mutex););
 
 struct _BzEntryCacheManager
 {
   GObject parent_instance;
 
-  GMutex mutex;
-  guint  living_entries;
+  GMutex   mutex;
+  guint    living_entries;
+  gboolean notify_queued;
 
   DexScheduler *scheduler;
   guint64       memory_usage;
 
   OngoingTaskData *task_data;
-  DexFuture       *watch_task;
+  DexFuture       *init_task;
 };
 
 G_DEFINE_FINAL_TYPE (BzEntryCacheManager, bz_entry_cache_manager, G_TYPE_OBJECT);
@@ -107,14 +216,7 @@ enum
 static GParamSpec *props[LAST_PROP] = { 0 };
 
 static DexFuture *
-watch_init_fiber (OngoingTaskData *task_data);
-
-static DexFuture *
-watch_cb (DexFuture       *future,
-          OngoingTaskData *task_data);
-
-static DexFuture *
-watch_work_fiber (OngoingTaskData *task_data);
+init_fiber (OngoingTaskData *task_data);
 
 static DexFuture *
 notify_props_fiber (GWeakRef *wr);
@@ -146,6 +248,8 @@ BZ_DEFINE_DATA (
     BZ_RELEASE_DATA (entry, g_object_unref);)
 static DexFuture *
 write_task_fiber (WriteTaskData *data);
+static DexFuture *
+adopt_task_fiber (WriteTaskData *data);
 
 BZ_DEFINE_DATA (
     read_task,
@@ -158,10 +262,99 @@ BZ_DEFINE_DATA (
     BZ_RELEASE_DATA (unique_id_checksum, g_free))
 static DexFuture *
 read_task_fiber (ReadTaskData *data);
+static DexFuture *
+living_task_fiber (ReadTaskData *data);
+
+BZ_DEFINE_DATA (
+    prune,
+    Prune,
+    {
+      OngoingTaskData *task_data;
+      char            *unique_id_checksum;
+    },
+    BZ_RELEASE_DATA (task_data, ongoing_task_data_unref);
+    BZ_RELEASE_DATA (unique_id_checksum, g_free));
+static void
+entry_finalized_cb (PruneData *data,
+                    GObject   *where_the_object_was);
+static DexFuture *
+prune_fiber (PruneData *data);
+
+static void
+prune_living (OngoingTaskData *task_data,
+              const char      *unique_id_checksum);
+
+static void
+set_living_entries (OngoingTaskData *task_data,
+                    guint            n_living);
+
+static DexFuture *
+trim_fiber (OngoingTaskData *task_data);
 
 static DexFuture *
 enumerate_disk_fiber (OngoingTaskData *data);
 
+BZ_DEFINE_DATA (
+    compact,
+    Compact,
+    {
+      OngoingTaskData *task_data;
+      GHashTable      *seen;
+    },
+    BZ_RELEASE_DATA (task_data, ongoing_task_data_unref);
+    BZ_RELEASE_DATA (seen, g_hash_table_unref));
+static DexFuture *
+compact_fiber (CompactData *data);
+
+static GHashTable *
+steal_staged (OngoingTaskData *task_data);
+
+static void
+restore_staged (OngoingTaskData *task_data,
+                GHashTable      *staged);
+
+static void
+collect_assets (GHashTable *live,
+                guint64     budget);
+
+static gboolean
+is_checksum_name (const char *name);
+
+static PackData *
+acquire_pack (OngoingTaskData *task_data);
+
+static const PackRecord *
+pack_find_record (PackData   *pack,
+                  const char *unique_id_checksum);
+
+static GBytes *
+pack_dup_entry_bytes (PackData   *pack,
+                      const char *unique_id_checksum);
+
+static void
+compute_digest (GBytes *bytes,
+                guint8  digest[DIGEST_LENGTH]);
+
+static gboolean
+lookup_digest (OngoingTaskData *task_data,
+               GFile           *file,
+               const char      *unique_id_checksum,
+               guint8           digest[DIGEST_LENGTH]);
+
+static void
+remember_digest (OngoingTaskData *task_data,
+                 GFile           *file,
+                 const char      *unique_id_checksum,
+                 const guint8     digest[DIGEST_LENGTH]);
+
+static guint64
+info_get_mtime_usec (GFileInfo *info);
+
+static GBytes *
+load_entry_bytes (OngoingTaskData *task_data,
+                  const char      *unique_id_checksum,
+                  GError         **error);
+
 static void
 bz_entry_cache_manager_dispose (GObject *object)
 {
@@ -170,7 +363,7 @@ bz_entry_cache_manager_dispose (GObject *object)
   g_mutex_clear (&self->mutex);
 
   dex_clear (&self->scheduler);
-  dex_clear (&self->watch_task);
+  dex_clear (&self->init_task);
   g_clear_pointer (&self->task_data, ongoing_task_data_unref);
 
   G_OBJECT_CLASS (bz_entry_cache_manager_parent_class)->dispose (object);
@@ -261,12 +454,20 @@ bz_entry_cache_manager_init (BzEntryCacheManager *self)
   g_mutex_init (&task_data->alive_mutex);
   g_mutex_init (&task_data->reading_mutex);
   g_mutex_init (&task_data->writing_mutex);
+  g_mutex_init (&task_data->pack_mutex);
+  g_mutex_init (&task_data->compact_mutex);
+  task_data->digests = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, g_free);
+  g_mutex_init (&task_data->digests_mutex);
+  task_data->staged = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_bytes_unref);
+  g_mutex_init (&task_data->staged_mutex);
   self->task_data = g_steal_pointer (&task_data);
 
-  self->watch_task = dex_scheduler_spawn (
+  self->init_task = dex_scheduler_spawn (
       self->scheduler,
       bz_get_dex_stack_size (),
-      (DexFiberFunc) watch_init_fiber,
+      (DexFiberFunc) init_fiber,
       ongoing_task_data_ref (self->task_data),
       ongoing_task_data_unref);
 }
@@ -313,6 +514,35 @@ bz_entry_cache_manager_add (BzEntryCacheManager *self,
   return g_steal_pointer (&future);
 }
 
+/* Makes an entry which did not come from this cache manager the one
+ * handed out for its checksum for as long as it stays alive, without
+ * writing it anywhere. Used for entries which some other process is
+ * persisting right now */
+DexFuture *
+bz_entry_cache_manager_adopt (BzEntryCacheManager *self,
+                              BzEntry             *entry)
+{
+  g_autoptr (WriteTaskData) data = NULL;
+  g_autoptr (DexFuture) future   = NULL;
+
+  dex_return_error_if_fail (BZ_IS_ENTRY_CACHE_MANAGER (self));
+  dex_return_error_if_fail (BZ_IS_ENTRY (entry));
+  dex_return_error_if_fail (bz_entry_get_unique_id_checksum (entry) != NULL);
+
+  data                     = write_task_data_new ();
+  data->task_data          = ongoing_task_data_ref (self->task_data);
+  data->unique_id_checksum = g_strdup (bz_entry_get_unique_id_checksum (entry));
+  data->entry              = g_object_ref (entry);
+
+  future = dex_scheduler_spawn (
+      self->scheduler,
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) adopt_task_fiber,
+      write_task_data_ref (data),
+      write_task_data_unref);
+  return g_steal_pointer (&future);
+}
+
 DexFuture *
 bz_entry_cache_manager_get (BzEntryCacheManager *self,
                             const char          *unique_id)
@@ -359,6 +589,31 @@ bz_entry_cache_manager_get_by_checksum (BzEntryCacheManager *self,
   return g_steal_pointer (&future);
 }
 
+/* Resolves to the entry handed out for this unique ID if something is
+ * still holding on to it, without ever touching the disk */
+DexFuture *
+bz_entry_cache_manager_get_living (BzEntryCacheManager *self,
+                                   const char          *unique_id)
+{
+  g_autoptr (ReadTaskData) data = NULL;
+  g_autoptr (DexFuture) future  = NULL;
+
+  dex_return_error_if_fail (BZ_IS_ENTRY_CACHE_MANAGER (self));
+  dex_return_error_if_fail (unique_id != NULL);
+
+  data                     = read_task_data_new ();
+  data->task_data          = ongoing_task_data_ref (self->task_data);
+  data->unique_id_checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, unique_id, -1);
+
+  future = dex_scheduler_spawn (
+      self->scheduler,
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) living_task_fiber,
+      read_task_data_ref (data),
+      read_task_data_unref);
+  return g_steal_pointer (&future);
+}
+
 DexFuture *
 bz_entry_cache_manager_enumerate_disk (BzEntryCacheManager *self)
 {
@@ -375,6 +630,50 @@ bz_entry_cache_manager_enumerate_disk (BzEntryCacheManager *self)
   return g_steal_pointer (&future);
 }
 
+/* From now until the next compaction, entries passed to
+ * `bz_entry_cache_manager_add` are only kept in memory and become visible
+ * to other processes all at once when the compaction succeeds */
+void
+bz_entry_cache_manager_begin_generation (BzEntryCacheManager *self)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  g_return_if_fail (BZ_IS_ENTRY_CACHE_MANAGER (self));
+
+  locker                   = g_mutex_locker_new (&self->task_data->staged_mutex);
+  self->task_data->staging = TRUE;
+}
+
+/* Folds every loose entry file, and everything staged since
+ * `bz_entry_cache_manager_begin_generation`, into the pack. Meant to be
+ * called after a flood of writes, such as at the end of a refresh.
+ *
+ * If `seen` is not NULL it must be a set of every unique ID checksum in the
+ * current catalog. A new generation is started, entries which have been
+ * missing for too long are evicted, and cached assets are garbage collected
+ * and trimmed to the configured budget */
+DexFuture *
+bz_entry_cache_manager_compact (BzEntryCacheManager *self,
+                                GHashTable          *seen)
+{
+  g_autoptr (CompactData) data = NULL;
+  g_autoptr (DexFuture) future = NULL;
+
+  dex_return_error_if_fail (BZ_IS_ENTRY_CACHE_MANAGER (self));
+
+  data            = compact_data_new ();
+  data->task_data = ongoing_task_data_ref (self->task_data);
+  data->seen      = seen != NULL ? g_hash_table_ref (seen) : NULL;
+
+  future = dex_scheduler_spawn (
+      self->scheduler,
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) compact_fiber,
+      compact_data_ref (data),
+      compact_data_unref);
+  return g_steal_pointer (&future);
+}
+
 static DexFuture *
 write_task_fiber (WriteTaskData *data)
 {
@@ -390,8 +689,6 @@ write_task_fiber (WriteTaskData *data)
   DexFuture *writing_future               = NULL;
   g_autoptr (LivingEntryData) living      = NULL;
   g_autoptr (DexPromise) promise          = NULL;
-  g_autoptr (GVariantBuilder) builder     = NULL;
-  g_autoptr (GVariant) variant            = NULL;
   g_autoptr (GBytes) bytes                = NULL;
   gsize            bytes_size             = 0;
   gconstpointer    bytes_data             = 0;
@@ -399,11 +696,15 @@ write_task_fiber (WriteTaskData *data)
   g_autoptr (GFile) parent_file           = NULL;
   g_autofree char *save_file_path         = NULL;
   g_autoptr (GFile) save_file             = NULL;
-  gsize            existing_contents_size = 0;
-  g_autofree char *existing_contents      = NULL;
-  g_autoptr (GFileOutputStream) output    = NULL;
-  gssize   bytes_written                  = 0;
-  gboolean result                         = FALSE;
+  g_autoptr (GBytes) existing             = NULL;
+  gsize         existing_size             = 0;
+  gconstpointer existing_data             = NULL;
+  guint8        digest[DIGEST_LENGTH]     = { 0 };
+  guint8        known[DIGEST_LENGTH]      = { 0 };
+  gboolean      changed                   = FALSE;
+  gboolean      staged                    = FALSE;
+  guint         n_living                  = 0;
+  gboolean      result                    = FALSE;
   g_autoptr (GError) ret_error            = NULL;
 
   if (!BZ_IS_FLATPAK_ENTRY (entry))
@@ -478,17 +779,16 @@ write_task_fiber (WriteTaskData *data)
                               g_strdup (unique_id_checksum),
                               living_entry_data_ref (living));
       }
+    n_living = g_hash_table_size (task_data->alive_hash);
   }
   bz_clear_guard (&other_guard);
+  set_living_entries (task_data, n_living);
 
   BZ_BEGIN_GUARD_WITH_CONTEXT (&other_guard,
                                &living->mutex,
                                &living->gate);
   {
-    builder = g_variant_builder_new (G_VARIANT_TYPE_VARDICT);
-    bz_serializable_serialize (BZ_SERIALIZABLE (entry), builder);
-    variant    = g_variant_builder_end (builder);
-    bytes      = g_variant_get_data_as_bytes (variant);
+    bytes      = bz_serializable_dup_bytes (BZ_SERIALIZABLE (entry));
     bytes_data = g_bytes_get_data (bytes, &bytes_size);
 
     main_cache  = bz_dup_module_dir ();
@@ -511,53 +811,50 @@ write_task_fiber (WriteTaskData *data)
     save_file_path = g_build_filename (main_cache, unique_id_checksum, NULL);
     save_file      = g_file_new_for_path (save_file_path);
 
-    result = g_file_get_contents (
-        save_file_path, &existing_contents,
-        &existing_contents_size, NULL);
-    /* Only write if the file has definitely changed */
-    if (!result ||
-        existing_contents_size != bytes_size ||
-        memcmp (existing_contents, bytes_data, bytes_size) != 0)
+    /* Only write if the entry has definitely changed, whether it
+     * currently lives in a loose file or in the pack. The digests
+     * usually answer this without reading anything back */
+    compute_digest (bytes, digest);
+    if (lookup_digest (task_data, save_file, unique_id_checksum, known))
+      changed = memcmp (known, digest, DIGEST_LENGTH) != 0;
+    else
       {
-        output = g_file_replace (
-            save_file,
-            NULL,
-            FALSE,
-            G_FILE_CREATE_REPLACE_DESTINATION,
-            NULL,
-            &local_error);
-        if (output == NULL)
-          {
-            ret_error = g_error_new (
-                BZ_ENTRY_CACHE_ERROR,
-                BZ_ENTRY_CACHE_ERROR_CACHE_FAILED,
-                "Failed to open write stream when caching '%s': %s",
-                unique_id_checksum, local_error->message);
-            goto done;
-          }
+        existing = load_entry_bytes (task_data, unique_id_checksum, NULL);
+        if (existing != NULL)
+          existing_data = g_bytes_get_data (existing, &existing_size);
+        changed = existing == NULL ||
+                  existing_size != bytes_size ||
+                  memcmp (existing_data, bytes_data, bytes_size) != 0;
+      }
 
-        bytes_written = g_output_stream_write_bytes (G_OUTPUT_STREAM (output), bytes, NULL, &local_error);
-        if (bytes_written < 0)
+    if (changed)
+      {
+        locker = g_mutex_locker_new (&task_data->staged_mutex);
+        if (task_data->staging)
           {
-            ret_error = g_error_new (
-                BZ_ENTRY_CACHE_ERROR,
-                BZ_ENTRY_CACHE_ERROR_CACHE_FAILED,
-                "Failed to write data to stream when caching '%s': %s",
-                unique_id_checksum, local_error->message);
-            goto done;
+            g_hash_table_replace (task_data->staged,
+                                  g_strdup (unique_id_checksum),
+                                  g_bytes_ref (bytes));
+            staged = TRUE;
           }
+        g_clear_pointer (&locker, g_mutex_locker_free);
+      }
 
-        result = g_output_stream_close (G_OUTPUT_STREAM (output), NULL, &local_error);
+    if (changed && !staged)
+      {
+        result = bz_write_path_bytes (save_file_path, bytes, &local_error);
         if (!result)
           {
             ret_error = g_error_new (
                 BZ_ENTRY_CACHE_ERROR,
                 BZ_ENTRY_CACHE_ERROR_CACHE_FAILED,
-                "Failed to close stream when caching '%s': %s",
+                "Failed to write cache file for '%s': %s",
                 unique_id_checksum, local_error->message);
             goto done;
           }
       }
+    if (!staged)
+      remember_digest (task_data, save_file, unique_id_checksum, digest);
 
     g_timer_start (living->cached);
   }
@@ -577,12 +874,103 @@ done:
   }
   bz_clear_guard (&other_guard);
 
+  /* Unless the application holds this entry, we were the only
+   * reason it was being tracked */
+  g_clear_pointer (&living, living_entry_data_unref);
+  prune_living (task_data, unique_id_checksum);
+
   if (ret_error != NULL)
     return dex_future_new_for_error (g_steal_pointer (&ret_error));
   else
     return dex_future_new_true ();
 }
 
+static DexFuture *
+adopt_task_fiber (WriteTaskData *data)
+{
+  OngoingTaskData *task_data          = data->task_data;
+  char            *unique_id_checksum = data->unique_id_checksum;
+  BzEntry         *entry              = data->entry;
+  g_autoptr (BzGuard) guard           = NULL;
+  g_autoptr (LivingEntryData) living  = NULL;
+  g_autoptr (PruneData) prune         = NULL;
+  guint n_living                      = 0;
+
+  dex_await (dex_ref (task_data->init), NULL);
+
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard,
+                               &task_data->alive_mutex,
+                               &task_data->alive_gate);
+  {
+    living = g_hash_table_lookup (task_data->alive_hash, unique_id_checksum);
+    if (living != NULL)
+      living_entry_data_ref (living);
+    else
+      {
+        living = living_entry_data_new ();
+        g_weak_ref_init (&living->wr, NULL);
+        g_mutex_init (&living->mutex);
+        living->cached = g_timer_new ();
+        g_hash_table_replace (task_data->alive_hash,
+                              g_strdup (unique_id_checksum),
+                              living_entry_data_ref (living));
+      }
+    n_living = g_hash_table_size (task_data->alive_hash);
+  }
+  bz_clear_guard (&guard);
+  set_living_entries (task_data, n_living);
+
+  /* Whatever was alive here before is older than this */
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard, &living->mutex, &living->gate);
+  g_weak_ref_set (&living->wr, entry);
+  g_timer_start (living->cached);
+  bz_clear_guard (&guard);
+
+  prune                     = prune_data_new ();
+  prune->task_data          = ongoing_task_data_ref (task_data);
+  prune->unique_id_checksum = g_strdup (unique_id_checksum);
+  g_object_weak_ref (G_OBJECT (entry), (GWeakNotify) entry_finalized_cb, g_steal_pointer (&prune));
+
+  return dex_future_new_true ();
+}
+
+static DexFuture *
+living_task_fiber (ReadTaskData *data)
+{
+  OngoingTaskData *task_data          = data->task_data;
+  char            *unique_id_checksum = data->unique_id_checksum;
+  g_autoptr (BzGuard) guard           = NULL;
+  g_autoptr (LivingEntryData) living  = NULL;
+  g_autoptr (BzEntry) entry           = NULL;
+
+  dex_await (dex_ref (task_data->init), NULL);
+
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard,
+                               &task_data->alive_mutex,
+                               &task_data->alive_gate);
+  {
+    living = g_hash_table_lookup (task_data->alive_hash, unique_id_checksum);
+    if (living != NULL)
+      living_entry_data_ref (living);
+  }
+  bz_clear_guard (&guard);
+
+  if (living != NULL)
+    {
+      BZ_BEGIN_GUARD_WITH_CONTEXT (&guard, &living->mutex, &living->gate);
+      entry = g_weak_ref_get (&living->wr);
+      bz_clear_guard (&guard);
+    }
+
+  if (entry == NULL)
+    return dex_future_new_reject (
+        G_IO_ERROR,
+        G_IO_ERROR_NOT_FOUND,
+        "Entry with unique ID checksum '%s' is not alive",
+        unique_id_checksum);
+  return dex_future_new_for_object (entry);
+}
+
 static DexFuture *
 read_task_fiber (ReadTaskData *data)
 {
@@ -595,13 +983,12 @@ read_task_fiber (ReadTaskData *data)
   g_autoptr (LivingEntryData) living   = NULL;
   DexFuture *reading_future            = NULL;
   g_autoptr (DexPromise) promise       = NULL;
-  g_autofree char *main_cache          = NULL;
-  g_autofree char *path                = NULL;
-  g_autoptr (GFile) file               = NULL;
   g_autoptr (GBytes) bytes             = NULL;
-  g_autoptr (GVariant) variant         = NULL;
   g_autoptr (BzFlatpakEntry) entry     = NULL;
   gboolean result                      = FALSE;
+  gboolean was_legacy                  = FALSE;
+  guint    n_living                    = 0;
+  g_autoptr (PruneData) prune          = NULL;
   g_autoptr (GError) ret_error         = NULL;
 
   dex_await (dex_ref (task_data->init), NULL);
@@ -673,7 +1060,9 @@ read_task_fiber (ReadTaskData *data)
         g_hash_table_replace (task_data->alive_hash,
                               g_strdup (unique_id_checksum),
                               living_entry_data_ref (living));
+        n_living = g_hash_table_size (task_data->alive_hash);
         bz_clear_guard (&guard);
+        set_living_entries (task_data, n_living);
 
         BZ_BEGIN_GUARD_WITH_CONTEXT (&guard, &living->mutex, &living->gate);
       }
@@ -681,45 +1070,39 @@ read_task_fiber (ReadTaskData *data)
 
   /* living data was guarded */
 
-  main_cache = bz_dup_module_dir ();
-  path       = g_build_filename (main_cache, unique_id_checksum, NULL);
-  file       = g_file_new_for_path (path);
-
-  bytes = g_file_load_bytes (file, NULL, NULL, &local_error);
+  bytes = load_entry_bytes (task_data, unique_id_checksum, &local_error);
   if (bytes == NULL)
     {
       ret_error = g_error_new (
           BZ_ENTRY_CACHE_ERROR,
           BZ_ENTRY_CACHE_ERROR_DECACHE_FAILED,
-          "Failed to de-cache variant from file: %s",
+          "Failed to de-cache variant: %s",
           local_error->message);
       goto done;
     }
 
-  variant = g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, bytes, FALSE);
-  if (variant == NULL)
-    {
-      ret_error = g_error_new (
-          BZ_ENTRY_CACHE_ERROR,
-          BZ_ENTRY_CACHE_ERROR_DECACHE_FAILED,
-          "Failed to interpret variant from %s: %s",
-          path, local_error->message);
-      goto done;
-    }
-
+  /* Packed entries are decoded header first: only what tiles and search
+   * need is copied out, while the details keep referencing these bytes
+   * (possibly the mapped pack) until something asks for them */
   entry  = g_object_new (BZ_TYPE_FLATPAK_ENTRY, NULL);
-  result = bz_serializable_deserialize (BZ_SERIALIZABLE (entry), variant, &local_error);
+  result = bz_serializable_load_bytes (BZ_SERIALIZABLE (entry), bytes, &was_legacy, &local_error);
   if (!result)
     {
       ret_error = g_error_new (
           BZ_ENTRY_CACHE_ERROR,
           BZ_ENTRY_CACHE_ERROR_DECACHE_FAILED,
-          "Failed to deserialize entry from %s: %s",
-          path, local_error->message);
+          "Failed to deserialize entry %s: %s",
+          unique_id_checksum, local_error->message);
       goto done;
     }
   g_weak_ref_init (&living->wr, entry);
 
+  /* Forget about the entry as soon as the application does */
+  prune                     = prune_data_new ();
+  prune->task_data          = ongoing_task_data_ref (task_data);
+  prune->unique_id_checksum = g_strdup (unique_id_checksum);
+  g_object_weak_ref (G_OBJECT (entry), (GWeakNotify) entry_finalized_cb, g_steal_pointer (&prune));
+
 done:
   BZ_BEGIN_GUARD_WITH_CONTEXT (&guard,
                                &task_data->reading_mutex,
@@ -735,9 +1118,32 @@ done:
   bz_clear_guard (&guard);
 
   if (ret_error != NULL)
-    return dex_future_new_for_error (g_steal_pointer (&ret_error));
-  else
-    return dex_future_new_for_object (entry);
+    {
+      g_clear_pointer (&living, living_entry_data_unref);
+      prune_living (task_data, unique_id_checksum);
+      return dex_future_new_for_error (g_steal_pointer (&ret_error));
+    }
+
+  if (was_legacy)
+    {
+      g_autoptr (WriteTaskData) write_data = NULL;
+
+      /* Rewrite entries from before the packed format once, so the slow
+       * path is only ever taken a single time per entry */
+      write_data                     = write_task_data_new ();
+      write_data->task_data          = ongoing_task_data_ref (task_data);
+      write_data->unique_id_checksum = g_strdup (unique_id_checksum);
+      write_data->entry              = g_object_ref (BZ_ENTRY (entry));
+
+      dex_future_disown (dex_scheduler_spawn (
+          task_data->scheduler,
+          bz_get_dex_stack_size (),
+          (DexFiberFunc) write_task_fiber,
+          write_task_data_ref (write_data),
+          write_task_data_unref));
+    }
+
+  return dex_future_new_for_object (entry);
 }
 
 static DexFuture *
@@ -749,6 +1155,7 @@ enumerate_disk_fiber (OngoingTaskData *data)
   g_autofree char *main_cache            = NULL;
   g_autoptr (GFile) main_cache_file      = NULL;
   g_autoptr (GFileEnumerator) enumerator = NULL;
+  g_autoptr (PackData) pack              = NULL;
 
   set = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
@@ -760,6 +1167,17 @@ enumerate_disk_fiber (OngoingTaskData *data)
   if (!g_file_test (main_cache, G_FILE_TEST_EXISTS))
     goto done;
 
+  pack = acquire_pack (data);
+  if (pack != NULL)
+    {
+      for (guint i = 0; i < pack->n_records; i++)
+        g_hash_table_replace (
+            set,
+            g_strndup (pack->records[i].checksum, CHECKSUM_LENGTH),
+            NULL);
+    }
+
+  /* After a compaction this only finds the pack itself */
   main_cache_file = g_file_new_for_path (main_cache);
   enumerator      = g_file_enumerate_children (
       main_cache_file,
@@ -801,7 +1219,7 @@ enumerate_disk_fiber (OngoingTaskData *data)
         continue;
 
       basename = g_file_get_basename (child);
-      if (basename != NULL)
+      if (basename != NULL && is_checksum_name (basename))
         g_hash_table_replace (set, g_steal_pointer (&basename), NULL);
     }
 
@@ -809,108 +1227,983 @@ done:
   return dex_future_new_take_boxed (G_TYPE_HASH_TABLE, g_steal_pointer (&set));
 }
 
-static DexFuture *
-watch_init_fiber (OngoingTaskData *task_data)
-{
-  // bz_discard_module_dir ();
-  dex_promise_resolve_boolean (task_data->init, TRUE);
-
-  return dex_future_finally_loop (
-      dex_timeout_new_msec (WATCH_CLEANUP_INTERVAL_MSEC),
-      (DexFutureCallback) watch_cb,
-      ongoing_task_data_ref (task_data),
-      ongoing_task_data_unref);
-}
+BZ_DEFINE_DATA (
+    loose_file,
+    LooseFile,
+    {
+      char   *unique_id_checksum;
+      GFile  *file;
+      GBytes *bytes;
+      goffset size;
+      guint64 mtime_usec;
+    },
+    BZ_RELEASE_DATA (unique_id_checksum, g_free);
+    BZ_RELEASE_DATA (file, g_object_unref);
+    BZ_RELEASE_DATA (bytes, g_bytes_unref));
 
-static DexFuture *
-watch_cb (DexFuture       *future,
-          OngoingTaskData *task_data)
+static guint64
+info_get_mtime_usec (GFileInfo *info)
 {
-  return dex_scheduler_spawn (
-      task_data->scheduler,
-      bz_get_dex_stack_size (),
-      (DexFiberFunc) watch_work_fiber,
-      ongoing_task_data_ref (task_data),
-      ongoing_task_data_unref);
+  return g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+         g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
 }
 
 static DexFuture *
-watch_work_fiber (OngoingTaskData *task_data)
+compact_fiber (CompactData *compact_data)
 {
-  g_autoptr (BzEntryCacheManager) self = NULL;
-  g_autoptr (BzGuard) guard0           = NULL;
-  GHashTableIter iter                  = { 0 };
-  g_autoptr (GTimer) timer             = NULL;
-  guint total                          = 0;
-  guint active                         = 0;
-  guint alive                          = 0;
-  guint pruned                         = 0;
-
-  timer = g_timer_new ();
-
-  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard0, &task_data->alive_mutex, &task_data->alive_gate);
-  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard0, &task_data->reading_mutex, &task_data->reading_gate);
-  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard0, &task_data->writing_mutex, &task_data->writing_gate);
-
-  g_hash_table_iter_init (&iter, task_data->alive_hash);
-  for (;;)
+  static const guint8 zeroes[PACK_ALIGNMENT] = { 0 };
+  OngoingTaskData *data                  = compact_data->task_data;
+  GHashTable      *seen                  = compact_data->seen;
+  g_autoptr (GError) local_error         = NULL;
+  g_autoptr (BzGuard) guard              = NULL;
+  g_autoptr (GTimer) timer               = NULL;
+  g_autofree char *main_cache            = NULL;
+  g_autofree char *pack_path             = NULL;
+  g_autoptr (GFile) main_cache_file      = NULL;
+  g_autoptr (GFileEnumerator) enumerator = NULL;
+  g_autoptr (PackData) pack              = NULL;
+  g_autoptr (GHashTable) loose           = NULL;
+  g_autoptr (GHashTable) staged          = NULL;
+  g_autoptr (GPtrArray) checksums        = NULL;
+  g_autoptr (GPtrArray) blobs            = NULL;
+  g_autoptr (GArray) last_seen           = NULL;
+  g_autoptr (GByteArray) buffer          = NULL;
+  g_autoptr (GHashTable) live            = NULL;
+  PackHeader     header                  = { 0 };
+  GHashTableIter iter                    = { 0 };
+  guint64        generation              = 0;
+  guint          removed                 = 0;
+  guint          evicted                 = 0;
+  gboolean       result                  = FALSE;
+
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard, &data->compact_mutex, &data->compact_gate);
+
+  staged = steal_staged (data);
+
+  timer      = g_timer_new ();
+  main_cache = bz_dup_module_dir ();
+  if (!g_file_test (main_cache, G_FILE_TEST_EXISTS))
     {
-      char            *unique_id_checksum = NULL;
-      LivingEntryData *living             = NULL;
-      g_autoptr (BzGuard) guard1          = NULL;
-      g_autoptr (BzEntry) entry           = NULL;
-
-      if (!g_hash_table_iter_next (&iter, (gpointer *) &unique_id_checksum, (gpointer *) &living))
-        break;
-      total++;
-
-      if (g_hash_table_contains (task_data->reading_hash, unique_id_checksum) ||
-          g_hash_table_contains (task_data->writing_hash, unique_id_checksum))
-        {
-          active++;
-          continue;
-        }
-
-      BZ_BEGIN_GUARD_WITH_CONTEXT (&guard1, &living->mutex, &living->gate);
+      if (g_hash_table_size (staged) > 0)
+        return dex_future_new_reject (
+            BZ_ENTRY_CACHE_ERROR,
+            BZ_ENTRY_CACHE_ERROR_CACHE_FAILED,
+            "Cache directory %s disappeared before the generation was published",
+            main_cache);
+      return dex_future_new_true ();
+    }
+  pack_path = g_build_filename (main_cache, PACK_FILENAME, NULL);
 
-      entry = g_weak_ref_get (&living->wr);
-      if (entry != NULL)
-        alive++;
+  main_cache_file = g_file_new_for_path (main_cache);
+  enumerator      = g_file_enumerate_children (
+      main_cache_file,
+      LOOSE_FILE_ATTRIBUTES,
+      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+      NULL,
+      &local_error);
+  if (enumerator == NULL)
+    {
+      restore_staged (data, staged);
+      return dex_future_new_reject (
+          BZ_ENTRY_CACHE_ERROR,
+          BZ_ENTRY_CACHE_ERROR_CACHE_FAILED,
+          "Could not initialize directory enumerator at %s: %s",
+          main_cache, local_error->message);
+    }
+
+  loose = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, loose_file_data_unref);
+  for (;;)
+    {
+      g_autoptr (GFileInfo) info       = NULL;
+      const char *name                 = NULL;
+      g_autoptr (LooseFileData) loaded = NULL;
+
+      info = g_file_enumerator_next_file (enumerator, NULL, &local_error);
+      if (info == NULL)
+        {
+          if (local_error != NULL)
+            {
+              restore_staged (data, staged);
+              return dex_future_new_reject (
+                  BZ_ENTRY_CACHE_ERROR,
+                  BZ_ENTRY_CACHE_ERROR_CACHE_FAILED,
+                  "Could not enumerate children of cache directory at %s: %s",
+                  main_cache, local_error->message);
+            }
+          else
+            break;
+        }
+
+      name = g_file_info_get_name (info);
+      if (g_file_info_get_is_symlink (info) ||
+          g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR ||
+          !is_checksum_name (name))
+        continue;
+
+      loaded                     = loose_file_data_new ();
+      loaded->unique_id_checksum = g_strdup (name);
+      loaded->file               = g_file_enumerator_get_child (enumerator, info);
+      loaded->size               = g_file_info_get_size (info);
+      loaded->mtime_usec         = info_get_mtime_usec (info);
+
+      loaded->bytes = g_file_load_bytes (loaded->file, NULL, NULL, &local_error);
+      if (loaded->bytes == NULL)
+        {
+          /* Someone else probably compacted or replaced it already */
+          g_debug ("Skipping loose cache file %s during compaction: %s",
+                   name, local_error->message);
+          g_clear_pointer (&local_error, g_error_free);
+          continue;
+        }
+
+      g_hash_table_replace (loose, loaded->unique_id_checksum, g_steal_pointer (&loaded));
+    }
+  g_clear_object (&enumerator);
+
+  /* Staged entries are the newest of all. A loose file they shadow is
+   * still tracked so it gets removed along with the others */
+  g_hash_table_iter_init (&iter, staged);
+  for (;;)
+    {
+      char          *checksum = NULL;
+      GBytes        *bytes    = NULL;
+      LooseFileData *loaded   = NULL;
+
+      if (!g_hash_table_iter_next (&iter, (gpointer *) &checksum, (gpointer *) &bytes))
+        break;
+
+      loaded = g_hash_table_lookup (loose, checksum);
+      if (loaded == NULL)
+        {
+          loaded                     = loose_file_data_new ();
+          loaded->unique_id_checksum = g_strdup (checksum);
+          g_hash_table_replace (loose, loaded->unique_id_checksum, loaded);
+        }
+      g_clear_pointer (&loaded->bytes, g_bytes_unref);
+      loaded->bytes = g_bytes_ref (bytes);
+    }
+
+  if (g_hash_table_size (loose) == 0 && seen == NULL)
+    return dex_future_new_true ();
+
+  pack       = acquire_pack (data);
+  generation = pack != NULL ? pack->generation : 0;
+  if (seen != NULL)
+    generation++;
+
+  checksums = g_ptr_array_new_with_free_func (g_free);
+  if (pack != NULL)
+    {
+      for (guint i = 0; i < pack->n_records; i++)
+        {
+          g_autofree char *checksum    = NULL;
+          guint64          record_seen = 0;
+
+          checksum = g_strndup (pack->records[i].checksum, CHECKSUM_LENGTH);
+          if (g_hash_table_contains (loose, checksum))
+            continue;
+
+          record_seen = GUINT64_FROM_LE (pack->records[i].last_seen);
+          if (seen != NULL &&
+              !g_hash_table_contains (seen, checksum) &&
+              generation - MIN (record_seen, generation) >= MAX_UNSEEN_GENERATIONS)
+            {
+              evicted++;
+              continue;
+            }
+
+          g_ptr_array_add (checksums, g_steal_pointer (&checksum));
+        }
+    }
+  g_hash_table_iter_init (&iter, loose);
+  for (;;)
+    {
+      char *checksum = NULL;
+
+      if (!g_hash_table_iter_next (&iter, (gpointer *) &checksum, NULL))
+        break;
+      g_ptr_array_add (checksums, g_strdup (checksum));
+    }
+  g_ptr_array_sort_values (checksums, (GCompareFunc) strcmp);
+
+  blobs     = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+  last_seen = g_array_new (FALSE, FALSE, sizeof (guint64));
+  for (guint i = 0; i < checksums->len;)
+    {
+      const char    *checksum    = NULL;
+      LooseFileData *loaded      = NULL;
+      GBytes        *bytes       = NULL;
+      guint64        record_seen = 0;
+
+      checksum = g_ptr_array_index (checksums, i);
+      loaded   = g_hash_table_lookup (loose, checksum);
+      if (loaded != NULL)
+        {
+          /* Written since the last compaction, so it's definitely in use */
+          bytes       = g_bytes_ref (loaded->bytes);
+          record_seen = generation;
+        }
       else
         {
-          bz_clear_guard (&guard1);
-          g_hash_table_iter_remove (&iter);
-          pruned++;
+          bytes = pack_dup_entry_bytes (pack, checksum);
+          if (seen != NULL && g_hash_table_contains (seen, checksum))
+            record_seen = generation;
+          else
+            record_seen = GUINT64_FROM_LE (pack_find_record (pack, checksum)->last_seen);
+        }
+
+      if (bytes != NULL)
+        {
+          g_ptr_array_add (blobs, bytes);
+          g_array_append_val (last_seen, record_seen);
+          i++;
         }
+      else
+        /* The old pack had a record pointing out of bounds, drop it */
+        g_ptr_array_remove_index (checksums, i);
+    }
+
+  memcpy (header.magic, PACK_MAGIC, sizeof (header.magic));
+  header.version    = GUINT32_TO_LE (PACK_VERSION);
+  header.n_records  = GUINT32_TO_LE (checksums->len);
+  header.generation = GUINT64_TO_LE (generation);
+
+  buffer = g_byte_array_new ();
+  g_byte_array_append (buffer, (const guint8 *) &header, sizeof (header));
+  g_byte_array_set_size (buffer, sizeof (header) + checksums->len * sizeof (PackRecord));
+
+  for (guint i = 0; i < checksums->len; i++)
+    {
+      GBytes       *bytes      = NULL;
+      gconstpointer bytes_data = NULL;
+      gsize         bytes_size = 0;
+      PackRecord    record     = { 0 };
+
+      bytes      = g_ptr_array_index (blobs, i);
+      bytes_data = g_bytes_get_data (bytes, &bytes_size);
+
+      g_byte_array_append (buffer, zeroes, (PACK_ALIGNMENT - buffer->len % PACK_ALIGNMENT) % PACK_ALIGNMENT);
+
+      memcpy (record.checksum, g_ptr_array_index (checksums, i), CHECKSUM_LENGTH);
+      record.offset = GUINT64_TO_LE (buffer->len);
+      record.size      = GUINT64_TO_LE (bytes_size);
+      record.last_seen = GUINT64_TO_LE (g_array_index (last_seen, guint64, i));
+      compute_digest (bytes, record.digest);
+      memcpy (buffer->data + sizeof (header) + i * sizeof (PackRecord), &record, sizeof (record));
+
+      g_byte_array_append (buffer, bytes_data, bytes_size);
+    }
+
+  /* The new pack is swapped in atomically, so readers either keep using
+   * their mapping of the old one or pick up the new one whole. This is
+   * the only sync a whole generation costs */
+  result = g_file_set_contents_full (
+      pack_path,
+      (const char *) buffer->data,
+      buffer->len,
+      G_FILE_SET_CONTENTS_CONSISTENT,
+      0644,
+      &local_error);
+  if (!result)
+    {
+      restore_staged (data, staged);
+      return dex_future_new_reject (
+          BZ_ENTRY_CACHE_ERROR,
+          BZ_ENTRY_CACHE_ERROR_CACHE_FAILED,
+          "Failed to write entry pack to %s: %s",
+          pack_path, local_error->message);
+    }
+
+  /* Only remove loose files which weren't replaced while we were busy,
+   * otherwise the newer copy would be lost */
+  g_hash_table_iter_init (&iter, loose);
+  for (;;)
+    {
+      LooseFileData *loaded      = NULL;
+      g_autoptr (GFileInfo) info = NULL;
+
+      if (!g_hash_table_iter_next (&iter, NULL, (gpointer *) &loaded))
+        break;
+      if (loaded->file == NULL)
+        continue;
+
+      info = g_file_query_info (
+          loaded->file,
+          LOOSE_FILE_ATTRIBUTES,
+          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+          NULL, NULL);
+      if (info == NULL ||
+          g_file_info_get_size (info) != loaded->size ||
+          info_get_mtime_usec (info) != loaded->mtime_usec)
+        continue;
+
+      if (g_file_delete (loaded->file, NULL, NULL))
+        removed++;
+    }
+
+  g_debug ("Compacted %u loose entries into a pack of %u entries (%u bytes), "
+           "evicting %u, at generation %" G_GUINT64_FORMAT " in %.4f seconds",
+           removed, checksums->len, buffer->len, evicted, generation,
+           g_timer_elapsed (timer, NULL));
+
+  if (seen == NULL)
+    return dex_future_new_true ();
+
+  /* Anything written since we started is alive too */
+  live = g_hash_table_new (g_str_hash, g_str_equal);
+  for (guint i = 0; i < checksums->len; i++)
+    g_hash_table_add (live, g_ptr_array_index (checksums, i));
+
+  enumerator = g_file_enumerate_children (
+      main_cache_file,
+      G_FILE_ATTRIBUTE_STANDARD_NAME,
+      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+      NULL,
+      NULL);
+  for (; enumerator != NULL;)
+    {
+      g_autoptr (GFileInfo) info = NULL;
+      const char *name           = NULL;
+
+      info = g_file_enumerator_next_file (enumerator, NULL, NULL);
+      if (info == NULL)
+        break;
+
+      name = g_file_info_get_name (info);
+      if (is_checksum_name (name) && !g_hash_table_contains (live, name))
+        {
+          g_ptr_array_add (checksums, g_strdup (name));
+          g_hash_table_add (live, g_ptr_array_index (checksums, checksums->len - 1));
+        }
+    }
+
+  collect_assets (live, bz_get_cache_asset_budget ());
+  return dex_future_new_true ();
+}
+
+/* Takes everything staged so far and ends the generation */
+static GHashTable *
+steal_staged (OngoingTaskData *task_data)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  GHashTable *staged              = NULL;
+
+  locker            = g_mutex_locker_new (&task_data->staged_mutex);
+  staged            = g_steal_pointer (&task_data->staged);
+  task_data->staged = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_bytes_unref);
+  task_data->staging = FALSE;
+
+  return staged;
+}
+
+/* Puts back what a failed compaction took, without clobbering anything
+ * staged in the meantime */
+static void
+restore_staged (OngoingTaskData *task_data,
+                GHashTable      *staged)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  GHashTableIter iter             = { 0 };
+
+  locker = g_mutex_locker_new (&task_data->staged_mutex);
+  if (g_hash_table_size (staged) > 0)
+    task_data->staging = TRUE;
+
+  g_hash_table_iter_init (&iter, staged);
+  for (;;)
+    {
+      char   *checksum = NULL;
+      GBytes *bytes    = NULL;
+
+      if (!g_hash_table_iter_next (&iter, (gpointer *) &checksum, (gpointer *) &bytes))
+        break;
+      if (!g_hash_table_contains (task_data->staged, checksum))
+        g_hash_table_replace (task_data->staged, g_strdup (checksum), g_bytes_ref (bytes));
+    }
+}
+
+BZ_DEFINE_DATA (
+    asset_file,
+    AssetFile,
+    {
+      GFile  *file;
+      GFile  *sidecar;
+      goffset size;
+      guint64 last_used;
+    },
+    BZ_RELEASE_DATA (file, g_object_unref);
+    BZ_RELEASE_DATA (sidecar, g_object_unref));
+
+static gint
+cmp_asset_file (AssetFileData **a,
+                AssetFileData **b)
+{
+  if ((*a)->last_used < (*b)->last_used)
+    return -1;
+  else if ((*a)->last_used > (*b)->last_used)
+    return 1;
+  else
+    return 0;
+}
+
+/* Entries store their assets in the "entry" module directory, in a
+ * subdirectory per unique ID checksum, alongside mini icons named
+ * "<checksum>-<width>x<height>". Assets of entries which are no longer
+ * cached are removed outright. Whatever remains is trimmed to `budget`
+ * bytes, least recently used first, by which point the async texture will
+ * just fetch it again. Mini icons are never trimmed as nothing would
+ * regenerate them before the next refresh */
+static void
+collect_assets (GHashTable *live,
+                guint64     budget)
+{
+  g_autoptr (GError) local_error         = NULL;
+  g_autoptr (GTimer) timer               = NULL;
+  g_autofree char *assets_dir            = NULL;
+  g_autoptr (GFile) assets_file          = NULL;
+  g_autoptr (GFileEnumerator) enumerator = NULL;
+  g_autoptr (GPtrArray) files            = NULL;
+  guint64 total                          = 0;
+  guint   reaped                         = 0;
+  guint   trimmed                        = 0;
+
+  timer       = g_timer_new ();
+  assets_dir  = bz_dup_cache_dir ("entry");
+  assets_file = g_file_new_for_path (assets_dir);
+  enumerator  = g_file_enumerate_children (
+      assets_file,
+      G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK
+      "," G_FILE_ATTRIBUTE_STANDARD_NAME
+      "," G_FILE_ATTRIBUTE_STANDARD_TYPE,
+      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+      NULL,
+      &local_error);
+  if (enumerator == NULL)
+    {
+      if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        g_warning ("Could not collect cached assets at %s: %s",
+                   assets_dir, local_error->message);
+      return;
     }
+
+  files = g_ptr_array_new_with_free_func (asset_file_data_unref);
+  for (;;)
+    {
+      g_autoptr (GFileInfo) info             = NULL;
+      const char *name                       = NULL;
+      g_autofree char *checksum              = NULL;
+      g_autoptr (GFile) child                = NULL;
+      g_autoptr (GFileEnumerator) children   = NULL;
+
+      info = g_file_enumerator_next_file (enumerator, NULL, NULL);
+      if (info == NULL)
+        break;
+      if (g_file_info_get_is_symlink (info))
+        continue;
+
+      name = g_file_info_get_name (info);
+      if (strlen (name) < CHECKSUM_LENGTH)
+        continue;
+      checksum = g_strndup (name, CHECKSUM_LENGTH);
+      if (!is_checksum_name (checksum))
+        continue;
+
+      child = g_file_enumerator_get_child (enumerator, info);
+      if (!g_hash_table_contains (live, checksum))
+        {
+          if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+            bz_reap_file (child);
+          else
+            g_file_delete (child, NULL, NULL);
+          reaped++;
+          continue;
+        }
+      if (g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY)
+        continue;
+
+      children = g_file_enumerate_children (
+          child,
+          G_FILE_ATTRIBUTE_STANDARD_NAME
+          "," G_FILE_ATTRIBUTE_STANDARD_TYPE
+          "," G_FILE_ATTRIBUTE_STANDARD_SIZE
+          "," G_FILE_ATTRIBUTE_TIME_ACCESS
+          "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
+          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+          NULL,
+          NULL);
+      for (; children != NULL;)
+        {
+          g_autoptr (GFileInfo) asset_info = NULL;
+          const char *asset_name           = NULL;
+          g_autoptr (AssetFileData) asset  = NULL;
+          g_autofree char *sidecar_name    = NULL;
+          g_autoptr (GFileInfo) sidecar    = NULL;
+
+          asset_info = g_file_enumerator_next_file (children, NULL, NULL);
+          if (asset_info == NULL)
+            break;
+          if (g_file_info_get_file_type (asset_info) != G_FILE_TYPE_REGULAR)
+            continue;
+
+          /* Sidecars are accounted for with the texture they belong to */
+          asset_name = g_file_info_get_name (asset_info);
+          if (g_str_has_suffix (asset_name, ".bz-async-texture-data"))
+            continue;
+
+          asset            = asset_file_data_new ();
+          asset->file      = g_file_enumerator_get_child (children, asset_info);
+          asset->size      = g_file_info_get_size (asset_info);
+          asset->last_used = MAX (g_file_info_get_attribute_uint64 (asset_info, G_FILE_ATTRIBUTE_TIME_ACCESS),
+                                  g_file_info_get_attribute_uint64 (asset_info, G_FILE_ATTRIBUTE_TIME_MODIFIED));
+
+          sidecar_name   = g_strdup_printf ("%s.bz-async-texture-data", asset_name);
+          asset->sidecar = g_file_get_child (child, sidecar_name);
+          sidecar        = g_file_query_info (
+              asset->sidecar,
+              G_FILE_ATTRIBUTE_STANDARD_SIZE,
+              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+              NULL, NULL);
+          if (sidecar != NULL)
+            asset->size += g_file_info_get_size (sidecar);
+
+          total += asset->size;
+          g_ptr_array_add (files, g_steal_pointer (&asset));
+        }
+    }
+
+  if (budget > 0 && total > budget)
+    {
+      g_ptr_array_sort (files, (GCompareFunc) cmp_asset_file);
+      for (guint i = 0; i < files->len && total > budget; i++)
+        {
+          AssetFileData *asset = NULL;
+
+          asset = g_ptr_array_index (files, i);
+          /* The sidecar goes first so the texture is never trusted
+           * without it */
+          g_file_delete (asset->sidecar, NULL, NULL);
+          if (g_file_delete (asset->file, NULL, NULL))
+            {
+              total -= asset->size;
+              trimmed++;
+            }
+        }
+    }
+
+  g_debug ("Reaped assets of %u stale entries and trimmed %u assets, "
+           "leaving %" G_GUINT64_FORMAT " bytes, in %.4f seconds",
+           reaped, trimmed, total, g_timer_elapsed (timer, NULL));
+}
+
+static gboolean
+is_checksum_name (const char *name)
+{
+  guint i = 0;
+
+  for (i = 0; name[i] != '\0'; i++)
+    {
+      if (i >= CHECKSUM_LENGTH || !g_ascii_isxdigit (name[i]))
+        return FALSE;
+    }
+  return i == CHECKSUM_LENGTH;
+}
+
+static PackData *
+open_pack (const char *path,
+           GStatBuf   *stat_buf,
+           GError    **error)
+{
+  g_autoptr (GMappedFile) mapped = NULL;
+  g_autoptr (GBytes) bytes       = NULL;
+  gconstpointer     data         = NULL;
+  gsize             size         = 0;
+  const PackHeader *header       = NULL;
+  guint             n_records    = 0;
+  g_autoptr (PackData) pack      = NULL;
+
+  mapped = g_mapped_file_new (path, FALSE, error);
+  if (mapped == NULL)
+    return NULL;
+  bytes = g_mapped_file_get_bytes (mapped);
+  data  = g_bytes_get_data (bytes, &size);
+
+  if (size < sizeof (PackHeader))
+    goto invalid;
+  header = data;
+  if (memcmp (header->magic, PACK_MAGIC, sizeof (header->magic)) != 0 ||
+      GUINT32_FROM_LE (header->version) != PACK_VERSION)
+    goto invalid;
+
+  n_records = GUINT32_FROM_LE (header->n_records);
+  if (n_records > (size - sizeof (PackHeader)) / sizeof (PackRecord))
+    goto invalid;
+
+  pack            = pack_data_new ();
+  pack->bytes      = g_steal_pointer (&bytes);
+  pack->records    = (const PackRecord *) (header + 1);
+  pack->n_records  = n_records;
+  pack->generation = GUINT64_FROM_LE (header->generation);
+  pack->device     = stat_buf->st_dev;
+  pack->inode      = stat_buf->st_ino;
+  return g_steal_pointer (&pack);
+
+invalid:
+  g_set_error (
+      error,
+      BZ_ENTRY_CACHE_ERROR,
+      BZ_ENTRY_CACHE_ERROR_DECACHE_FAILED,
+      "%s is not a valid entry pack",
+      path);
+  return NULL;
+}
+
+/* Returns the current pack, remapping it if it was replaced since we last
+ * looked. Holding onto the mapping keeps the old inode alive, so comparing
+ * inode numbers is enough to tell */
+static PackData *
+acquire_pack (OngoingTaskData *task_data)
+{
+  g_autofree char *main_cache     = NULL;
+  g_autofree char *path           = NULL;
+  GStatBuf stat_buf               = { 0 };
+  g_autoptr (GMutexLocker) locker = NULL;
+  g_autoptr (GError) local_error  = NULL;
+  g_autoptr (PackData) pack       = NULL;
+
+  main_cache = bz_dup_module_dir ();
+  path       = g_build_filename (main_cache, PACK_FILENAME, NULL);
+
+  locker = g_mutex_locker_new (&task_data->pack_mutex);
+  if (g_stat (path, &stat_buf) != 0)
+    {
+      g_clear_pointer (&task_data->pack, pack_data_unref);
+      return NULL;
+    }
+
+  if (task_data->pack != NULL &&
+      task_data->pack->device == (guint64) stat_buf.st_dev &&
+      task_data->pack->inode == (guint64) stat_buf.st_ino)
+    return pack_data_ref (task_data->pack);
+
+  pack = open_pack (path, &stat_buf, &local_error);
+  if (pack == NULL)
+    g_warning ("Ignoring entry pack: %s", local_error->message);
+
+  g_clear_pointer (&task_data->pack, pack_data_unref);
+  if (pack != NULL)
+    task_data->pack = pack_data_ref (pack);
+  return g_steal_pointer (&pack);
+}
+
+static const PackRecord *
+pack_find_record (PackData   *pack,
+                  const char *unique_id_checksum)
+{
+  guint lower = 0;
+  guint upper = 0;
+
+  if (!is_checksum_name (unique_id_checksum))
+    return NULL;
+
+  upper = pack->n_records;
+  while (lower < upper)
+    {
+      guint mid = 0;
+      int   cmp = 0;
+
+      mid = lower + (upper - lower) / 2;
+      cmp = memcmp (pack->records[mid].checksum, unique_id_checksum, CHECKSUM_LENGTH);
+      if (cmp == 0)
+        return &pack->records[mid];
+      else if (cmp < 0)
+        lower = mid + 1;
+      else
+        upper = mid;
+    }
+  return NULL;
+}
+
+static GBytes *
+pack_dup_entry_bytes (PackData   *pack,
+                      const char *unique_id_checksum)
+{
+  const PackRecord *record = NULL;
+  guint64           offset = 0;
+  guint64           size   = 0;
+
+  record = pack_find_record (pack, unique_id_checksum);
+  if (record == NULL)
+    return NULL;
+
+  offset = GUINT64_FROM_LE (record->offset);
+  size   = GUINT64_FROM_LE (record->size);
+  if (offset > g_bytes_get_size (pack->bytes) ||
+      size > g_bytes_get_size (pack->bytes) - offset)
+    return NULL;
+
+  return g_bytes_new_from_bytes (pack->bytes, offset, size);
+}
+
+static void
+compute_digest (GBytes *bytes,
+                guint8  digest[DIGEST_LENGTH])
+{
+  g_autoptr (GChecksum) checksum = NULL;
+  gconstpointer data             = NULL;
+  gsize         size             = 0;
+  gsize         digest_len       = DIGEST_LENGTH;
+
+  data     = g_bytes_get_data (bytes, &size);
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+  g_checksum_update (checksum, data, size);
+  g_checksum_get_digest (checksum, digest, &digest_len);
+}
+
+/* Finds the digest of what is currently cached for the entry, following
+ * the same precedence as `load_entry_bytes`, without reading the entry.
+ * Returns FALSE if it cannot be known this way */
+static gboolean
+lookup_digest (OngoingTaskData *task_data,
+               GFile           *file,
+               const char      *unique_id_checksum,
+               guint8           digest[DIGEST_LENGTH])
+{
+  g_autoptr (GError) local_error  = NULL;
+  g_autoptr (GFileInfo) info      = NULL;
+  g_autoptr (GMutexLocker) locker = NULL;
+  DigestRecord     *loose         = NULL;
+  g_autoptr (PackData) pack       = NULL;
+  const PackRecord *record        = NULL;
+
+  info = g_file_query_info (
+      file,
+      LOOSE_FILE_ATTRIBUTES,
+      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+      NULL,
+      &local_error);
+  if (info != NULL)
+    {
+      locker = g_mutex_locker_new (&task_data->digests_mutex);
+      loose  = g_hash_table_lookup (task_data->digests, unique_id_checksum);
+      if (loose == NULL ||
+          loose->size != g_file_info_get_size (info) ||
+          loose->mtime_usec != info_get_mtime_usec (info) ||
+          loose->inode != g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE))
+        return FALSE;
+
+      memcpy (digest, loose->digest, DIGEST_LENGTH);
+      return TRUE;
+    }
+  if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+    return FALSE;
+
+  pack = acquire_pack (task_data);
+  if (pack == NULL)
+    return FALSE;
+  record = pack_find_record (pack, unique_id_checksum);
+  if (record == NULL)
+    return FALSE;
+
+  memcpy (digest, record->digest, DIGEST_LENGTH);
+  return TRUE;
+}
+
+/* Records the digest of the loose file the entry was just compared against
+ * or written to. Entries living in the pack already have theirs stored */
+static void
+remember_digest (OngoingTaskData *task_data,
+                 GFile           *file,
+                 const char      *unique_id_checksum,
+                 const guint8     digest[DIGEST_LENGTH])
+{
+  g_autoptr (GFileInfo) info      = NULL;
+  g_autoptr (GMutexLocker) locker = NULL;
+  DigestRecord *loose             = NULL;
+
+  info = g_file_query_info (
+      file,
+      LOOSE_FILE_ATTRIBUTES,
+      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+      NULL,
+      NULL);
+
+  locker = g_mutex_locker_new (&task_data->digests_mutex);
+  if (info == NULL)
+    {
+      g_hash_table_remove (task_data->digests, unique_id_checksum);
+      return;
+    }
+
+  loose             = g_new0 (DigestRecord, 1);
+  loose->size       = g_file_info_get_size (info);
+  loose->mtime_usec = info_get_mtime_usec (info);
+  loose->inode      = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+  memcpy (loose->digest, digest, DIGEST_LENGTH);
+  g_hash_table_replace (task_data->digests, g_strdup (unique_id_checksum), loose);
+}
+
+/* Staged entries come first, then loose files, since those are always newer
+ * than the pack */
+static GBytes *
+load_entry_bytes (OngoingTaskData *task_data,
+                  const char      *unique_id_checksum,
+                  GError         **error)
+{
+  g_autoptr (GError) local_error  = NULL;
+  g_autoptr (GMutexLocker) locker = NULL;
+  GBytes *staged                  = NULL;
+  g_autofree char *main_cache     = NULL;
+  g_autofree char *path           = NULL;
+  g_autoptr (GBytes) bytes        = NULL;
+  g_autoptr (PackData) pack       = NULL;
+
+  locker = g_mutex_locker_new (&task_data->staged_mutex);
+  staged = g_hash_table_lookup (task_data->staged, unique_id_checksum);
+  if (staged != NULL)
+    return g_bytes_ref (staged);
+  g_clear_pointer (&locker, g_mutex_locker_free);
+
+  main_cache = bz_dup_module_dir ();
+  path       = g_build_filename (main_cache, unique_id_checksum, NULL);
+
+  bytes = bz_read_path_bytes (path, &local_error);
+  if (bytes != NULL)
+    return g_steal_pointer (&bytes);
+  if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+    {
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return NULL;
+    }
+
+  pack = acquire_pack (task_data);
+  if (pack != NULL)
+    bytes = pack_dup_entry_bytes (pack, unique_id_checksum);
+  if (bytes == NULL)
+    g_set_error (
+        error,
+        G_IO_ERROR,
+        G_IO_ERROR_NOT_FOUND,
+        "Entry with unique ID checksum '%s' is not cached",
+        unique_id_checksum);
+  return g_steal_pointer (&bytes);
+}
+
+static DexFuture *
+init_fiber (OngoingTaskData *task_data)
+{
+  // bz_discard_module_dir ();
+  dex_promise_resolve_boolean (task_data->init, TRUE);
+  return dex_future_new_true ();
+}
+
+/* Runs on whatever thread dropped the last reference */
+static void
+entry_finalized_cb (PruneData *data,
+                    GObject   *where_the_object_was)
+{
+  dex_future_disown (dex_scheduler_spawn (
+      data->task_data->scheduler,
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) prune_fiber,
+      data, prune_data_unref));
+}
+
+static DexFuture *
+prune_fiber (PruneData *data)
+{
+  prune_living (data->task_data, data->unique_id_checksum);
+  return dex_future_new_true ();
+}
+
+/* Stops tracking an entry once nothing needs it anymore. Any task still
+ * running for it will call this again when it's done, and entries read
+ * back in the meantime are simply kept */
+static void
+prune_living (OngoingTaskData *task_data,
+              const char      *unique_id_checksum)
+{
+  g_autoptr (BzGuard) guard0 = NULL;
+  g_autoptr (BzGuard) guard1 = NULL;
+  LivingEntryData *living    = NULL;
+  g_autoptr (BzEntry) entry  = NULL;
+  guint n_living             = 0;
+
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard0, &task_data->alive_mutex, &task_data->alive_gate);
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard0, &task_data->reading_mutex, &task_data->reading_gate);
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard0, &task_data->writing_mutex, &task_data->writing_gate);
+
+  if (g_hash_table_contains (task_data->reading_hash, unique_id_checksum) ||
+      g_hash_table_contains (task_data->writing_hash, unique_id_checksum))
+    return;
+
+  living = g_hash_table_lookup (task_data->alive_hash, unique_id_checksum);
+  if (living == NULL)
+    return;
+
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard1, &living->mutex, &living->gate);
+  entry = g_weak_ref_get (&living->wr);
+  bz_clear_guard (&guard1);
+  if (entry != NULL)
+    return;
+
+  g_hash_table_remove (task_data->alive_hash, unique_id_checksum);
+  n_living = g_hash_table_size (task_data->alive_hash);
   bz_clear_guard (&guard0);
 
-#ifdef __GLIBC__
-  malloc_trim (0);
-#endif
+  set_living_entries (task_data, n_living);
+
+  /* Entries tend to die in bursts, such as when a window closes, so
+   * give the heap back once things have settled down */
+  if (g_atomic_int_compare_and_exchange (&task_data->trim_queued, FALSE, TRUE))
+    dex_future_disown (dex_scheduler_spawn (
+        task_data->scheduler,
+        bz_get_dex_stack_size (),
+        (DexFiberFunc) trim_fiber,
+        ongoing_task_data_ref (task_data),
+        ongoing_task_data_unref));
+}
 
-  g_debug ("Sweep report: finished in %.4f seconds, including time to acquire guards\n"
-           "  Out of a total of %d entries considered:\n"
-           "    %d were skipped due to active tasks being associated with them\n"
-           "    %d application entries were otherwise kept alive\n"
-           "    %d entries were forgotten by the application and were pruned\n"
-           "  Another sweep will take place in %d msec",
-           g_timer_elapsed (timer, NULL),
-           total, active, alive, pruned, WATCH_CLEANUP_INTERVAL_MSEC);
+static void
+set_living_entries (OngoingTaskData *task_data,
+                    guint            n_living)
+{
+  g_autoptr (BzEntryCacheManager) self = NULL;
+  gboolean notify                      = FALSE;
+
+  self = g_weak_ref_get (task_data->self);
+  if (self == NULL)
+    return;
 
-  bz_weak_get_or_return_reject (self, task_data->self);
   g_mutex_lock (&self->mutex);
-  self->living_entries = active + alive;
+  if (self->living_entries != n_living)
+    {
+      self->living_entries = n_living;
+      notify               = !self->notify_queued;
+      self->notify_queued  = TRUE;
+    }
   g_mutex_unlock (&self->mutex);
 
-  dex_future_disown (dex_scheduler_spawn (
-      dex_scheduler_get_default (),
-      bz_get_dex_stack_size (),
-      (DexFiberFunc) notify_props_fiber,
-      bz_track_weak (self),
-      bz_weak_release));
+  if (notify)
+    dex_future_disown (dex_scheduler_spawn (
+        dex_scheduler_get_default (),
+        bz_get_dex_stack_size (),
+        (DexFiberFunc) notify_props_fiber,
+        bz_track_weak (self),
+        bz_weak_release));
+}
+
+static DexFuture *
+trim_fiber (OngoingTaskData *task_data)
+{
+  dex_await (dex_timeout_new_msec (TRIM_DELAY_MSEC), NULL);
+  g_atomic_int_set (&task_data->trim_queued, FALSE);
+
+#ifdef __GLIBC__
+  malloc_trim (0);
+#endif
 
-  return dex_timeout_new_msec (WATCH_CLEANUP_INTERVAL_MSEC);
+  return dex_future_new_true ();
 }
 
 static DexFuture *
@@ -920,6 +2213,10 @@ notify_props_fiber (GWeakRef *wr)
 
   bz_weak_get_or_return_reject (self, wr);
 
+  g_mutex_lock (&self->mutex);
+  self->notify_queued = FALSE;
+  g_mutex_unlock (&self->mutex);
+
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_LIVING_ENTRIES]);
   return dex_future_new_true ();
 }
@@ -49,6 +49,10 @@ DexFuture *
 bz_entry_cache_manager_add (BzEntryCacheManager *self,
                             BzEntry             *entry);
 
+DexFuture *
+bz_entry_cache_manager_adopt (BzEntryCacheManager *self,
+                              BzEntry             *entry);
+
 DexFuture *
 bz_entry_cache_manager_get (BzEntryCacheManager *self,
                             const char          *unique_id);
@@ -57,9 +61,20 @@ DexFuture *
 bz_entry_cache_manager_get_by_checksum (BzEntryCacheManager *self,
                                         const char          *unique_id_checksum);
 
+DexFuture *
+bz_entry_cache_manager_get_living (BzEntryCacheManager *self,
+                                   const char          *unique_id);
+
 DexFuture *
 bz_entry_cache_manager_enumerate_disk (BzEntryCacheManager *self);
 
+void
+bz_entry_cache_manager_begin_generation (BzEntryCacheManager *self);
+
+DexFuture *
+bz_entry_cache_manager_compact (BzEntryCacheManager *self,
+                                GHashTable          *seen);
+
 G_END_DECLS
 
 /* End of bz-entry-cache-manager.h */
@@ -46,6 +46,7 @@ struct _BzEntryGroup
   GtkStringList *unique_ids;
   GtkStringList *installed_versions;
   GArray        *state_flags;
+  GArray        *usefulness;
 
   char           *id;
   char           *title;
@@ -124,6 +125,7 @@ enum
   PROP_REMOVABLE_AND_AVAILABLE,
   PROP_USER_DATA_SIZE,
   PROP_CACHE_SIZE,
+  PROP_SEARCHABLE,
 
   LAST_PROP
 };
@@ -162,6 +164,7 @@ bz_entry_group_dispose (GObject *object)
   g_clear_object (&self->unique_ids);
   g_clear_object (&self->installed_versions);
   g_clear_pointer (&self->state_flags, g_array_unref);
+  g_clear_pointer (&self->usefulness, g_array_unref);
 
   g_clear_pointer (&self->id, g_free);
   g_clear_pointer (&self->title, g_free);
@@ -275,6 +278,9 @@ bz_entry_group_get_property (GObject    *object,
     case PROP_CACHE_SIZE:
       g_value_set_uint64 (value, bz_entry_group_get_cache_size (self));
       break;
+    case PROP_SEARCHABLE:
+      g_value_set_boolean (value, bz_entry_group_is_searchable (self));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -313,6 +319,7 @@ bz_entry_group_set_property (GObject      *object,
     case PROP_REMOVABLE_AND_AVAILABLE:
     case PROP_USER_DATA_SIZE:
     case PROP_CACHE_SIZE:
+    case PROP_SEARCHABLE:
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -513,6 +520,12 @@ bz_entry_group_class_init (BzEntryGroupClass *klass)
           0, G_MAXUINT64, 0,
           G_PARAM_READABLE);
 
+  props[PROP_SEARCHABLE] =
+      g_param_spec_boolean (
+          "searchable",
+          NULL, NULL, FALSE,
+          G_PARAM_READABLE);
+
   g_object_class_install_properties (object_class, LAST_PROP, props);
 }
 
@@ -522,6 +535,7 @@ bz_entry_group_init (BzEntryGroup *self)
   self->unique_ids         = gtk_string_list_new (NULL);
   self->installed_versions = gtk_string_list_new (NULL);
   self->state_flags        = g_array_new (FALSE, TRUE, sizeof (gint32));
+  self->usefulness         = g_array_new (FALSE, TRUE, sizeof (int));
 
   self->max_usefulness = -1;
   g_weak_ref_init (&self->ui_entry, NULL);
@@ -727,6 +741,23 @@ bz_entry_group_get_eol (BzEntryGroup *self)
   return self->eol;
 }
 
+void
+bz_entry_group_set_eol (BzEntryGroup *self,
+                        const char   *eol)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  g_return_if_fail (BZ_IS_ENTRY_GROUP (self));
+
+  locker = g_mutex_locker_new (&self->mutex);
+  if (g_strcmp0 (eol, self->eol) == 0)
+    return;
+
+  g_clear_pointer (&self->eol, g_free);
+  self->eol = g_strdup (eol);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_EOL]);
+}
+
 guint64
 bz_entry_group_get_installed_size (BzEntryGroup *self)
 {
@@ -761,6 +792,23 @@ bz_entry_group_append_addon_group_id (BzEntryGroup *self,
   gtk_string_list_append (self->addon_group_ids, id);
 }
 
+void
+bz_entry_group_remove_addon_group_id (BzEntryGroup *self,
+                                      const char   *id)
+{
+  guint position = 0;
+
+  g_return_if_fail (BZ_IS_ENTRY_GROUP (self));
+  g_return_if_fail (id != NULL);
+
+  if (self->addon_group_ids == NULL)
+    return;
+
+  position = gtk_string_list_find (self->addon_group_ids, id);
+  if (position != G_MAXUINT)
+    gtk_string_list_remove (self->addon_group_ids, position);
+}
+
 int
 bz_entry_group_get_n_addons (BzEntryGroup *self)
 {
@@ -947,10 +995,12 @@ bz_entry_group_add (BzEntryGroup *self,
   const char      *donation_url       = NULL;
   BzCategoryFlags  entry_categories   = BZ_CATEGORY_FLAGS_NONE;
   guint            existing           = 0;
+  guint            position           = 0;
   gboolean         is_searchable      = FALSE;
   AsContentRating *content_rating     = NULL;
   gboolean         is_addon           = FALSE;
   gint32           state_flags        = 0;
+  gint32           previous_flags     = 0;
 
   g_return_if_fail (BZ_IS_ENTRY_GROUP (self));
   g_return_if_fail (BZ_IS_ENTRY (entry));
@@ -1015,16 +1065,24 @@ bz_entry_group_add (BzEntryGroup *self,
 
   usefulness = bz_entry_calc_usefulness (entry);
   existing   = gtk_string_list_find (self->unique_ids, unique_id);
+  if (existing != G_MAXUINT)
+    previous_flags = g_array_index (self->state_flags, gint32, existing);
 
+  /* `state_flags` and `usefulness` move in lockstep with `unique_ids` */
   if (usefulness >= self->max_usefulness)
     {
       if (existing != G_MAXUINT)
         {
           gtk_string_list_remove (self->unique_ids, existing);
           gtk_string_list_remove (self->installed_versions, existing);
+          g_array_remove_index (self->state_flags, existing);
+          g_array_remove_index (self->usefulness, existing);
         }
       gtk_string_list_splice (self->unique_ids, 0, 0, (const char *const[]) { unique_id, NULL });
       gtk_string_list_splice (self->installed_versions, 0, 0, (const char *const[]) { installed_version != NULL ? installed_version : "", NULL });
+      g_array_insert_val (self->state_flags, 0, state_flags);
+      g_array_insert_val (self->usefulness, 0, usefulness);
+      position = 0;
 
       if (title != NULL)
         {
@@ -1119,6 +1177,14 @@ bz_entry_group_add (BzEntryGroup *self,
         {
           gtk_string_list_append (self->unique_ids, unique_id);
           gtk_string_list_append (self->installed_versions, installed_version != NULL ? installed_version : "");
+          g_array_append_val (self->state_flags, state_flags);
+          g_array_append_val (self->usefulness, usefulness);
+          position = self->usefulness->len - 1;
+        }
+      else
+        {
+          g_array_index (self->usefulness, int, existing) = usefulness;
+          position = existing;
         }
 
       if (title != NULL && self->title == NULL)
@@ -1172,26 +1238,19 @@ bz_entry_group_add (BzEntryGroup *self,
         }
     }
 
-  if (existing != G_MAXUINT)
-    {
-      gint32 previous_state_flags = 0;
-
-      /* revert the old state if we are replacing */
-
-      previous_state_flags = g_array_index (self->state_flags, gint32, existing);
-      if (previous_state_flags & ENTRY_INSTALLABLE)
-        self->installable--;
-      if (previous_state_flags & ENTRY_INSTALLABLE_AVAILABLE)
-        self->installable_available--;
-      if (previous_state_flags & ENTRY_UPDATABLE)
-        self->updatable--;
-      if (previous_state_flags & ENTRY_UPDATABLE_AVAILABLE)
-        self->updatable_available--;
-      if (previous_state_flags & ENTRY_REMOVABLE)
-        self->removable--;
-      if (previous_state_flags & ENTRY_REMOVABLE_AVAILABLE)
-        self->removable_available--;
-    }
+  /* revert the old state if we are replacing */
+  if (previous_flags & ENTRY_INSTALLABLE)
+    self->installable--;
+  if (previous_flags & ENTRY_INSTALLABLE_AVAILABLE)
+    self->installable_available--;
+  if (previous_flags & ENTRY_UPDATABLE)
+    self->updatable--;
+  if (previous_flags & ENTRY_UPDATABLE_AVAILABLE)
+    self->updatable_available--;
+  if (previous_flags & ENTRY_REMOVABLE)
+    self->removable--;
+  if (previous_flags & ENTRY_REMOVABLE_AVAILABLE)
+    self->removable_available--;
 
   if (bz_entry_is_installed (entry))
     {
@@ -1220,13 +1279,103 @@ bz_entry_group_add (BzEntryGroup *self,
           g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLABLE]);
         }
     }
-  if (existing != G_MAXUINT)
-    g_array_index (self->state_flags, gint32, existing) = state_flags;
-  else
-    g_array_append_val (self->state_flags, state_flags);
+  g_array_index (self->state_flags, gint32, position) = state_flags;
+
+  if (!is_addon && is_searchable && !self->searchable)
+    {
+      self->searchable = TRUE;
+      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_SEARCHABLE]);
+    }
+}
+
+/* Drops an entry which no longer exists anywhere. The group's metadata is
+ * left as is, since it describes the same app either way, but the most
+ * useful entry left over takes the place of a removed head */
+void
+bz_entry_group_remove (BzEntryGroup *self,
+                       const char   *unique_id)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  guint  existing                 = 0;
+  gint32 state_flags              = 0;
+  guint  best                     = 0;
+
+  g_return_if_fail (BZ_IS_ENTRY_GROUP (self));
+  g_return_if_fail (unique_id != NULL);
+
+  locker = g_mutex_locker_new (&self->mutex);
 
-  if (!is_addon && is_searchable)
-    self->searchable = TRUE;
+  existing = gtk_string_list_find (self->unique_ids, unique_id);
+  if (existing == G_MAXUINT)
+    return;
+
+  state_flags = g_array_index (self->state_flags, gint32, existing);
+  if (state_flags & ENTRY_INSTALLABLE)
+    self->installable--;
+  if (state_flags & ENTRY_INSTALLABLE_AVAILABLE)
+    self->installable_available--;
+  if (state_flags & ENTRY_UPDATABLE)
+    self->updatable--;
+  if (state_flags & ENTRY_UPDATABLE_AVAILABLE)
+    self->updatable_available--;
+  if (state_flags & ENTRY_REMOVABLE)
+    self->removable--;
+  if (state_flags & ENTRY_REMOVABLE_AVAILABLE)
+    self->removable_available--;
+
+  gtk_string_list_remove (self->unique_ids, existing);
+  gtk_string_list_remove (self->installed_versions, existing);
+  g_array_remove_index (self->state_flags, existing);
+  g_array_remove_index (self->usefulness, existing);
+
+  if (existing == 0)
+    {
+      for (guint i = 1; i < self->usefulness->len; i++)
+        {
+          if (g_array_index (self->usefulness, int, i) >
+              g_array_index (self->usefulness, int, best))
+            best = i;
+        }
+
+      if (best > 0)
+        {
+          g_autofree char *best_id      = NULL;
+          g_autofree char *best_version = NULL;
+          gint32           best_flags   = 0;
+          int              best_useful  = 0;
+
+          best_id      = g_strdup (gtk_string_list_get_string (self->unique_ids, best));
+          best_version = g_strdup (gtk_string_list_get_string (self->installed_versions, best));
+          best_flags   = g_array_index (self->state_flags, gint32, best);
+          best_useful  = g_array_index (self->usefulness, int, best);
+
+          gtk_string_list_remove (self->unique_ids, best);
+          gtk_string_list_remove (self->installed_versions, best);
+          g_array_remove_index (self->state_flags, best);
+          g_array_remove_index (self->usefulness, best);
+
+          gtk_string_list_splice (self->unique_ids, 0, 0, (const char *const[]) { best_id, NULL });
+          gtk_string_list_splice (self->installed_versions, 0, 0, (const char *const[]) { best_version, NULL });
+          g_array_insert_val (self->state_flags, 0, best_flags);
+          g_array_insert_val (self->usefulness, 0, best_useful);
+        }
+
+      if (self->usefulness->len > 0)
+        self->max_usefulness = g_array_index (self->usefulness, int, 0);
+      else
+        self->max_usefulness = -1;
+
+      g_weak_ref_set (&self->ui_entry, NULL);
+      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_UI_ENTRY]);
+    }
+
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLED_VERSIONS]);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLABLE]);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLABLE_AND_AVAILABLE]);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_UPDATABLE]);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_UPDATABLE_AND_AVAILABLE]);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_REMOVABLE]);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_REMOVABLE_AND_AVAILABLE]);
 }
 
 void
@@ -82,6 +82,10 @@ bz_entry_group_get_search_tokens (BzEntryGroup *self);
 const char *
 bz_entry_group_get_eol (BzEntryGroup *self);
 
+void
+bz_entry_group_set_eol (BzEntryGroup *self,
+                        const char   *eol);
+
 guint64
 bz_entry_group_get_installed_size (BzEntryGroup *self);
 
@@ -92,6 +96,10 @@ void
 bz_entry_group_append_addon_group_id (BzEntryGroup *self,
                                       const char   *id);
 
+void
+bz_entry_group_remove_addon_group_id (BzEntryGroup *self,
+                                      const char   *id);
+
 int
 bz_entry_group_get_n_addons (BzEntryGroup *self);
 
@@ -156,6 +164,10 @@ bz_entry_group_add (BzEntryGroup *self,
                     BzEntry      *runtime,
                     gboolean      ignore_eol);
 
+void
+bz_entry_group_remove (BzEntryGroup *self,
+                       const char   *unique_id);
+
 void
 bz_entry_group_connect_living (BzEntryGroup *self,
                                BzEntry      *entry);
@@ -130,6 +130,11 @@ typedef struct
   int                   favorites_count;
 
   GHashTable *flathub_prop_queries;
+
+  /* See `borrow_string` */
+  GVariant *backing;
+  /* See `ensure_details` */
+  GVariant *details;
 } BzEntryPrivate;
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (BzEntry, bz_entry, G_TYPE_OBJECT);
@@ -237,12 +242,44 @@ maybe_save_paintable (BzEntryPrivate  *priv,
                       GdkPaintable    *paintable,
                       GVariantBuilder *builder);
 
+static GVariant *
+save_paintable (BzEntryPrivate *priv,
+                GdkPaintable   *paintable);
+
 static GdkPaintable *
 make_async_texture (GVariant *parse);
 
+static GIcon *
+make_mini_icon (GVariant *serialized);
+
+static void
+ensure_details (BzEntry *self);
+static GVariant *
+dup_details (BzEntry *self);
+
+static char *
+borrow_string (BzEntryPrivate *priv,
+               const char     *string);
+static char *
+next_string (BzEntryPrivate *priv,
+             GVariantIter   *iter);
+static void
+release_string (BzEntryPrivate *priv,
+                char          **string);
+static gboolean
+details_has_items (BzEntry *self,
+                   guint    index);
+
+static gboolean
+find_addon (BzEntryPrivate *priv,
+            const char     *id,
+            guint          *position);
+
 static void
 clear_entry (BzEntry *self);
 
+static GMutex details_mutex;
+
 static void
 bz_entry_dispose (GObject *object)
 {
@@ -304,6 +341,7 @@ bz_entry_get_property (GObject    *object,
       g_value_set_string (value, priv->description);
       break;
     case PROP_LONG_DESCRIPTION:
+      ensure_details (self);
       g_value_set_string (value, priv->long_description);
       break;
     case PROP_REMOTE_REPO_NAME:
@@ -353,15 +391,19 @@ bz_entry_get_property (GObject    *object,
       g_value_set_object (value, priv->developer_apps);
       break;
     case PROP_SCREENSHOT_PAINTABLES:
+      ensure_details (self);
       g_value_set_object (value, priv->screenshot_paintables);
       break;
     case PROP_SCREENSHOT_CAPTIONS:
+      ensure_details (self);
       g_value_set_object (value, priv->screenshot_captions);
       break;
     case PROP_THUMBNAIL_PAINTABLE:
+      ensure_details (self);
       g_value_set_object (value, priv->thumbnail_paintable);
       break;
     case PROP_SHARE_URLS:
+      ensure_details (self);
       g_value_set_object (value, priv->share_urls);
       break;
     case PROP_DONATION_URL:
@@ -371,6 +413,7 @@ bz_entry_get_property (GObject    *object,
       g_value_set_string (value, priv->ratings_summary);
       break;
     case PROP_VERSION_HISTORY:
+      ensure_details (self);
       g_value_set_object (value, priv->version_history);
       break;
     case PROP_LIGHT_ACCENT_COLOR:
@@ -401,12 +444,14 @@ bz_entry_get_property (GObject    *object,
       g_value_set_object (value, priv->content_rating);
       break;
     case PROP_KEYWORDS:
+      ensure_details (self);
       g_value_set_object (value, priv->keywords);
       break;
     case PROP_CATEGORIES:
       g_value_set_uint (value, priv->categories);
       break;
     case PROP_PERMISSIONS:
+      ensure_details (self);
       g_value_set_object (value, priv->permissions);
       break;
     case PROP_IS_FLATHUB:
@@ -456,7 +501,7 @@ bz_entry_set_property (GObject      *object,
       priv->installed = g_value_get_boolean (value);
       break;
     case PROP_INSTALLED_VERSION:
-      g_clear_pointer (&priv->installed_version, g_free);
+      release_string (priv, &priv->installed_version);
       priv->installed_version = g_value_dup_string (value);
       break;
     case PROP_REINSTALLABLE:
@@ -473,41 +518,42 @@ bz_entry_set_property (GObject      *object,
       priv->kinds = g_value_get_flags (value);
       break;
     case PROP_ID:
-      g_clear_pointer (&priv->id, g_free);
+      release_string (priv, &priv->id);
       priv->id = g_value_dup_string (value);
       break;
     case PROP_UNIQUE_ID:
-      g_clear_pointer (&priv->unique_id, g_free);
+      release_string (priv, &priv->unique_id);
       priv->unique_id = g_value_dup_string (value);
       break;
     case PROP_UNIQUE_ID_CHECKSUM:
-      g_clear_pointer (&priv->unique_id_checksum, g_free);
+      release_string (priv, &priv->unique_id_checksum);
       priv->unique_id_checksum = g_value_dup_string (value);
       break;
     case PROP_TITLE:
-      g_clear_pointer (&priv->title, g_free);
+      release_string (priv, &priv->title);
       priv->title = g_value_dup_string (value);
       break;
     case PROP_EOL:
-      g_clear_pointer (&priv->eol, g_free);
+      release_string (priv, &priv->eol);
       priv->eol = g_value_dup_string (value);
       break;
     case PROP_DESCRIPTION:
-      g_clear_pointer (&priv->description, g_free);
+      release_string (priv, &priv->description);
       priv->description = g_value_dup_string (value);
       break;
     case PROP_LONG_DESCRIPTION:
-      g_clear_pointer (&priv->long_description, g_free);
+      ensure_details (self);
+      release_string (priv, &priv->long_description);
       priv->long_description = g_value_dup_string (value);
       break;
     case PROP_REMOTE_REPO_NAME:
-      g_clear_pointer (&priv->remote_repo_name, g_free);
+      release_string (priv, &priv->remote_repo_name);
       priv->remote_repo_name = g_value_dup_string (value);
       priv->is_flathub       = g_strcmp0 (priv->remote_repo_name, "flathub") == 0;
       g_object_notify_by_pspec (object, props[PROP_IS_FLATHUB]);
       break;
     case PROP_URL:
-      g_clear_pointer (&priv->url, g_free);
+      release_string (priv, &priv->url);
       priv->url = g_value_dup_string (value);
       break;
     case PROP_SIZE:
@@ -525,7 +571,7 @@ bz_entry_set_property (GObject      *object,
       priv->mini_icon = g_value_dup_object (value);
       break;
     case PROP_SEARCH_TOKENS:
-      g_clear_pointer (&priv->search_tokens, g_free);
+      release_string (priv, &priv->search_tokens);
       priv->search_tokens = g_value_dup_string (value);
       break;
     case PROP_REMOTE_REPO_ICON:
@@ -533,26 +579,26 @@ bz_entry_set_property (GObject      *object,
       priv->remote_repo_icon = g_value_dup_object (value);
       break;
     case PROP_METADATA_LICENSE:
-      g_clear_pointer (&priv->metadata_license, g_free);
+      release_string (priv, &priv->metadata_license);
       priv->metadata_license = g_value_dup_string (value);
       break;
     case PROP_PROJECT_LICENSE:
-      g_clear_pointer (&priv->project_license, g_free);
+      release_string (priv, &priv->project_license);
       priv->project_license = g_value_dup_string (value);
       break;
     case PROP_IS_FLOSS:
       priv->is_floss = g_value_get_boolean (value);
       break;
     case PROP_PROJECT_GROUP:
-      g_clear_pointer (&priv->project_group, g_free);
+      release_string (priv, &priv->project_group);
       priv->project_group = g_value_dup_string (value);
       break;
     case PROP_DEVELOPER:
-      g_clear_pointer (&priv->developer, g_free);
+      release_string (priv, &priv->developer);
       priv->developer = g_value_dup_string (value);
       break;
     case PROP_DEVELOPER_ID:
-      g_clear_pointer (&priv->developer_id, g_free);
+      release_string (priv, &priv->developer_id);
       priv->developer_id = g_value_dup_string (value);
       break;
     case PROP_DEVELOPER_APPS:
@@ -560,39 +606,44 @@ bz_entry_set_property (GObject      *object,
       priv->developer_apps = g_value_dup_object (value);
       break;
     case PROP_SCREENSHOT_PAINTABLES:
+      ensure_details (self);
       g_clear_object (&priv->screenshot_paintables);
       priv->screenshot_paintables = g_value_dup_object (value);
       break;
     case PROP_SCREENSHOT_CAPTIONS:
+      ensure_details (self);
       g_clear_object (&priv->screenshot_captions);
       priv->screenshot_captions = g_value_dup_object (value);
       break;
     case PROP_THUMBNAIL_PAINTABLE:
+      ensure_details (self);
       g_clear_object (&priv->thumbnail_paintable);
       priv->thumbnail_paintable = g_value_dup_object (value);
       break;
     case PROP_SHARE_URLS:
+      ensure_details (self);
       g_clear_object (&priv->share_urls);
       priv->share_urls = g_value_dup_object (value);
       break;
     case PROP_DONATION_URL:
-      g_clear_pointer (&priv->donation_url, g_free);
+      release_string (priv, &priv->donation_url);
       priv->donation_url = g_value_dup_string (value);
       break;
     case PROP_RATINGS_SUMMARY:
-      g_clear_pointer (&priv->ratings_summary, g_free);
+      release_string (priv, &priv->ratings_summary);
       priv->ratings_summary = g_value_dup_string (value);
       break;
     case PROP_VERSION_HISTORY:
+      ensure_details (self);
       g_clear_object (&priv->version_history);
       priv->version_history = g_value_dup_object (value);
       break;
     case PROP_LIGHT_ACCENT_COLOR:
-      g_clear_pointer (&priv->light_accent_color, g_free);
+      release_string (priv, &priv->light_accent_color);
       priv->light_accent_color = g_value_dup_string (value);
       break;
     case PROP_DARK_ACCENT_COLOR:
-      g_clear_pointer (&priv->dark_accent_color, g_free);
+      release_string (priv, &priv->dark_accent_color);
       priv->dark_accent_color = g_value_dup_string (value);
       break;
     case PROP_IS_MOBILE_FRIENDLY:
@@ -618,6 +669,7 @@ bz_entry_set_property (GObject      *object,
       priv->content_rating = g_value_dup_object (value);
       break;
     case PROP_KEYWORDS:
+      ensure_details (self);
       g_clear_object (&priv->keywords);
       priv->keywords = g_value_dup_object (value);
       break;
@@ -625,6 +677,7 @@ bz_entry_set_property (GObject      *object,
       priv->categories = g_value_get_uint (value);
       break;
     case PROP_PERMISSIONS:
+      ensure_details (self);
       g_clear_object (&priv->permissions);
       priv->permissions = g_value_dup_object (value);
       break;
@@ -1061,6 +1114,8 @@ bz_entry_real_serialize (BzSerializable  *serializable,
   BzEntry        *self = BZ_ENTRY (serializable);
   BzEntryPrivate *priv = bz_entry_get_instance_private (self);
 
+  ensure_details (self);
+
   g_variant_builder_add (builder, "{sv}", "installed", g_variant_new_boolean (priv->installed));
   if (priv->installed_version != NULL)
     g_variant_builder_add (builder, "{sv}", "installed-version", g_variant_new_string (priv->installed_version));
@@ -1460,7 +1515,7 @@ bz_entry_real_deserialize (BzSerializable *serializable,
       else if (g_strcmp0 (key, "icon-paintable") == 0)
         priv->icon_paintable = make_async_texture (value);
       else if (g_strcmp0 (key, "mini-icon") == 0)
-        priv->mini_icon = g_icon_deserialize (value);
+        priv->mini_icon = make_mini_icon (value);
       else if (g_strcmp0 (key, "remote-repo-icon") == 0)
         priv->remote_repo_icon = make_async_texture (value);
       else if (g_strcmp0 (key, "search-tokens") == 0)
@@ -1707,6 +1762,575 @@ bz_entry_real_deserialize (BzSerializable *serializable,
   return TRUE;
 }
 
+static GVariant *
+pack_string_list (GListModel *model)
+{
+  g_autoptr (GVariantBuilder) builder = NULL;
+  guint n_items                       = 0;
+
+  builder = g_variant_builder_new (G_VARIANT_TYPE_STRING_ARRAY);
+  if (model != NULL)
+    n_items = g_list_model_get_n_items (model);
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (GtkStringObject) string = NULL;
+
+      string = g_list_model_get_item (model, i);
+      g_variant_builder_add (builder, "s", gtk_string_object_get_string (string));
+    }
+
+  return g_variant_builder_end (builder);
+}
+
+/* Empty lists become NULL, same as the vardict format which omits them */
+static GListModel *
+unpack_string_list (GVariant *strings)
+{
+  g_autoptr (GListStore) store = NULL;
+  GVariantIter iter            = { 0 };
+  const char  *string          = NULL;
+
+  if (g_variant_n_children (strings) == 0)
+    return NULL;
+
+  store = g_list_store_new (GTK_TYPE_STRING_OBJECT);
+  g_variant_iter_init (&iter, strings);
+  while (g_variant_iter_next (&iter, "&s", &string))
+    {
+      g_autoptr (GtkStringObject) object = NULL;
+
+      object = gtk_string_object_new (string);
+      g_list_store_append (store, object);
+    }
+
+  return G_LIST_MODEL (g_steal_pointer (&store));
+}
+
+static GVariant *
+pack_paintable (BzEntryPrivate *priv,
+                GdkPaintable   *paintable)
+{
+  GVariant *saved = NULL;
+
+  if (paintable != NULL)
+    saved = save_paintable (priv, paintable);
+  return g_variant_new_maybe (G_VARIANT_TYPE ("(sms)"), saved);
+}
+
+static GdkPaintable *
+unpack_paintable (GVariant *maybe)
+{
+  g_autoptr (GVariant) saved = NULL;
+
+  saved = g_variant_get_maybe (maybe);
+  return saved != NULL ? make_async_texture (saved) : NULL;
+}
+
+static GVariant *
+bz_entry_real_pack (BzEntry *self)
+{
+  BzEntryPrivate *priv                    = bz_entry_get_instance_private (self);
+  g_autoptr (GVariantBuilder) builder     = NULL;
+  g_autoptr (GVariantBuilder) details     = NULL;
+  g_autoptr (GVariantBuilder) sub_builder = NULL;
+  g_autoptr (GVariant) mini_icon          = NULL;
+  g_autoptr (GVariant) pending            = NULL;
+  guint n_items                           = 0;
+
+  builder = g_variant_builder_new (G_VARIANT_TYPE (BZ_ENTRY_PACKED_TYPE));
+
+  g_variant_builder_add (builder, "b", priv->installed);
+  g_variant_builder_add (builder, "ms", priv->installed_version);
+  g_variant_builder_add (builder, "u", priv->kinds);
+  g_variant_builder_add (builder, "b", priv->reinstallable);
+  g_variant_builder_add (builder, "b", priv->searchable);
+  g_variant_builder_add_value (builder, pack_string_list (priv->addons));
+
+  g_variant_builder_add (builder, "ms", priv->id);
+  g_variant_builder_add (builder, "ms", priv->unique_id);
+  g_variant_builder_add (builder, "ms", priv->unique_id_checksum);
+  g_variant_builder_add (builder, "ms", priv->title);
+  g_variant_builder_add (builder, "ms", priv->eol);
+  g_variant_builder_add (builder, "ms", priv->description);
+  g_variant_builder_add (builder, "ms", priv->remote_repo_name);
+  g_variant_builder_add (builder, "ms", priv->url);
+
+  g_variant_builder_add (builder, "t", priv->size);
+  g_variant_builder_add (builder, "t", priv->installed_size);
+
+  if (priv->mini_icon != NULL)
+    mini_icon = g_icon_serialize (priv->mini_icon);
+  g_variant_builder_add_value (builder, pack_paintable (priv, priv->icon_paintable));
+  g_variant_builder_add_value (
+      builder,
+      g_variant_new_maybe (
+          G_VARIANT_TYPE_VARIANT,
+          mini_icon != NULL ? g_variant_new_variant (mini_icon) : NULL));
+  g_variant_builder_add_value (builder, pack_paintable (priv, priv->remote_repo_icon));
+
+  g_variant_builder_add (builder, "ms", priv->search_tokens);
+  g_variant_builder_add (builder, "ms", priv->metadata_license);
+  g_variant_builder_add (builder, "ms", priv->project_license);
+  g_variant_builder_add (builder, "b", priv->is_floss);
+  g_variant_builder_add (builder, "ms", priv->project_group);
+  g_variant_builder_add (builder, "ms", priv->developer);
+  g_variant_builder_add (builder, "ms", priv->developer_id);
+
+  g_variant_builder_add (builder, "ms", priv->donation_url);
+  g_variant_builder_add (builder, "ms", priv->light_accent_color);
+  g_variant_builder_add (builder, "ms", priv->dark_accent_color);
+  g_variant_builder_add (builder, "b", priv->is_mobile_friendly);
+  g_variant_builder_add (builder, "u", priv->required_controls);
+  g_variant_builder_add (builder, "u", priv->recommended_controls);
+  g_variant_builder_add (builder, "u", priv->supported_controls);
+  g_variant_builder_add (builder, "i", priv->min_display_length);
+  g_variant_builder_add (builder, "i", priv->max_display_length);
+
+  if (priv->content_rating != NULL)
+    {
+      const char *kind                   = NULL;
+      g_autofree const char **rating_ids = NULL;
+
+      kind        = as_content_rating_get_kind (priv->content_rating);
+      rating_ids  = as_content_rating_get_all_rating_ids ();
+      sub_builder = g_variant_builder_new (G_VARIANT_TYPE ("a(ss)"));
+
+      for (gsize i = 0; rating_ids[i] != NULL; i++)
+        {
+          AsContentRatingValue value = AS_CONTENT_RATING_VALUE_UNKNOWN;
+
+          value = as_content_rating_get_value (priv->content_rating, rating_ids[i]);
+          if (value != AS_CONTENT_RATING_VALUE_UNKNOWN)
+            g_variant_builder_add (sub_builder, "(ss)", rating_ids[i], as_content_rating_value_to_string (value));
+        }
+
+      g_variant_builder_add_value (
+          builder,
+          g_variant_new_maybe (
+              NULL,
+              g_variant_new ("(s@a(ss))",
+                             kind ? kind : "oars-1.1",
+                             g_variant_builder_end (sub_builder))));
+      g_clear_pointer (&sub_builder, g_variant_builder_unref);
+    }
+  else
+    g_variant_builder_add_value (builder, g_variant_new_maybe (G_VARIANT_TYPE ("(sa(ss))"), NULL));
+  g_variant_builder_add (builder, "u", priv->categories);
+
+  if (priv->verification_status != NULL)
+    {
+      gboolean         verified              = FALSE;
+      g_autofree char *method                = NULL;
+      g_autofree char *website               = NULL;
+      g_autofree char *login_name            = NULL;
+      g_autofree char *login_provider        = NULL;
+      g_autofree char *timestamp             = NULL;
+      gboolean         login_is_organization = FALSE;
+
+      g_object_get (priv->verification_status,
+                    "verified", &verified,
+                    "method", &method,
+                    "website", &website,
+                    "login-name", &login_name,
+                    "login-provider", &login_provider,
+                    "timestamp", &timestamp,
+                    "login-is-organization", &login_is_organization,
+                    NULL);
+
+      g_variant_builder_add_value (
+          builder,
+          g_variant_new_maybe (
+              NULL,
+              g_variant_new ("(bmsmsmsmsmsb)",
+                             verified, method, website, login_name,
+                             login_provider, timestamp, login_is_organization)));
+    }
+  else
+    g_variant_builder_add_value (builder, g_variant_new_maybe (G_VARIANT_TYPE ("(bmsmsmsmsmsb)"), NULL));
+  g_variant_builder_add (builder, "b", priv->is_flathub);
+
+  /* Details which were never decoded can be passed through untouched */
+  pending = dup_details (self);
+  if (pending != NULL)
+    {
+      g_variant_builder_add_value (builder, pending);
+      return g_variant_builder_end (builder);
+    }
+
+  /* Everything below is only needed once the entry is looked at closely,
+   * so it lives in its own tuple which can be decoded later */
+  details = g_variant_builder_new (G_VARIANT_TYPE (BZ_ENTRY_PACKED_DETAILS_TYPE));
+
+  g_variant_builder_add (details, "ms", priv->long_description);
+
+  sub_builder = g_variant_builder_new (G_VARIANT_TYPE ("a(sms)"));
+  n_items     = priv->screenshot_paintables != NULL ? g_list_model_get_n_items (priv->screenshot_paintables) : 0;
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (GdkPaintable) paintable = NULL;
+      GVariant *saved                    = NULL;
+
+      paintable = g_list_model_get_item (priv->screenshot_paintables, i);
+      saved     = save_paintable (priv, paintable);
+      if (saved != NULL)
+        g_variant_builder_add_value (sub_builder, saved);
+    }
+  g_variant_builder_add_value (details, g_variant_builder_end (sub_builder));
+  g_clear_pointer (&sub_builder, g_variant_builder_unref);
+  g_variant_builder_add_value (details, pack_string_list (priv->screenshot_captions));
+  g_variant_builder_add_value (details, pack_paintable (priv, priv->thumbnail_paintable));
+
+  sub_builder = g_variant_builder_new (G_VARIANT_TYPE ("a(ss)"));
+  n_items     = priv->share_urls != NULL ? g_list_model_get_n_items (priv->share_urls) : 0;
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (BzUrl) url = NULL;
+      const char *id        = NULL;
+      const char *url_str   = NULL;
+
+      url     = g_list_model_get_item (priv->share_urls, i);
+      id      = bz_url_get_id (url);
+      url_str = bz_url_get_url (url);
+
+      g_variant_builder_add (sub_builder, "(ss)", id ? id : "", url_str ? url_str : "");
+    }
+  g_variant_builder_add_value (details, g_variant_builder_end (sub_builder));
+  g_clear_pointer (&sub_builder, g_variant_builder_unref);
+
+  sub_builder = g_variant_builder_new (G_VARIANT_TYPE ("a(mstmsms)"));
+  n_items     = priv->version_history != NULL ? g_list_model_get_n_items (priv->version_history) : 0;
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (BzRelease) release = NULL;
+
+      release = g_list_model_get_item (priv->version_history, i);
+      g_variant_builder_add (
+          sub_builder,
+          "(mstmsms)",
+          bz_release_get_description (release),
+          bz_release_get_timestamp (release),
+          bz_release_get_url (release),
+          bz_release_get_version (release));
+    }
+  g_variant_builder_add_value (details, g_variant_builder_end (sub_builder));
+  g_clear_pointer (&sub_builder, g_variant_builder_unref);
+
+  g_variant_builder_add_value (details, pack_string_list (priv->keywords));
+
+  /* Permissions are sparse, so they keep their vardict representation */
+  sub_builder = g_variant_builder_new (G_VARIANT_TYPE_VARDICT);
+  if (priv->permissions != NULL)
+    bz_app_permissions_serialize (priv->permissions, sub_builder);
+  g_variant_builder_add_value (details, g_variant_builder_end (sub_builder));
+  g_clear_pointer (&sub_builder, g_variant_builder_unref);
+
+  g_variant_builder_add_value (builder, g_variant_builder_end (details));
+
+  return g_variant_builder_end (builder);
+}
+
+/* Only decodes what tiles and search need. The details tuple is retained,
+ * still referencing the cache bytes, until `ensure_details` is called */
+static gboolean
+bz_entry_real_unpack (BzEntry  *self,
+                      GVariant *packed,
+                      GError  **error)
+{
+  BzEntryPrivate *priv              = bz_entry_get_instance_private (self);
+  GVariantIter iter                 = { 0 };
+  g_autoptr (GVariant) addons       = NULL;
+  g_autoptr (GVariant) icon         = NULL;
+  g_autoptr (GVariant) mini_icon    = NULL;
+  g_autoptr (GVariant) repo_icon    = NULL;
+  g_autoptr (GVariant) rating       = NULL;
+  g_autoptr (GVariant) verification = NULL;
+  g_autoptr (GVariant) child        = NULL;
+
+  if (!g_variant_is_of_type (packed, G_VARIANT_TYPE (BZ_ENTRY_PACKED_TYPE)))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Packed entry has unexpected type '%s'",
+                   g_variant_get_type_string (packed));
+      return FALSE;
+    }
+
+  clear_entry (self);
+
+  /* Strings are borrowed from the serialized data, so make sure it
+   * exists before anything is read out of it */
+  g_variant_get_data (packed);
+  priv->backing = g_variant_ref (packed);
+
+  g_variant_iter_init (&iter, packed);
+
+  g_variant_iter_next (&iter, "b", &priv->installed);
+  priv->installed_version = next_string (priv, &iter);
+  g_variant_iter_next (&iter, "u", &priv->kinds);
+  g_variant_iter_next (&iter, "b", &priv->reinstallable);
+  g_variant_iter_next (&iter, "b", &priv->searchable);
+  g_variant_iter_next (&iter, "@as", &addons);
+
+  priv->id = next_string (priv, &iter);
+  priv->unique_id = next_string (priv, &iter);
+  priv->unique_id_checksum = next_string (priv, &iter);
+  priv->title = next_string (priv, &iter);
+  priv->eol = next_string (priv, &iter);
+  priv->description = next_string (priv, &iter);
+  priv->remote_repo_name = next_string (priv, &iter);
+  priv->url = next_string (priv, &iter);
+
+  g_variant_iter_next (&iter, "t", &priv->size);
+  g_variant_iter_next (&iter, "t", &priv->installed_size);
+
+  g_variant_iter_next (&iter, "@m(sms)", &icon);
+  g_variant_iter_next (&iter, "mv", &mini_icon);
+  g_variant_iter_next (&iter, "@m(sms)", &repo_icon);
+
+  priv->search_tokens = next_string (priv, &iter);
+  priv->metadata_license = next_string (priv, &iter);
+  priv->project_license = next_string (priv, &iter);
+  g_variant_iter_next (&iter, "b", &priv->is_floss);
+  priv->project_group = next_string (priv, &iter);
+  priv->developer = next_string (priv, &iter);
+  priv->developer_id = next_string (priv, &iter);
+
+  priv->donation_url = next_string (priv, &iter);
+  priv->light_accent_color = next_string (priv, &iter);
+  priv->dark_accent_color = next_string (priv, &iter);
+  g_variant_iter_next (&iter, "b", &priv->is_mobile_friendly);
+  g_variant_iter_next (&iter, "u", &priv->required_controls);
+  g_variant_iter_next (&iter, "u", &priv->recommended_controls);
+  g_variant_iter_next (&iter, "u", &priv->supported_controls);
+  g_variant_iter_next (&iter, "i", &priv->min_display_length);
+  g_variant_iter_next (&iter, "i", &priv->max_display_length);
+
+  g_variant_iter_next (&iter, "@m(sa(ss))", &rating);
+  g_variant_iter_next (&iter, "u", &priv->categories);
+  g_variant_iter_next (&iter, "@m(bmsmsmsmsmsb)", &verification);
+  g_variant_iter_next (&iter, "b", &priv->is_flathub);
+
+  g_variant_iter_next (&iter, "@" BZ_ENTRY_PACKED_DETAILS_TYPE, &priv->details);
+
+  priv->addons           = unpack_string_list (addons);
+  priv->icon_paintable   = unpack_paintable (icon);
+  priv->remote_repo_icon = unpack_paintable (repo_icon);
+  if (mini_icon != NULL)
+    priv->mini_icon = make_mini_icon (mini_icon);
+
+  child = g_variant_get_maybe (rating);
+  if (child != NULL)
+    {
+      const char   *kind   = NULL;
+      GVariantIter *values = NULL;
+      const char   *id     = NULL;
+      const char   *value  = NULL;
+
+      priv->content_rating = as_content_rating_new ();
+
+      g_variant_get (child, "(&sa(ss))", &kind, &values);
+      as_content_rating_set_kind (priv->content_rating, kind);
+      while (g_variant_iter_next (values, "(&s&s)", &id, &value))
+        {
+          AsContentRatingValue rating_value = AS_CONTENT_RATING_VALUE_UNKNOWN;
+
+          rating_value = as_content_rating_value_from_string (value);
+          if (rating_value != AS_CONTENT_RATING_VALUE_UNKNOWN)
+            as_content_rating_set_value (priv->content_rating, id, rating_value);
+        }
+      g_variant_iter_free (values);
+    }
+  g_clear_pointer (&child, g_variant_unref);
+
+  child = g_variant_get_maybe (verification);
+  if (child != NULL)
+    {
+      gboolean    verified              = FALSE;
+      const char *method                = NULL;
+      const char *website               = NULL;
+      const char *login_name            = NULL;
+      const char *login_provider        = NULL;
+      const char *timestamp             = NULL;
+      gboolean    login_is_organization = FALSE;
+
+      g_variant_get (child, "(bm&sm&sm&sm&sm&sb)",
+                     &verified, &method, &website, &login_name,
+                     &login_provider, &timestamp, &login_is_organization);
+
+      priv->verification_status = bz_verification_status_new ();
+      g_object_set (priv->verification_status,
+                    "verified", verified,
+                    "method", method,
+                    "website", website,
+                    "login-name", login_name,
+                    "login-provider", login_provider,
+                    "timestamp", timestamp,
+                    "login-is-organization", login_is_organization,
+                    NULL);
+    }
+  g_clear_pointer (&child, g_variant_unref);
+
+  return TRUE;
+}
+
+static void
+unpack_details (BzEntry  *self,
+                GVariant *details)
+{
+  BzEntryPrivate *priv             = bz_entry_get_instance_private (self);
+  g_autoptr (GVariant) screenshots = NULL;
+  g_autoptr (GVariant) captions    = NULL;
+  g_autoptr (GVariant) thumbnail   = NULL;
+  g_autoptr (GVariant) share_urls  = NULL;
+  g_autoptr (GVariant) versions    = NULL;
+  g_autoptr (GVariant) keywords    = NULL;
+  g_autoptr (GVariant) permissions = NULL;
+  const char *long_description     = NULL;
+  gsize n_children                 = 0;
+  g_autoptr (GError) local_error   = NULL;
+
+  g_variant_get (
+      details,
+      "(m&s@a(sms)@as@m(sms)@a(ss)@a(mstmsms)@as@a{sv})",
+      &long_description,
+      &screenshots,
+      &captions,
+      &thumbnail,
+      &share_urls,
+      &versions,
+      &keywords,
+      &permissions);
+
+  priv->long_description    = borrow_string (priv, long_description);
+  priv->screenshot_captions = unpack_string_list (captions);
+  priv->thumbnail_paintable = unpack_paintable (thumbnail);
+  priv->keywords            = unpack_string_list (keywords);
+
+  n_children = g_variant_n_children (screenshots);
+  if (n_children > 0)
+    {
+      g_autoptr (GListStore) store = NULL;
+
+      store = g_list_store_new (BZ_TYPE_ASYNC_TEXTURE);
+      for (gsize i = 0; i < n_children; i++)
+        {
+          g_autoptr (GVariant) child       = NULL;
+          g_autoptr (GdkPaintable) texture = NULL;
+
+          child   = g_variant_get_child_value (screenshots, i);
+          texture = make_async_texture (child);
+          g_list_store_append (store, texture);
+        }
+
+      priv->screenshot_paintables = G_LIST_MODEL (g_steal_pointer (&store));
+    }
+
+  n_children = g_variant_n_children (share_urls);
+  if (n_children > 0)
+    {
+      g_autoptr (GListStore) store = NULL;
+
+      store = g_list_store_new (BZ_TYPE_URL);
+      for (gsize i = 0; i < n_children; i++)
+        {
+          const char *id        = NULL;
+          const char *url_str   = NULL;
+          g_autoptr (BzUrl) url = NULL;
+
+          g_variant_get_child (share_urls, i, "(&s&s)", &id, &url_str);
+          url = bz_url_new ();
+          bz_url_set_id (url, id);
+          bz_url_set_url (url, url_str);
+          g_list_store_append (store, url);
+        }
+
+      priv->share_urls = G_LIST_MODEL (g_steal_pointer (&store));
+    }
+
+  n_children = g_variant_n_children (versions);
+  if (n_children > 0)
+    {
+      g_autoptr (GListStore) store = NULL;
+
+      store = g_list_store_new (BZ_TYPE_RELEASE);
+      for (gsize i = 0; i < n_children; i++)
+        {
+          const char *description       = NULL;
+          guint64     timestamp         = 0;
+          const char *url               = NULL;
+          const char *version           = NULL;
+          g_autoptr (BzRelease) release = NULL;
+
+          g_variant_get_child (versions, i, "(m&stm&sm&s)", &description, &timestamp, &url, &version);
+
+          release = bz_release_new ();
+          bz_release_set_timestamp (release, timestamp);
+          bz_release_set_url (release, url);
+          bz_release_set_version (release, version);
+          bz_release_set_description (release, description);
+          g_list_store_append (store, release);
+        }
+
+      priv->version_history = G_LIST_MODEL (g_steal_pointer (&store));
+    }
+
+  priv->permissions = bz_app_permissions_new ();
+  if (!bz_app_permissions_deserialize (priv->permissions, permissions, &local_error))
+    {
+      g_warning ("Failed to deserialize app permissions");
+    }
+}
+
+/* Must be called before touching any member stored in the details tuple.
+ * Entries are read from worker threads as well, hence the lock */
+static void
+ensure_details (BzEntry *self)
+{
+  BzEntryPrivate *priv            = bz_entry_get_instance_private (self);
+  g_autoptr (GMutexLocker) locker = NULL;
+  GVariant *details               = NULL;
+
+  if (g_atomic_pointer_get (&priv->details) == NULL)
+    return;
+
+  locker  = g_mutex_locker_new (&details_mutex);
+  details = priv->details;
+  if (details == NULL)
+    return;
+
+  unpack_details (self, details);
+  g_atomic_pointer_set (&priv->details, NULL);
+  g_variant_unref (details);
+}
+
+static GVariant *
+dup_details (BzEntry *self)
+{
+  BzEntryPrivate *priv            = bz_entry_get_instance_private (self);
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  if (g_atomic_pointer_get (&priv->details) == NULL)
+    return NULL;
+
+  locker = g_mutex_locker_new (&details_mutex);
+  return priv->details != NULL ? g_variant_ref (priv->details) : NULL;
+}
+
+/* Lets cheap checks avoid decoding the details tuple */
+static gboolean
+details_has_items (BzEntry *self,
+                   guint    index)
+{
+  g_autoptr (GVariant) details = NULL;
+  g_autoptr (GVariant) child   = NULL;
+
+  details = dup_details (self);
+  if (details == NULL)
+    return FALSE;
+
+  child = g_variant_get_child_value (details, index);
+  return g_variant_n_children (child) > 0;
+}
+
 void
 bz_entry_hold (BzEntry *self)
 {
@@ -1786,7 +2410,7 @@ bz_entry_set_installed_version (BzEntry    *self,
   g_return_if_fail (BZ_IS_ENTRY (self));
   priv = bz_entry_get_instance_private (self);
 
-  g_clear_pointer (&priv->installed_version, g_free);
+  release_string (priv, &priv->installed_version);
   priv->installed_version = g_strdup (version);
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLED_VERSION]);
 }
@@ -1836,6 +2460,9 @@ bz_entry_append_addon (BzEntry    *self,
   g_return_if_fail (id != NULL);
   priv = bz_entry_get_instance_private (self);
 
+  if (find_addon (priv, id, NULL))
+    return;
+
   string = gtk_string_object_new (id);
   if (priv->addons == NULL)
     {
@@ -1847,6 +2474,21 @@ bz_entry_append_addon (BzEntry    *self,
     g_list_store_append (G_LIST_STORE (priv->addons), string);
 }
 
+void
+bz_entry_remove_addon (BzEntry    *self,
+                       const char *id)
+{
+  BzEntryPrivate *priv     = NULL;
+  guint           position = 0;
+
+  g_return_if_fail (BZ_IS_ENTRY (self));
+  g_return_if_fail (id != NULL);
+  priv = bz_entry_get_instance_private (self);
+
+  if (find_addon (priv, id, &position))
+    g_list_store_remove (G_LIST_STORE (priv->addons), position);
+}
+
 GListModel *
 bz_entry_get_addons (BzEntry *self)
 {
@@ -1958,6 +2600,7 @@ bz_entry_get_long_description (BzEntry *self)
   g_return_val_if_fail (BZ_IS_ENTRY (self), NULL);
   priv = bz_entry_get_instance_private (self);
 
+  ensure_details (self);
   return priv->long_description;
 }
 
@@ -2013,6 +2656,7 @@ bz_entry_get_screenshot_paintables (BzEntry *self)
   g_return_val_if_fail (BZ_IS_ENTRY (self), NULL);
   priv = bz_entry_get_instance_private (self);
 
+  ensure_details (self);
   return priv->screenshot_paintables;
 }
 
@@ -2046,6 +2690,7 @@ bz_entry_get_share_urls (BzEntry *self)
   g_return_val_if_fail (BZ_IS_ENTRY (self), NULL);
   priv = bz_entry_get_instance_private (self);
 
+  ensure_details (self);
   return priv->share_urls;
 }
 
@@ -2295,7 +2940,7 @@ bz_entry_calc_usefulness (BzEntry *self)
 
   score += priv->title != NULL ? 5 : 0;
   score += priv->description != NULL ? 1 : 0;
-  score += priv->long_description != NULL ? 5 : 0;
+  score += details_has_items (self, 0) || priv->long_description != NULL ? 5 : 0;
   score += priv->url != NULL ? 1 : 0;
   score += priv->size > 0 ? 1 : 0;
   score += priv->icon_paintable != NULL ? 15 : 0;
@@ -2305,8 +2950,8 @@ bz_entry_calc_usefulness (BzEntry *self)
   score += priv->project_group != NULL ? 1 : 0;
   score += priv->developer != NULL ? 1 : 0;
   score += priv->developer_id != NULL ? 1 : 0;
-  score += priv->screenshot_paintables != NULL ? 5 : 0;
-  score += priv->share_urls != NULL ? 5 : 0;
+  score += details_has_items (self, 1) || priv->screenshot_paintables != NULL ? 5 : 0;
+  score += details_has_items (self, 4) || priv->share_urls != NULL ? 5 : 0;
 
   score -= priv->eol != NULL ? 500 : 0;
 
@@ -2334,6 +2979,25 @@ bz_entry_deserialize (BzEntry  *self,
   return bz_entry_real_deserialize (BZ_SERIALIZABLE (self), import, error);
 }
 
+GVariant *
+bz_entry_pack (BzEntry *self)
+{
+  g_return_val_if_fail (BZ_IS_ENTRY (self), NULL);
+
+  return bz_entry_real_pack (self);
+}
+
+gboolean
+bz_entry_unpack (BzEntry  *self,
+                 GVariant *packed,
+                 GError  **error)
+{
+  g_return_val_if_fail (BZ_IS_ENTRY (self), FALSE);
+  g_return_val_if_fail (packed != NULL, FALSE);
+
+  return bz_entry_real_unpack (self, packed, error);
+}
+
 GIcon *
 bz_load_mini_icon_sync (const char *unique_id_checksum,
                         const char *path)
@@ -2676,6 +3340,22 @@ maybe_save_paintable (BzEntryPrivate  *priv,
                       const char      *key,
                       GdkPaintable    *paintable,
                       GVariantBuilder *builder)
+{
+  GVariant *saved = NULL;
+
+  saved = save_paintable (priv, paintable);
+  if (saved == NULL)
+    return FALSE;
+
+  g_variant_builder_add (builder, "{sv}", key, saved);
+  return TRUE;
+}
+
+/* Makes sure the texture is cached on disk and returns a floating "(sms)"
+ * describing where to find it, or NULL if it isn't an async texture */
+static GVariant *
+save_paintable (BzEntryPrivate *priv,
+                GdkPaintable   *paintable)
 {
   g_autoptr (GError) local_error = NULL;
   const char *source_uri         = NULL;
@@ -2686,7 +3366,7 @@ maybe_save_paintable (BzEntryPrivate  *priv,
 
   if (!BZ_IS_ASYNC_TEXTURE (paintable))
     {
-      return FALSE;
+      return NULL;
     }
 
   source_uri      = bz_async_texture_get_source_uri (BZ_ASYNC_TEXTURE (paintable));
@@ -2759,8 +3439,7 @@ maybe_save_paintable (BzEntryPrivate  *priv,
     }
 
 done:
-  g_variant_builder_add (builder, "{sv}", key, g_variant_new ("(sms)", source_uri, cache_into_path));
-  return TRUE;
+  return g_variant_new ("(sms)", source_uri, cache_into_path);
 }
 
 static GdkPaintable *
@@ -2775,12 +3454,41 @@ make_async_texture (GVariant *parse)
   g_variant_get (parse, "(sms)", &source, &cache_into);
   source_file = g_file_new_for_uri (source);
   if (cache_into != NULL)
-    cache_into_file = g_file_new_for_path (cache_into);
+    {
+      g_autofree char *rebased = NULL;
+
+      rebased         = bz_rebase_cache_path (cache_into);
+      cache_into_file = g_file_new_for_path (rebased);
+    }
 
   texture = bz_async_texture_new_lazy (source_file, cache_into_file);
   return GDK_PAINTABLE (g_steal_pointer (&texture));
 }
 
+static GIcon *
+make_mini_icon (GVariant *serialized)
+{
+  g_autoptr (GIcon) icon         = NULL;
+  g_autofree char *path          = NULL;
+  g_autofree char *rebased       = NULL;
+  g_autoptr (GFile) rebased_file = NULL;
+
+  icon = g_icon_deserialize (serialized);
+  if (!G_IS_FILE_ICON (icon))
+    return g_steal_pointer (&icon);
+
+  path = g_file_get_path (g_file_icon_get_file (G_FILE_ICON (icon)));
+  if (path == NULL)
+    return g_steal_pointer (&icon);
+
+  rebased = bz_rebase_cache_path (path);
+  if (g_strcmp0 (rebased, path) == 0)
+    return g_steal_pointer (&icon);
+
+  rebased_file = g_file_new_for_path (rebased);
+  return g_file_icon_new (rebased_file);
+}
+
 static void
 clear_entry (BzEntry *self)
 {
@@ -2788,39 +3496,117 @@ clear_entry (BzEntry *self)
 
   g_clear_pointer (&priv->flathub_prop_queries, g_hash_table_unref);
   g_clear_object (&priv->addons);
-  g_clear_pointer (&priv->id, g_free);
-  g_clear_pointer (&priv->unique_id, g_free);
-  g_clear_pointer (&priv->unique_id_checksum, g_free);
-  g_clear_pointer (&priv->installed_version, g_free);
-  g_clear_pointer (&priv->title, g_free);
-  g_clear_pointer (&priv->eol, g_free);
-  g_clear_pointer (&priv->description, g_free);
-  g_clear_pointer (&priv->long_description, g_free);
-  g_clear_pointer (&priv->remote_repo_name, g_free);
-  g_clear_pointer (&priv->url, g_free);
+  release_string (priv, &priv->id);
+  release_string (priv, &priv->unique_id);
+  release_string (priv, &priv->unique_id_checksum);
+  release_string (priv, &priv->installed_version);
+  release_string (priv, &priv->title);
+  release_string (priv, &priv->eol);
+  release_string (priv, &priv->description);
+  release_string (priv, &priv->long_description);
+  release_string (priv, &priv->remote_repo_name);
+  release_string (priv, &priv->url);
   g_clear_object (&priv->icon_paintable);
   g_clear_object (&priv->mini_icon);
   g_clear_object (&priv->remote_repo_icon);
-  g_clear_pointer (&priv->search_tokens, g_free);
-  g_clear_pointer (&priv->metadata_license, g_free);
-  g_clear_pointer (&priv->project_license, g_free);
-  g_clear_pointer (&priv->project_group, g_free);
-  g_clear_pointer (&priv->developer, g_free);
-  g_clear_pointer (&priv->developer_id, g_free);
+  release_string (priv, &priv->search_tokens);
+  release_string (priv, &priv->metadata_license);
+  release_string (priv, &priv->project_license);
+  release_string (priv, &priv->project_group);
+  release_string (priv, &priv->developer);
+  release_string (priv, &priv->developer_id);
   g_clear_object (&priv->developer_apps);
   g_clear_object (&priv->screenshot_paintables);
   g_clear_object (&priv->screenshot_captions);
   g_clear_object (&priv->thumbnail_paintable);
   g_clear_object (&priv->share_urls);
-  g_clear_pointer (&priv->donation_url, g_free);
-  g_clear_pointer (&priv->ratings_summary, g_free);
+  release_string (priv, &priv->donation_url);
+  release_string (priv, &priv->ratings_summary);
   g_clear_object (&priv->version_history);
-  g_clear_pointer (&priv->light_accent_color, g_free);
-  g_clear_pointer (&priv->dark_accent_color, g_free);
+  release_string (priv, &priv->light_accent_color);
+  release_string (priv, &priv->dark_accent_color);
   g_clear_object (&priv->verification_status);
   g_clear_object (&priv->download_stats);
   g_clear_object (&priv->download_stats_per_country);
   g_clear_object (&priv->content_rating);
   g_clear_object (&priv->keywords);
   g_clear_object (&priv->permissions);
+  g_clear_pointer (&priv->details, g_variant_unref);
+  g_clear_pointer (&priv->backing, g_variant_unref);
+}
+
+static gboolean
+is_borrowed (BzEntryPrivate *priv,
+             const char     *string)
+{
+  const char *data = NULL;
+  gsize       size = 0;
+
+  if (priv->backing == NULL)
+    return FALSE;
+
+  data = g_variant_get_data (priv->backing);
+  size = g_variant_get_size (priv->backing);
+  return string >= data && string < data + size;
+}
+
+/* Strings unpacked from the cache point straight into the packed
+ * variant, which `priv->backing` keeps alive along with its bytes.
+ * GVariant hands out static strings for malformed data, which are
+ * copied like anything else outside of the backing range */
+static char *
+borrow_string (BzEntryPrivate *priv,
+               const char     *string)
+{
+  if (string == NULL)
+    return NULL;
+  if (is_borrowed (priv, string))
+    return (char *) string;
+  return g_strdup (string);
+}
+
+static char *
+next_string (BzEntryPrivate *priv,
+             GVariantIter   *iter)
+{
+  const char *string = NULL;
+
+  g_variant_iter_next (iter, "m&s", &string);
+  return borrow_string (priv, string);
+}
+
+/* Must be used in place of `g_free` for any string member */
+static void
+release_string (BzEntryPrivate *priv,
+                char          **string)
+{
+  if (*string != NULL && !is_borrowed (priv, *string))
+    g_free (*string);
+  *string = NULL;
+}
+
+static gboolean
+find_addon (BzEntryPrivate *priv,
+            const char     *id,
+            guint          *position)
+{
+  guint n_items = 0;
+
+  if (priv->addons == NULL)
+    return FALSE;
+
+  n_items = g_list_model_get_n_items (priv->addons);
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (GtkStringObject) string = NULL;
+
+      string = g_list_model_get_item (priv->addons, i);
+      if (g_strcmp0 (gtk_string_object_get_string (string), id) == 0)
+        {
+          if (position != NULL)
+            *position = i;
+          return TRUE;
+        }
+    }
+  return FALSE;
 }
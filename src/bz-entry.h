@@ -111,6 +111,10 @@ void
 bz_entry_append_addon (BzEntry    *self,
                        const char *id);
 
+void
+bz_entry_remove_addon (BzEntry    *self,
+                       const char *id);
+
 GListModel *
 bz_entry_get_addons (BzEntry *self);
 
@@ -238,6 +242,34 @@ bz_entry_deserialize (BzEntry  *self,
                       GVariant *import,
                       GError  **error);
 
+/* Type of the tuple returned by `bz_entry_pack`, for subclasses which
+ * embed it in their own packed form */
+#define BZ_ENTRY_PACKED_TYPE                             \
+  "("                                                    \
+  "bmsubbas"             /* state and addons */          \
+  "msmsmsmsmsmsmsms"     /* identity and text */         \
+  "tt"                   /* sizes */                     \
+  "m(sms)mvm(sms)"       /* icons */                     \
+  "msmsmsbmsmsms"        /* licensing, devs */           \
+  "msmsmsbuuuii"         /* presentation */              \
+  "m(sa(ss))u"           /* rating, categories */        \
+  "m(bmsmsmsmsmsb)b"     /* verification, flathub */     \
+  BZ_ENTRY_PACKED_DETAILS_TYPE                           \
+  ")"
+
+/* Last member of the packed tuple, holding fields which are
+ * only decoded once something asks for them */
+#define BZ_ENTRY_PACKED_DETAILS_TYPE \
+  "(msa(sms)asm(sms)a(ss)a(mstmsms)asa{sv})"
+
+GVariant *
+bz_entry_pack (BzEntry *self);
+
+gboolean
+bz_entry_unpack (BzEntry  *self,
+                 GVariant *packed,
+                 GError  **error);
+
 GIcon *
 bz_load_mini_icon_sync (const char *unique_id_checksum,
                         const char *path);
@@ -153,3 +153,48 @@ bz_get_desktop_search_provider_icon_size (void)
 
   return (guint) icon_size;
 }
+
+guint64
+bz_get_cache_asset_budget (void)
+{
+  static guint64 budget = 0;
+
+  if (g_once_init_enter (&budget))
+    {
+      const char *envvar = NULL;
+      guint64     value  = 0;
+
+      /* 512 MiB of icons and screenshots, in bytes */
+      value = 536870912;
+
+      envvar = g_getenv ("BAZAAR_CACHE_ASSET_BUDGET");
+      if (envvar != NULL)
+        {
+          g_autoptr (GError) local_error = NULL;
+          g_autoptr (GVariant) variant   = NULL;
+
+          variant = g_variant_parse (
+              G_VARIANT_TYPE_UINT64, envvar,
+              NULL, NULL, &local_error);
+          if (variant != NULL)
+            {
+              guint64 parse_result = 0;
+
+              /* zero lifts the limit entirely */
+              parse_result = g_variant_get_uint64 (variant);
+              if (parse_result == G_MAXUINT64)
+                g_warning ("BAZAAR_CACHE_ASSET_BUDGET must be less than %" G_GUINT64_FORMAT,
+                           G_MAXUINT64);
+              else
+                value = parse_result;
+            }
+          else
+            g_warning ("BAZAAR_CACHE_ASSET_BUDGET is invalid: %s", local_error->message);
+        }
+
+      /* offset by one since zero can't be stored */
+      g_once_init_leave (&budget, value + 1);
+    }
+
+  return budget - 1;
+}
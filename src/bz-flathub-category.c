@@ -480,11 +480,99 @@ bz_flathub_category_real_deserialize (BzSerializable *serializable,
   return TRUE;
 }
 
+static GVariant *
+pack_string_list (GListModel *model)
+{
+  g_autoptr (GVariantBuilder) builder = NULL;
+  guint n_items                       = 0;
+
+  builder = g_variant_builder_new (G_VARIANT_TYPE_STRING_ARRAY);
+  if (model != NULL)
+    n_items = g_list_model_get_n_items (model);
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (GtkStringObject) string = NULL;
+
+      string = g_list_model_get_item (model, i);
+      g_variant_builder_add (builder, "s", gtk_string_object_get_string (string));
+    }
+
+  return g_variant_builder_end (builder);
+}
+
+static GListModel *
+unpack_string_list (GVariant *strings)
+{
+  g_autoptr (GtkStringList) list = NULL;
+  g_autofree const char **strv   = NULL;
+
+  if (g_variant_n_children (strings) == 0)
+    return NULL;
+
+  strv = g_variant_get_strv (strings, NULL);
+  list = gtk_string_list_new (strv);
+  return G_LIST_MODEL (g_steal_pointer (&list));
+}
+
+static GVariant *
+bz_flathub_category_real_pack (BzSerializable *serializable)
+{
+  BzFlathubCategory *self = BZ_FLATHUB_CATEGORY (serializable);
+
+  return g_variant_new (
+      "(ms@as@asib)",
+      self->name,
+      pack_string_list (self->applications),
+      pack_string_list (self->quality_applications),
+      self->total_entries,
+      self->is_spotlight);
+}
+
+static gboolean
+bz_flathub_category_real_unpack (BzSerializable *serializable,
+                                 GVariant       *packed,
+                                 GError        **error)
+{
+  BzFlathubCategory *self           = BZ_FLATHUB_CATEGORY (serializable);
+  const char *name                  = NULL;
+  g_autoptr (GVariant) applications = NULL;
+  g_autoptr (GVariant) quality      = NULL;
+
+  if (!g_variant_is_of_type (packed, G_VARIANT_TYPE (BZ_FLATHUB_CATEGORY_PACKED_TYPE)))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Packed category has unexpected type '%s'",
+                   g_variant_get_type_string (packed));
+      return FALSE;
+    }
+
+  clear (self);
+
+  g_variant_get (
+      packed,
+      "(m&s@as@asib)",
+      &name,
+      &applications,
+      &quality,
+      &self->total_entries,
+      &self->is_spotlight);
+
+  if (name != NULL)
+    bz_flathub_category_set_name (self, name);
+  self->applications         = unpack_string_list (applications);
+  self->quality_applications = unpack_string_list (quality);
+
+  return TRUE;
+}
+
 static void
 serializable_iface_init (BzSerializableInterface *iface)
 {
-  iface->serialize   = bz_flathub_category_real_serialize;
-  iface->deserialize = bz_flathub_category_real_deserialize;
+  iface->serialize      = bz_flathub_category_real_serialize;
+  iface->deserialize    = bz_flathub_category_real_deserialize;
+  iface->packed_version = 1;
+  iface->pack           = bz_flathub_category_real_pack;
+  iface->unpack         = bz_flathub_category_real_unpack;
 }
 
 BzFlathubCategory *
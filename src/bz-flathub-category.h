@@ -29,6 +29,9 @@ G_BEGIN_DECLS
 #define BZ_TYPE_FLATHUB_CATEGORY (bz_flathub_category_get_type ())
 G_DECLARE_FINAL_TYPE (BzFlathubCategory, bz_flathub_category, BZ, FLATHUB_CATEGORY, GObject)
 
+/* Type of the tuple produced by `bz_serializable_pack` */
+#define BZ_FLATHUB_CATEGORY_PACKED_TYPE "(msasasib)"
+
 BzFlathubCategory *
 bz_flathub_category_new (void);
 
@@ -24,6 +24,7 @@
 #define QUALITY_MODERATION_PAGE_SIZE 300
 #define KEYWORD_SEARCH_PAGE_SIZE     48
 #define ADWAITA_URL                  "https://arewelibadwaitayet.com"
+#define PACKED_TYPE                  "(msmsasa" BZ_FLATHUB_CATEGORY_PACKED_TYPE ")"
 
 #include <json-glib/json-glib.h>
 #include <libdex.h>
@@ -393,11 +394,126 @@ bz_flathub_state_real_deserialize (BzSerializable *serializable,
   return TRUE;
 }
 
+static GVariant *
+bz_flathub_state_real_pack (BzSerializable *serializable)
+{
+  BzFlathubState *self                           = BZ_FLATHUB_STATE (serializable);
+  gboolean initializing                          = FALSE;
+  g_autoptr (GVariantBuilder) apps_builder       = NULL;
+  g_autoptr (GVariantBuilder) categories_builder = NULL;
+  guint n_items                                  = 0;
+
+  /* Mirrors the vardict format, which stores nothing in this case */
+  initializing = self->initializing != NULL &&
+                 dex_future_is_pending (self->initializing);
+
+  apps_builder = g_variant_builder_new (G_VARIANT_TYPE_STRING_ARRAY);
+  if (!initializing && self->apps_of_the_week != NULL)
+    n_items = g_list_model_get_n_items (G_LIST_MODEL (self->apps_of_the_week));
+  for (guint i = 0; i < n_items; i++)
+    g_variant_builder_add (apps_builder, "s", gtk_string_list_get_string (self->apps_of_the_week, i));
+
+  categories_builder = g_variant_builder_new (G_VARIANT_TYPE ("a" BZ_FLATHUB_CATEGORY_PACKED_TYPE));
+  n_items            = 0;
+  if (!initializing && self->categories != NULL)
+    n_items = g_list_model_get_n_items (G_LIST_MODEL (self->categories));
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (BzFlathubCategory) category = NULL;
+
+      category = g_list_model_get_item (G_LIST_MODEL (self->categories), i);
+      g_variant_builder_add_value (categories_builder, bz_serializable_pack (BZ_SERIALIZABLE (category)));
+    }
+
+  return g_variant_new (
+      "(msms@as@a" BZ_FLATHUB_CATEGORY_PACKED_TYPE ")",
+      initializing ? NULL : self->for_day,
+      initializing ? NULL : self->app_of_the_day,
+      g_variant_builder_end (apps_builder),
+      g_variant_builder_end (categories_builder));
+}
+
+static gboolean
+bz_flathub_state_real_unpack (BzSerializable *serializable,
+                              GVariant       *packed,
+                              GError        **error)
+{
+  BzFlathubState *self            = BZ_FLATHUB_STATE (serializable);
+  g_autoptr (GVariant) apps       = NULL;
+  g_autoptr (GVariant) categories = NULL;
+  gsize n_categories              = 0;
+
+  if (self->initializing != NULL &&
+      !dex_future_is_pending (self->initializing))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_BUSY,
+                   "Cannot perform serialization operations while initializing!");
+      return FALSE;
+    }
+  if (!g_variant_is_of_type (packed, G_VARIANT_TYPE (PACKED_TYPE)))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Packed flathub state has unexpected type '%s'",
+                   g_variant_get_type_string (packed));
+      return FALSE;
+    }
+
+  clear (self);
+
+  g_variant_get (
+      packed,
+      "(msms@as@a" BZ_FLATHUB_CATEGORY_PACKED_TYPE ")",
+      &self->for_day,
+      &self->app_of_the_day,
+      &apps,
+      &categories);
+
+  if (g_variant_n_children (apps) > 0)
+    {
+      g_autofree const char **strv = NULL;
+
+      strv                   = g_variant_get_strv (apps, NULL);
+      self->apps_of_the_week = gtk_string_list_new (strv);
+    }
+
+  n_categories = g_variant_n_children (categories);
+  if (n_categories > 0)
+    {
+      g_autoptr (GListStore) store = NULL;
+
+      store = g_list_store_new (BZ_TYPE_FLATHUB_CATEGORY);
+      for (gsize i = 0; i < n_categories; i++)
+        {
+          g_autoptr (GVariant) category_packed   = NULL;
+          g_autoptr (BzFlathubCategory) category = NULL;
+          gboolean result                        = FALSE;
+
+          category_packed = g_variant_get_child_value (categories, i);
+          category        = bz_flathub_category_new ();
+          result          = bz_serializable_unpack (
+              BZ_SERIALIZABLE (category), category_packed, error);
+          if (!result)
+            return FALSE;
+
+          g_object_bind_property (self, "map-factory", category, "map-factory", G_BINDING_SYNC_CREATE);
+          g_list_store_append (store, category);
+        }
+
+      self->categories = g_steal_pointer (&store);
+    }
+
+  notify_all (self);
+  return TRUE;
+}
+
 static void
 serializable_iface_init (BzSerializableInterface *iface)
 {
-  iface->serialize   = bz_flathub_state_real_serialize;
-  iface->deserialize = bz_flathub_state_real_deserialize;
+  iface->serialize      = bz_flathub_state_real_serialize;
+  iface->deserialize    = bz_flathub_state_real_deserialize;
+  iface->packed_version = 1;
+  iface->pack           = bz_flathub_state_real_pack;
+  iface->unpack         = bz_flathub_state_real_unpack;
 }
 
 BzFlathubState *
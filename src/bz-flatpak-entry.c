@@ -38,6 +38,10 @@
 
 #define VERSION_SUFFIX_REGEX "\\s+[0-9][0-9.]*\\s*$"
 
+#define PACKED_VERSION 2
+#define PACKED_FIELDS  "bbbmsmsmsmsmsmsmsmsms"
+#define PACKED_TYPE    "(" PACKED_FIELDS BZ_ENTRY_PACKED_TYPE ")"
+
 struct _BzFlatpakEntry
 {
   BzEntry parent_instance;
@@ -357,11 +361,77 @@ bz_flatpak_entry_real_deserialize (BzSerializable *serializable,
   return bz_entry_deserialize (BZ_ENTRY (self), import, error);
 }
 
+static GVariant *
+bz_flatpak_entry_real_pack (BzSerializable *serializable)
+{
+  BzFlatpakEntry *self = BZ_FLATPAK_ENTRY (serializable);
+
+  return g_variant_new (
+      "(" PACKED_FIELDS "@" BZ_ENTRY_PACKED_TYPE ")",
+      self->user,
+      self->is_bundle,
+      self->is_installed_ref,
+      self->bundle_path,
+      self->flatpak_name,
+      self->flatpak_id,
+      self->flatpak_version,
+      self->application_name,
+      self->application_runtime,
+      self->application_command,
+      self->runtime_name,
+      self->addon_extension_of_ref,
+      bz_entry_pack (BZ_ENTRY (self)));
+}
+
+static gboolean
+bz_flatpak_entry_real_unpack (BzSerializable *serializable,
+                              GVariant       *packed,
+                              GError        **error)
+{
+  BzFlatpakEntry *self        = BZ_FLATPAK_ENTRY (serializable);
+  g_autoptr (GVariant) parent = NULL;
+
+  if (!g_variant_is_of_type (packed, G_VARIANT_TYPE (PACKED_TYPE)))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Packed flatpak entry has unexpected type '%s'",
+                   g_variant_get_type_string (packed));
+      return FALSE;
+    }
+
+  clear_entry (self);
+
+  g_variant_get (
+      packed,
+      "(" PACKED_FIELDS "@" BZ_ENTRY_PACKED_TYPE ")",
+      &self->user,
+      &self->is_bundle,
+      &self->is_installed_ref,
+      &self->bundle_path,
+      &self->flatpak_name,
+      &self->flatpak_id,
+      &self->flatpak_version,
+      &self->application_name,
+      &self->application_runtime,
+      &self->application_command,
+      &self->runtime_name,
+      &self->addon_extension_of_ref,
+      &parent);
+
+  if (self->is_installed_ref)
+    apply_icon_theme (self);
+
+  return bz_entry_unpack (BZ_ENTRY (self), parent, error);
+}
+
 static void
 serializable_iface_init (BzSerializableInterface *iface)
 {
-  iface->serialize   = bz_flatpak_entry_real_serialize;
-  iface->deserialize = bz_flatpak_entry_real_deserialize;
+  iface->serialize      = bz_flatpak_entry_real_serialize;
+  iface->deserialize    = bz_flatpak_entry_real_deserialize;
+  iface->packed_version = PACKED_VERSION;
+  iface->pack           = bz_flatpak_entry_real_pack;
+  iface->unpack         = bz_flatpak_entry_real_unpack;
 }
 
 BzResult *
@@ -21,6 +21,18 @@
 #define G_LOG_DOMAIN  "BAZAAR::FLATPAK"
 #define BAZAAR_MODULE "flatpak"
 
+/* Compiled appstream silos. These must outlive the module dir, which is
+ * discarded on every startup */
+#define SILO_CACHE_SUBMODULE "flatpak-silos"
+
+/* Outlives the module dir, which is discarded on every startup */
+#define FINGERPRINTS_SUBMODULE "flatpak-fingerprints"
+/* bazaar version, locale, appstream key, then
+ * unique id -> (ref digest, fingerprint) */
+#define FINGERPRINTS_TYPE "(sssa{s(ss)})"
+
+#include <errno.h>
+#include <glib/gstdio.h>
 #include <malloc.h>
 #include <xmlb.h>
 
@@ -68,6 +80,12 @@ struct _BzFlatpakInstance
   GMutex transactions_mutex;
   /* BzEntry* -> GPtrArray* -> GCancellable* */
   GHashTable *ongoing_cancellables;
+
+  GMutex fingerprints_mutex;
+  /* char* path -> GBytes* */
+  GHashTable *pending_fingerprints;
+  /* char* unique id checksum set */
+  GHashTable *cached_checksums;
 };
 
 static void
@@ -195,6 +213,54 @@ retrieve_refs_for_noenumerable_remote (BzFlatpakInstance   *self,
                                        FlatpakInstallation *installation,
                                        FlatpakRemote       *remote);
 
+/* Refs per entry construction job when syncing enumerable remotes */
+#define ENTRY_BATCH_SIZE 256
+
+BZ_DEFINE_DATA (
+    build_entries,
+    BuildEntries,
+    {
+      GCancellable  *cancellable;
+      FlatpakRemote *remote;
+      gboolean       user;
+      char          *appstream_dir;
+      AsMetadata    *metadata;
+      GHashTable    *previous;
+      GHashTable    *cached;
+      GPtrArray     *refs;
+      GPtrArray     *components;
+      GArray        *indices;
+      GPtrArray     *unique_ids;
+      GPtrArray     *ref_digests;
+      GPtrArray     *fingerprints;
+      GPtrArray     *entries;
+    },
+    BZ_RELEASE_DATA (cancellable, g_object_unref);
+    BZ_RELEASE_DATA (remote, g_object_unref);
+    BZ_RELEASE_DATA (appstream_dir, g_free);
+    BZ_RELEASE_DATA (metadata, g_object_unref);
+    BZ_RELEASE_DATA (previous, g_hash_table_unref);
+    BZ_RELEASE_DATA (cached, g_hash_table_unref);
+    BZ_RELEASE_DATA (refs, g_ptr_array_unref);
+    BZ_RELEASE_DATA (components, g_ptr_array_unref);
+    BZ_RELEASE_DATA (indices, g_array_unref);
+    BZ_RELEASE_DATA (unique_ids, g_ptr_array_unref);
+    BZ_RELEASE_DATA (ref_digests, g_ptr_array_unref);
+    BZ_RELEASE_DATA (fingerprints, g_ptr_array_unref);
+    BZ_RELEASE_DATA (entries, g_ptr_array_unref));
+static DexFuture *
+build_entries_fiber (BuildEntriesData *data);
+
+BZ_DEFINE_DATA (
+    commit_fingerprints,
+    CommitFingerprints,
+    {
+      GHashTable *pending;
+    },
+    BZ_RELEASE_DATA (pending, g_hash_table_unref));
+static DexFuture *
+commit_fingerprints_fiber (CommitFingerprintsData *data);
+
 BZ_DEFINE_DATA (
     transaction,
     Transaction,
@@ -359,13 +425,58 @@ decompress_appstream_gz (GBytes       *appstream_gz,
 
 static XbSilo *
 build_silo (XbBuilderSource *source,
+            GFile           *cache,
+            gboolean        *compiled,
             GCancellable    *cancellable,
             GError         **error);
 
+static GFile *
+dup_silo_cache_file (FlatpakInstallation *installation,
+                     const char          *remote_name);
+
 static AsComponent *
 extract_first_component_for_silo (XbSilo  *silo,
                                   GError **error);
 
+static char *
+dup_fingerprints_path (gboolean    user,
+                       const char *remote_name);
+
+static char *
+dup_fingerprints_locale (void);
+
+static char *
+dup_appstream_key (const char *appstream_xml_path);
+
+static GHashTable *
+load_fingerprints (const char  *path,
+                   char       **appstream_key_out,
+                   GHashTable **ref_digests_out);
+
+static void
+stage_fingerprints (BzFlatpakInstance *self,
+                    const char        *path,
+                    const char        *appstream_key,
+                    GHashTable        *ref_digests,
+                    GHashTable        *fingerprints);
+
+static void
+send_removals (BzFlatpakInstance *self,
+               GHashTable        *previous,
+               GHashTable        *current);
+
+static gboolean
+is_cached (GHashTable *cached,
+           const char *unique_id);
+
+static char *
+dup_ref_digest (FlatpakRemoteRef *rref);
+
+static char *
+dup_ref_fingerprint (const char  *ref_digest,
+                     AsComponent *component,
+                     AsMetadata  *serializer);
+
 static void
 bz_flatpak_instance_dispose (GObject *object)
 {
@@ -389,6 +500,10 @@ bz_flatpak_instance_dispose (GObject *object)
   g_clear_pointer (&self->ongoing_cancellables, g_hash_table_unref);
   g_mutex_clear (&self->transactions_mutex);
 
+  g_clear_pointer (&self->pending_fingerprints, g_hash_table_unref);
+  g_clear_pointer (&self->cached_checksums, g_hash_table_unref);
+  g_mutex_clear (&self->fingerprints_mutex);
+
   G_OBJECT_CLASS (bz_flatpak_instance_parent_class)->dispose (object);
 }
 
@@ -415,6 +530,10 @@ bz_flatpak_instance_init (BzFlatpakInstance *self)
   self->ongoing_cancellables = g_hash_table_new_full (
       g_direct_hash, g_direct_equal, g_object_unref, (GDestroyNotify) g_ptr_array_unref);
   g_mutex_init (&self->transactions_mutex);
+
+  self->pending_fingerprints = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_bytes_unref);
+  g_mutex_init (&self->fingerprints_mutex);
 }
 
 static DexChannel *
@@ -700,6 +819,52 @@ bz_flatpak_instance_ensure_has_flathub (BzFlatpakInstance *self,
       ensure_flathub_data_ref (data), ensure_flathub_data_unref);
 }
 
+/* Persists the ref fingerprints recorded by the last retrieval of remote
+ * refs, so the next one only reports what changed in between. Only call
+ * this once the entries from that retrieval are safely cached, since
+ * unchanged refs are reported without an entry */
+DexFuture *
+bz_flatpak_instance_commit_fingerprints (BzFlatpakInstance *self)
+{
+  g_autoptr (CommitFingerprintsData) data = NULL;
+
+  dex_return_error_if_fail (BZ_IS_FLATPAK_INSTANCE (self));
+
+  data = commit_fingerprints_data_new ();
+
+  g_mutex_lock (&self->fingerprints_mutex);
+  data->pending              = g_steal_pointer (&self->pending_fingerprints);
+  self->pending_fingerprints = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_bytes_unref);
+  g_mutex_unlock (&self->fingerprints_mutex);
+
+  if (g_hash_table_size (data->pending) == 0)
+    return dex_future_new_true ();
+
+  return dex_scheduler_spawn (
+      self->scheduler,
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) commit_fingerprints_fiber,
+      commit_fingerprints_data_ref (data), commit_fingerprints_data_unref);
+}
+
+/* Tells which entries the next retrievals of remote refs can count on
+ * being cached, as a set of unique ID checksums. Unchanged refs outside of
+ * it have their entries built again rather than just being acknowledged.
+ * With NULL, the default, fingerprints alone decide */
+void
+bz_flatpak_instance_set_cached_checksums (BzFlatpakInstance *self,
+                                          GHashTable        *checksums)
+{
+  g_return_if_fail (BZ_IS_FLATPAK_INSTANCE (self));
+
+  g_mutex_lock (&self->fingerprints_mutex);
+  g_clear_pointer (&self->cached_checksums, g_hash_table_unref);
+  if (checksums != NULL)
+    self->cached_checksums = g_hash_table_ref (checksums);
+  g_mutex_unlock (&self->fingerprints_mutex);
+}
+
 static DexFuture *
 init_fiber (InitData *data)
 {
@@ -1339,7 +1504,7 @@ load_local_ref_fiber (LoadLocalRefData *data)
                 {
                   g_autoptr (XbSilo) silo = NULL;
 
-                  silo = build_silo (source, NULL, &local_error);
+                  silo = build_silo (source, NULL, NULL, NULL, &local_error);
                   if (silo == NULL)
                     {
                       g_warning ("Failed to compile xmlb silo: %s", local_error->message);
@@ -1536,11 +1701,32 @@ retrieve_refs_for_enumerable_remote (BzFlatpakInstance   *self,
   g_autofree char *appstream_xml_path   = NULL;
   g_autoptr (GFile) appstream_xml       = NULL;
   g_autoptr (XbBuilderSource) source    = NULL;
+  g_autoptr (GFile) silo_cache          = NULL;
+  gboolean compiled                     = TRUE;
   g_autoptr (XbSilo) silo               = NULL;
-  g_autoptr (XbNode) root               = NULL;
-  g_autoptr (GPtrArray) children        = NULL;
+  g_autofree char *catalog_xml          = NULL;
+  g_autoptr (AsMetadata) metadata       = NULL;
+  AsComponentBox *components            = NULL;
   g_autoptr (GHashTable) component_hash = NULL;
   g_autoptr (GPtrArray) refs            = NULL;
+  gboolean         user                 = FALSE;
+  g_autofree char *fingerprints_path    = NULL;
+  g_autofree char *appstream_key        = NULL;
+  g_autofree char *previous_key         = NULL;
+  g_autoptr (GHashTable) previous       = NULL;
+  g_autoptr (GHashTable) previous_refs  = NULL;
+  g_autoptr (GHashTable) cached         = NULL;
+  g_autoptr (GPtrArray) ref_components  = NULL;
+  g_autoptr (GHashTable) owners         = NULL;
+  g_autoptr (GPtrArray) batches         = NULL;
+  g_autoptr (GPtrArray) unique_ids      = NULL;
+  g_autoptr (GPtrArray) ref_digests     = NULL;
+  g_autoptr (GPtrArray) fingerprints    = NULL;
+  g_autoptr (GPtrArray) entries         = NULL;
+  g_autoptr (GPtrArray) jobs            = NULL;
+  g_autoptr (GHashTable) current        = NULL;
+  g_autoptr (GHashTable) next_refs      = NULL;
+  g_autoptr (GHashTable) next           = NULL;
 
   g_debug ("Remote '%s' is enumerable, listing all remote refs", remote_name);
 
@@ -1593,6 +1779,101 @@ retrieve_refs_for_enumerable_remote (BzFlatpakInstance   *self,
 
   appstream_xml = g_file_new_for_path (appstream_xml_path);
 
+  refs = flatpak_installation_list_remote_refs_sync (
+      installation, remote_name, cancellable, &local_error);
+  if (refs == NULL)
+    SEND_AND_RETURN_ERROR (
+        self, TRUE,
+        BZ_FLATPAK_ERROR_REMOTE_SYNCHRONIZATION_FAILURE,
+        "Failed to enumerate refs for remote '%s': %s",
+        remote_name,
+        local_error->message);
+
+  {
+    g_autoptr (BzBackendNotification) notif = NULL;
+
+    notif = bz_backend_notification_new ();
+    bz_backend_notification_set_kind (notif, BZ_BACKEND_NOTIFICATION_KIND_TELL_INCOMING);
+    bz_backend_notification_set_n_incoming (notif, refs->len);
+
+    send_notif_all (self, notif, TRUE);
+  }
+
+  /* Refs whose fingerprint matches the last refresh are only acknowledged,
+   * since their cached entries would come out the same */
+  user              = installation == self->user;
+  fingerprints_path = dup_fingerprints_path (user, remote_name);
+  appstream_key     = dup_appstream_key (appstream_xml_path);
+  previous          = load_fingerprints (fingerprints_path, &previous_key, &previous_refs);
+
+  g_mutex_lock (&self->fingerprints_mutex);
+  if (self->cached_checksums != NULL)
+    cached = g_hash_table_ref (self->cached_checksums);
+  g_mutex_unlock (&self->fingerprints_mutex);
+
+  /* Parsing the catalog is most of the work here. If it is the same one as
+   * last time, and no ref changed either, every entry would come out the
+   * same and there is no need to look at it at all */
+  if (appstream_key != NULL &&
+      previous != NULL &&
+      g_strcmp0 (appstream_key, previous_key) == 0)
+    {
+      g_autoptr (GPtrArray) kept_ids     = NULL;
+      g_autoptr (GPtrArray) kept_digests = NULL;
+
+      kept_ids     = g_ptr_array_new_with_free_func (g_free);
+      kept_digests = g_ptr_array_new_with_free_func (g_free);
+      for (guint i = 0; i < refs->len; i++)
+        {
+          FlatpakRemoteRef *rref       = NULL;
+          g_autofree char  *unique_id  = NULL;
+          g_autofree char  *ref_digest = NULL;
+
+          rref       = g_ptr_array_index (refs, i);
+          unique_id  = bz_flatpak_ref_format_unique (FLATPAK_REF (rref), user);
+          ref_digest = dup_ref_digest (rref);
+          if (ref_digest == NULL ||
+              g_strcmp0 (g_hash_table_lookup (previous_refs, unique_id), ref_digest) != 0 ||
+              !is_cached (cached, unique_id))
+            break;
+
+          g_ptr_array_add (kept_ids, g_steal_pointer (&unique_id));
+          g_ptr_array_add (kept_digests, g_steal_pointer (&ref_digest));
+        }
+
+      if (kept_ids->len == refs->len)
+        {
+          g_debug ("Appstream data and refs of remote '%s' are unchanged, "
+                   "keeping all %u entries",
+                   remote_name, refs->len);
+
+          current   = g_hash_table_new (g_str_hash, g_str_equal);
+          next_refs = g_hash_table_new (g_str_hash, g_str_equal);
+          next      = g_hash_table_new (g_str_hash, g_str_equal);
+          for (guint i = 0; i < kept_ids->len; i++)
+            {
+              const char *unique_id                   = NULL;
+              g_autoptr (BzBackendNotification) notif = NULL;
+
+              unique_id = g_ptr_array_index (kept_ids, i);
+              g_hash_table_add (current, (gpointer) unique_id);
+              g_hash_table_replace (next_refs, (gpointer) unique_id, g_ptr_array_index (kept_digests, i));
+              g_hash_table_replace (next, (gpointer) unique_id, g_hash_table_lookup (previous, unique_id));
+
+              notif = bz_backend_notification_new ();
+              bz_backend_notification_set_kind (notif, BZ_BACKEND_NOTIFICATION_KIND_KEEP_ENTRY);
+              bz_backend_notification_set_unique_id (notif, unique_id);
+
+              send_notif_all (self, notif, TRUE);
+            }
+
+          send_removals (self, previous, current);
+          stage_fingerprints (self, fingerprints_path, appstream_key, next_refs, next);
+
+          return dex_future_new_true ();
+        }
+    }
+
   source = xb_builder_source_new ();
   result = xb_builder_source_load_file (
       source,
@@ -1611,7 +1892,10 @@ retrieve_refs_for_enumerable_remote (BzFlatpakInstance   *self,
         remote_name,
         local_error->message);
 
-  silo = build_silo (source, cancellable, &local_error);
+  /* An unchanged appstream bundle only costs mapping the silo we compiled
+   * from it last time */
+  silo_cache = dup_silo_cache_file (installation, remote_name);
+  silo       = build_silo (source, silo_cache, &compiled, cancellable, &local_error);
 
 #ifdef __GLIBC__
   /* From gnome-software/plugins/core/gs-plugin-appstream.c
@@ -1619,7 +1903,8 @@ retrieve_refs_for_enumerable_remote (BzFlatpakInstance   *self,
    * https://gitlab.gnome.org/GNOME/gnome-software/-/issues/941
    * libxmlb <= 0.3.22 makes lots of temporary heap allocations parsing large XMLs
    * trim the heap after parsing to control RSS growth. */
-  malloc_trim (0);
+  if (compiled)
+    malloc_trim (0);
 #endif
 
   if (silo == NULL)
@@ -1632,55 +1917,59 @@ retrieve_refs_for_enumerable_remote (BzFlatpakInstance   *self,
         remote_name,
         local_error->message);
 
-  root     = xb_silo_get_root (silo);
-  children = xb_node_get_children (root);
-
-  component_hash = g_hash_table_new (g_str_hash, g_str_equal);
-
-  for (guint i = 0; i < children->len; i++)
-    {
-      XbNode      *component_node = NULL;
-      AsComponent *component      = NULL;
-      const char  *id             = NULL;
-
-      component_node = g_ptr_array_index (children, i);
-      component      = parse_component_for_node (component_node, &local_error);
+  /* Parse the whole catalog in one go, rather than exporting and re-parsing
+   * every component on its own. Only the native languages made it into the
+   * silo, so its export is also much smaller than the download */
+  catalog_xml = xb_silo_export (silo, XB_NODE_EXPORT_FLAG_NONE, &local_error);
+  if (catalog_xml == NULL)
+    SEND_AND_RETURN_ERROR (
+        self, TRUE,
+        BZ_FLATPAK_ERROR_IO_MISBEHAVIOR,
+        "Failed to export binary xml silo from appstream bundle "
+        "download at path %s for remote '%s': %s",
+        appstream_xml_path,
+        remote_name,
+        local_error->message);
 
-      if (component == NULL)
-        {
-          SEND_AND_RETURN_ERROR (
-              self, TRUE,
-              BZ_FLATPAK_ERROR_APPSTREAM_FAILURE,
-              "Failed to parse appstream component from appstream bundle silo "
-              "originating from download at path %s for remote '%s': %s",
-              appstream_xml_path,
-              remote_name,
-              local_error->message);
-        }
+  metadata = as_metadata_new ();
+  as_metadata_set_format_style (metadata, AS_FORMAT_STYLE_CATALOG);
+  result = as_metadata_parse_data (
+      metadata,
+      catalog_xml,
+      -1,
+      AS_FORMAT_KIND_XML,
+      &local_error);
+  g_clear_pointer (&catalog_xml, g_free);
 
-      id = as_component_get_id (component);
-      g_hash_table_replace (component_hash, (gpointer) id, component);
-    }
+#ifdef __GLIBC__
+  /* The same goes for libxml2 parsing the catalog */
+  malloc_trim (0);
+#endif
 
-  refs = flatpak_installation_list_remote_refs_sync (
-      installation, remote_name, cancellable, &local_error);
-  if (refs == NULL)
+  if (!result)
     SEND_AND_RETURN_ERROR (
         self, TRUE,
-        BZ_FLATPAK_ERROR_REMOTE_SYNCHRONIZATION_FAILURE,
-        "Failed to enumerate refs for remote '%s': %s",
+        BZ_FLATPAK_ERROR_APPSTREAM_FAILURE,
+        "Failed to parse appstream catalog from appstream bundle silo "
+        "originating from download at path %s for remote '%s': %s",
+        appstream_xml_path,
         remote_name,
         local_error->message);
 
-  {
-    g_autoptr (BzBackendNotification) notif = NULL;
+  /* Components are owned by `metadata` */
+  components     = as_metadata_get_components (metadata);
+  component_hash = g_hash_table_new (g_str_hash, g_str_equal);
 
-    notif = bz_backend_notification_new ();
-    bz_backend_notification_set_kind (notif, BZ_BACKEND_NOTIFICATION_KIND_TELL_INCOMING);
-    bz_backend_notification_set_n_incoming (notif, refs->len);
+  for (guint i = 0; i < as_component_box_len (components); i++)
+    {
+      AsComponent *component = NULL;
+      const char  *id        = NULL;
 
-    send_notif_all (self, notif, TRUE);
-  }
+      component = as_component_box_index (components, i);
+      id        = as_component_get_id (component);
+      if (id != NULL)
+        g_hash_table_replace (component_hash, (gpointer) id, component);
+    }
 
   /* Ensure the receiving side of the channel gets
    * runtimes first, then addons, then applications
@@ -1688,12 +1977,23 @@ retrieve_refs_for_enumerable_remote (BzFlatpakInstance   *self,
   g_ptr_array_sort_values_with_data (
       refs, (GCompareDataFunc) cmp_rref, component_hash);
 
+  /* Entries are built in batches across the thread pool. libappstream fills
+   * some component caches lazily, so every component belongs to exactly one
+   * batch: the one holding the first ref which uses it */
+  ref_components = g_ptr_array_sized_new (refs->len);
+  owners         = g_hash_table_new (g_direct_hash, g_direct_equal);
+  batches        = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+
+  for (guint i = 0; i < refs->len; i += ENTRY_BATCH_SIZE)
+    g_ptr_array_add (batches, g_array_new (FALSE, FALSE, sizeof (guint)));
+
   for (guint i = 0; i < refs->len; i++)
     {
-      FlatpakRemoteRef *rref           = NULL;
-      const char       *name           = NULL;
-      AsComponent      *component      = NULL;
-      g_autoptr (BzFlatpakEntry) entry = NULL;
+      FlatpakRemoteRef *rref      = NULL;
+      const char       *name      = NULL;
+      AsComponent      *component = NULL;
+      gpointer          owner     = NULL;
+      guint             batch     = 0;
 
       rref      = g_ptr_array_index (refs, i);
       name      = flatpak_ref_get_name (FLATPAK_REF (rref));
@@ -1705,14 +2005,87 @@ retrieve_refs_for_enumerable_remote (BzFlatpakInstance   *self,
           desktop_id = g_strdup_printf ("%s.desktop", name);
           component  = g_hash_table_lookup (component_hash, desktop_id);
         }
+      g_ptr_array_add (ref_components, component);
 
-      entry = bz_flatpak_entry_new_for_ref (
-          FLATPAK_REF (rref),
-          remote,
-          installation == self->user,
-          component,
-          appstream_dir_path,
-          NULL);
+      batch = i / ENTRY_BATCH_SIZE;
+      if (component != NULL)
+        {
+          if (g_hash_table_lookup_extended (owners, component, NULL, &owner))
+            batch = GPOINTER_TO_UINT (owner);
+          else
+            g_hash_table_replace (owners, component, GUINT_TO_POINTER (batch));
+        }
+      g_array_append_val (g_ptr_array_index (batches, batch), i);
+    }
+
+  unique_ids = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_set_size (unique_ids, refs->len);
+  ref_digests = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_set_size (ref_digests, refs->len);
+  fingerprints = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_set_size (fingerprints, refs->len);
+  entries = g_ptr_array_new_with_free_func (g_object_unref);
+  g_ptr_array_set_size (entries, refs->len);
+  jobs = g_ptr_array_new_with_free_func (dex_unref);
+
+  for (guint i = 0; i < batches->len; i++)
+    {
+      g_autoptr (BuildEntriesData) job_data = NULL;
+
+      job_data                = build_entries_data_new ();
+      job_data->cancellable   = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+      job_data->remote        = g_object_ref (remote);
+      job_data->user          = user;
+      job_data->appstream_dir = g_strdup (appstream_dir_path);
+      job_data->metadata      = g_object_ref (metadata);
+      job_data->previous      = previous != NULL ? g_hash_table_ref (previous) : NULL;
+      job_data->cached        = cached != NULL ? g_hash_table_ref (cached) : NULL;
+      job_data->refs          = g_ptr_array_ref (refs);
+      job_data->components    = g_ptr_array_ref (ref_components);
+      job_data->indices       = g_array_ref (g_ptr_array_index (batches, i));
+      job_data->unique_ids    = g_ptr_array_ref (unique_ids);
+      job_data->ref_digests   = g_ptr_array_ref (ref_digests);
+      job_data->fingerprints  = g_ptr_array_ref (fingerprints);
+      job_data->entries       = g_ptr_array_ref (entries);
+
+      g_ptr_array_add (
+          jobs,
+          dex_scheduler_spawn (
+              self->scheduler,
+              bz_get_dex_stack_size (),
+              (DexFiberFunc) build_entries_fiber,
+              build_entries_data_ref (job_data),
+              build_entries_data_unref));
+    }
+
+  current   = g_hash_table_new (g_str_hash, g_str_equal);
+  next_refs = g_hash_table_new (g_str_hash, g_str_equal);
+  next      = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* A batch may hold refs from later ranges but never earlier ones, so
+   * once every batch up to a range is done, that range is complete */
+  for (guint i = 0; i < refs->len; i++)
+    {
+      const char     *unique_id   = NULL;
+      const char     *ref_digest  = NULL;
+      const char     *fingerprint = NULL;
+      BzFlatpakEntry *entry       = NULL;
+
+      if (i % ENTRY_BATCH_SIZE == 0)
+        dex_await (dex_ref (g_ptr_array_index (jobs, i / ENTRY_BATCH_SIZE)), NULL);
+
+      unique_id   = g_ptr_array_index (unique_ids, i);
+      ref_digest  = g_ptr_array_index (ref_digests, i);
+      fingerprint = g_ptr_array_index (fingerprints, i);
+      entry       = g_ptr_array_index (entries, i);
+
+      if (unique_id != NULL)
+        g_hash_table_add (current, (gpointer) unique_id);
+      if (unique_id != NULL && fingerprint != NULL)
+        {
+          g_hash_table_replace (next_refs, (gpointer) unique_id, (gpointer) ref_digest);
+          g_hash_table_replace (next, (gpointer) unique_id, (gpointer) fingerprint);
+        }
 
       if (entry != NULL)
         {
@@ -1722,6 +2095,16 @@ retrieve_refs_for_enumerable_remote (BzFlatpakInstance   *self,
           bz_backend_notification_set_kind (notif, BZ_BACKEND_NOTIFICATION_KIND_REPLACE_ENTRY);
           bz_backend_notification_set_entry (notif, BZ_ENTRY (entry));
 
+          send_notif_all (self, notif, TRUE);
+        }
+      else if (fingerprint != NULL)
+        {
+          g_autoptr (BzBackendNotification) notif = NULL;
+
+          notif = bz_backend_notification_new ();
+          bz_backend_notification_set_kind (notif, BZ_BACKEND_NOTIFICATION_KIND_KEEP_ENTRY);
+          bz_backend_notification_set_unique_id (notif, unique_id);
+
           send_notif_all (self, notif, TRUE);
         }
       else
@@ -1736,6 +2119,107 @@ retrieve_refs_for_enumerable_remote (BzFlatpakInstance   *self,
         }
     }
 
+  /* A cancelled retrieval didn't look at every ref */
+  if (g_cancellable_is_cancelled (cancellable))
+    return dex_future_new_true ();
+
+  send_removals (self, previous, current);
+  stage_fingerprints (self, fingerprints_path, appstream_key, next_refs, next);
+
+  return dex_future_new_true ();
+}
+
+static DexFuture *
+build_entries_fiber (BuildEntriesData *data)
+{
+  g_autoptr (AsMetadata) serializer = NULL;
+
+  serializer = as_metadata_new ();
+  as_metadata_set_format_style (serializer, AS_FORMAT_STYLE_CATALOG);
+
+  for (guint i = 0; i < data->indices->len; i++)
+    {
+      guint             index       = 0;
+      FlatpakRemoteRef *rref        = NULL;
+      AsComponent      *component   = NULL;
+      g_autofree char  *unique_id   = NULL;
+      g_autofree char  *ref_digest  = NULL;
+      g_autofree char  *fingerprint = NULL;
+      BzFlatpakEntry   *entry       = NULL;
+
+      if (g_cancellable_is_cancelled (data->cancellable))
+        break;
+
+      index     = g_array_index (data->indices, guint, i);
+      rref      = g_ptr_array_index (data->refs, index);
+      component = g_ptr_array_index (data->components, index);
+
+      unique_id   = bz_flatpak_ref_format_unique (FLATPAK_REF (rref), data->user);
+      ref_digest  = dup_ref_digest (rref);
+      if (ref_digest != NULL)
+        fingerprint = dup_ref_fingerprint (ref_digest, component, serializer);
+
+      /* An entry which went missing from the cache must be built again,
+       * or nothing would ever bring it back */
+      if (fingerprint == NULL ||
+          data->previous == NULL ||
+          g_strcmp0 (g_hash_table_lookup (data->previous, unique_id), fingerprint) != 0 ||
+          !is_cached (data->cached, unique_id))
+        {
+          entry = bz_flatpak_entry_new_for_ref (
+              FLATPAK_REF (rref),
+              data->remote,
+              data->user,
+              component,
+              data->appstream_dir,
+              NULL);
+          /* Try again next time */
+          if (entry == NULL)
+            g_clear_pointer (&fingerprint, g_free);
+        }
+
+      /* Every slot has exactly one writer */
+      data->unique_ids->pdata[index]   = g_steal_pointer (&unique_id);
+      data->ref_digests->pdata[index]  = g_steal_pointer (&ref_digest);
+      data->fingerprints->pdata[index] = g_steal_pointer (&fingerprint);
+      data->entries->pdata[index]      = entry;
+    }
+
+  return dex_future_new_true ();
+}
+
+static DexFuture *
+commit_fingerprints_fiber (CommitFingerprintsData *data)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autofree char *dir           = NULL;
+  GHashTableIter   iter          = { 0 };
+
+  dir = bz_dup_cache_dir (FINGERPRINTS_SUBMODULE);
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      int errsv = errno;
+
+      return dex_future_new_reject (
+          G_IO_ERROR,
+          g_io_error_from_errno (errsv),
+          "Failed to create directory %s: %s",
+          dir, g_strerror (errsv));
+    }
+
+  g_hash_table_iter_init (&iter, data->pending);
+  for (;;)
+    {
+      const char *path  = NULL;
+      GBytes     *bytes = NULL;
+
+      if (!g_hash_table_iter_next (&iter, (gpointer *) &path, (gpointer *) &bytes))
+        break;
+
+      if (!bz_write_path_bytes (path, bytes, &local_error))
+        return dex_future_new_for_error (g_steal_pointer (&local_error));
+    }
+
   return dex_future_new_true ();
 }
 
@@ -1809,7 +2293,7 @@ retrieve_refs_for_noenumerable_remote (BzFlatpakInstance   *self,
               goto create_entry;
             }
 
-          silo = build_silo (source, cancellable, &appstream_error);
+          silo = build_silo (source, NULL, NULL, cancellable, &appstream_error);
           if (silo == NULL)
             {
               g_info ("Could not build silo from appstream: %s",
@@ -3309,14 +3793,40 @@ decompress_appstream_gz (GBytes       *appstream_gz,
   return g_steal_pointer (&appstream);
 }
 
+static guint64
+query_mtime_usec (GFile *file)
+{
+  g_autoptr (GFileInfo) info  = NULL;
+  g_autoptr (GDateTime) mtime = NULL;
+
+  info = g_file_query_info (
+      file,
+      G_FILE_ATTRIBUTE_TIME_MODIFIED
+      "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+      G_FILE_QUERY_INFO_NONE,
+      NULL, NULL);
+  if (info == NULL)
+    return 0;
+
+  mtime = g_file_info_get_modification_date_time (info);
+  return mtime != NULL ? g_date_time_to_unix_usec (mtime) : 0;
+}
+
+/* With a `cache`, the compiled silo is stored there and reused as long as
+ * the sources, their mtimes and the locales stay the same. `compiled` is
+ * set to whether the XML actually had to be parsed */
 static XbSilo *
 build_silo (XbBuilderSource *source,
+            GFile           *cache,
+            gboolean        *compiled,
             GCancellable    *cancellable,
             GError         **error)
 {
-  g_autoptr (XbBuilder) builder = NULL;
-  const gchar *const *locales   = NULL;
-  g_autoptr (XbSilo) silo       = NULL;
+  g_autoptr (XbBuilder) builder  = NULL;
+  const gchar *const *locales    = NULL;
+  g_autoptr (XbSilo) silo        = NULL;
+  g_autoptr (GError) local_error = NULL;
+  guint64 cached_mtime           = 0;
 
   builder = xb_builder_new ();
 
@@ -3325,15 +3835,58 @@ build_silo (XbBuilderSource *source,
     xb_builder_add_locale (builder, locales[i]);
 
   xb_builder_import_source (builder, source);
+
+  if (cache != NULL)
+    {
+      cached_mtime = query_mtime_usec (cache);
+      silo         = xb_builder_ensure (
+          builder,
+          cache,
+          XB_BUILDER_COMPILE_FLAG_NATIVE_LANGS,
+          cancellable,
+          &local_error);
+      if (silo != NULL)
+        {
+          if (compiled != NULL)
+            *compiled = cached_mtime == 0 || query_mtime_usec (cache) != cached_mtime;
+          return g_steal_pointer (&silo);
+        }
+
+      /* Not being able to cache shouldn't stop us */
+      g_warning ("Failed to use compiled silo cache at %s, compiling in memory instead: %s",
+                 g_file_peek_path (cache), local_error->message);
+      g_clear_error (&local_error);
+    }
+
   silo = xb_builder_compile (
       builder,
       XB_BUILDER_COMPILE_FLAG_NATIVE_LANGS,
       cancellable,
       error);
+  if (compiled != NULL)
+    *compiled = TRUE;
 
   return g_steal_pointer (&silo);
 }
 
+static GFile *
+dup_silo_cache_file (FlatpakInstallation *installation,
+                     const char          *remote_name)
+{
+  g_autofree char *silo_dir = NULL;
+  g_autofree char *basename = NULL;
+
+  silo_dir = bz_dup_cache_dir (SILO_CACHE_SUBMODULE);
+  if (g_mkdir_with_parents (silo_dir, 0755) != 0)
+    return NULL;
+
+  basename = g_strdup_printf (
+      "%s-%s.xmlb",
+      flatpak_installation_get_is_user (installation) ? "user" : "system",
+      remote_name);
+  return g_file_new_build_filename (silo_dir, basename, NULL);
+}
+
 static AsComponent *
 extract_first_component_for_silo (XbSilo  *silo,
                                   GError **error)
@@ -3351,3 +3904,247 @@ extract_first_component_for_silo (XbSilo  *silo,
       g_ptr_array_index (children, 0),
       error);
 }
+
+static char *
+dup_fingerprints_path (gboolean    user,
+                       const char *remote_name)
+{
+  g_autofree char *dir      = NULL;
+  g_autofree char *basename = NULL;
+
+  dir      = bz_dup_cache_dir (FINGERPRINTS_SUBMODULE);
+  basename = g_strdup_printf ("%s-%s", user ? "user" : "system", remote_name);
+
+  return g_build_filename (dir, basename, NULL);
+}
+
+/* Entries hold translated strings, so a locale change invalidates them */
+static char *
+dup_fingerprints_locale (void)
+{
+  return g_strjoinv (":", (GStrv) g_get_language_names ());
+}
+
+/* Identifies a download of the appstream catalog, or NULL if it can't be
+ * read. The mtime alone would do for flatpak's own checkouts, but the
+ * content checksum keeps this honest if something else touches the file */
+static char *
+dup_appstream_key (const char *appstream_xml_path)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GBytes) bytes       = NULL;
+  g_autofree char *checksum      = NULL;
+  GStatBuf         stat_buf      = { 0 };
+
+  if (g_stat (appstream_xml_path, &stat_buf) != 0)
+    return NULL;
+
+  bytes = bz_read_path_bytes (appstream_xml_path, &local_error);
+  if (bytes == NULL)
+    {
+      g_warning ("Unable to read appstream data at %s, "
+                 "it will be parsed again: %s",
+                 appstream_xml_path, local_error->message);
+      return NULL;
+    }
+  checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, bytes);
+
+  return g_strdup_printf ("%s-%" G_GINT64_FORMAT, checksum, (gint64) stat_buf.st_mtime);
+}
+
+static GHashTable *
+load_fingerprints (const char  *path,
+                   char       **appstream_key_out,
+                   GHashTable **ref_digests_out)
+{
+  g_autoptr (GError) local_error     = NULL;
+  g_autoptr (GBytes) bytes           = NULL;
+  g_autoptr (GVariant) variant       = NULL;
+  const char *version                = NULL;
+  const char *locale                 = NULL;
+  const char *appstream_key          = NULL;
+  g_autofree char *cur_locale        = NULL;
+  g_autoptr (GVariantIter) iter      = NULL;
+  g_autoptr (GHashTable) ref_digests = NULL;
+  g_autoptr (GHashTable) ret         = NULL;
+
+  bytes = bz_read_path_bytes (path, &local_error);
+  if (bytes == NULL)
+    {
+      if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        g_warning ("Unable to read ref fingerprints from %s, "
+                   "all refs will be treated as changed: %s",
+                   path, local_error->message);
+      return NULL;
+    }
+
+  variant = g_variant_ref_sink (g_variant_new_from_bytes (
+      G_VARIANT_TYPE (FINGERPRINTS_TYPE), bytes, FALSE));
+  g_variant_get (variant, "(&s&s&sa{s(ss)})", &version, &locale, &appstream_key, &iter);
+
+  cur_locale = dup_fingerprints_locale ();
+  if (g_strcmp0 (version, PACKAGE_VERSION) != 0 ||
+      g_strcmp0 (locale, cur_locale) != 0)
+    return NULL;
+
+  ref_digests = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  ret         = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  for (;;)
+    {
+      const char *unique_id   = NULL;
+      char       *ref_digest  = NULL;
+      char       *fingerprint = NULL;
+
+      if (!g_variant_iter_next (iter, "{&s(ss)}", &unique_id, &ref_digest, &fingerprint))
+        break;
+      g_hash_table_replace (ref_digests, g_strdup (unique_id), ref_digest);
+      g_hash_table_replace (ret, g_strdup (unique_id), fingerprint);
+    }
+
+  *appstream_key_out = g_strdup (appstream_key);
+  *ref_digests_out   = g_steal_pointer (&ref_digests);
+  return g_steal_pointer (&ret);
+}
+
+/* Written out by `bz_flatpak_instance_commit_fingerprints` once the
+ * entries are safely cached */
+static void
+stage_fingerprints (BzFlatpakInstance *self,
+                    const char        *path,
+                    const char        *appstream_key,
+                    GHashTable        *ref_digests,
+                    GHashTable        *fingerprints)
+{
+  g_auto (GVariantBuilder) builder = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("a{s(ss)}"));
+  g_autofree char *locale          = NULL;
+  g_autoptr (GVariant) variant     = NULL;
+  GHashTableIter iter              = { 0 };
+
+  g_hash_table_iter_init (&iter, fingerprints);
+  for (;;)
+    {
+      const char *unique_id   = NULL;
+      const char *fingerprint = NULL;
+
+      if (!g_hash_table_iter_next (&iter, (gpointer *) &unique_id, (gpointer *) &fingerprint))
+        break;
+      g_variant_builder_add (
+          &builder, "{s(ss)}", unique_id,
+          g_hash_table_lookup (ref_digests, unique_id),
+          fingerprint);
+    }
+
+  locale  = dup_fingerprints_locale ();
+  variant = g_variant_ref_sink (g_variant_new (
+      "(sss@a{s(ss)})",
+      PACKAGE_VERSION,
+      locale,
+      /* An unreadable catalog never matches */
+      appstream_key != NULL ? appstream_key : "",
+      g_variant_builder_end (&builder)));
+
+  g_mutex_lock (&self->fingerprints_mutex);
+  g_hash_table_replace (
+      self->pending_fingerprints,
+      g_strdup (path),
+      g_variant_get_data_as_bytes (variant));
+  g_mutex_unlock (&self->fingerprints_mutex);
+}
+
+/* Refs which were there last time but are gone now */
+static void
+send_removals (BzFlatpakInstance *self,
+               GHashTable        *previous,
+               GHashTable        *current)
+{
+  GHashTableIter iter = { 0 };
+
+  if (previous == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, previous);
+  for (;;)
+    {
+      const char *unique_id                   = NULL;
+      g_autoptr (BzBackendNotification) notif = NULL;
+
+      if (!g_hash_table_iter_next (&iter, (gpointer *) &unique_id, NULL))
+        break;
+      if (g_hash_table_contains (current, unique_id))
+        continue;
+
+      notif = bz_backend_notification_new ();
+      bz_backend_notification_set_kind (notif, BZ_BACKEND_NOTIFICATION_KIND_REMOVE_ENTRY);
+      bz_backend_notification_set_unique_id (notif, unique_id);
+
+      send_notif_all (self, notif, TRUE);
+    }
+}
+
+static gboolean
+is_cached (GHashTable *cached,
+           const char *unique_id)
+{
+  g_autofree char *checksum = NULL;
+
+  if (cached == NULL)
+    return TRUE;
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, unique_id, -1);
+  return g_hash_table_contains (cached, checksum);
+}
+
+/* Covers what an entry is built from in the summary: the commit, which
+ * pins sizes and metadata, and the end-of-life state, which can change in
+ * the summary alone */
+static char *
+dup_ref_digest (FlatpakRemoteRef *rref)
+{
+  g_autoptr (GChecksum) checksum = NULL;
+  const char *parts[3]           = { 0 };
+
+  parts[0] = flatpak_ref_get_commit (FLATPAK_REF (rref));
+  parts[1] = flatpak_remote_ref_get_eol (rref);
+  parts[2] = flatpak_remote_ref_get_eol_rebase (rref);
+  if (parts[0] == NULL)
+    return NULL;
+
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+  for (guint i = 0; i < G_N_ELEMENTS (parts); i++)
+    /* Include the terminator so fields can't run into each other */
+    g_checksum_update (
+        checksum,
+        (const guchar *) (parts[i] != NULL ? parts[i] : ""),
+        parts[i] != NULL ? strlen (parts[i]) + 1 : 1);
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
+
+/* Covers everything an entry is built from besides the remote itself: the
+ * ref's digest and the appstream component */
+static char *
+dup_ref_fingerprint (const char  *ref_digest,
+                     AsComponent *component,
+                     AsMetadata  *serializer)
+{
+  g_autoptr (GChecksum) checksum = NULL;
+
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+  g_checksum_update (checksum, (const guchar *) ref_digest, -1);
+
+  if (component != NULL)
+    {
+      g_autofree char *xml = NULL;
+
+      as_metadata_clear_components (serializer);
+      as_metadata_add_component (serializer, component);
+      xml = as_metadata_components_to_catalog (serializer, AS_FORMAT_KIND_XML, NULL);
+      as_metadata_clear_components (serializer);
+      if (xml == NULL)
+        return NULL;
+
+      g_checksum_update (checksum, (const guchar *) xml, -1);
+    }
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
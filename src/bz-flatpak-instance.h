@@ -52,4 +52,11 @@ DexFuture *
 bz_flatpak_instance_ensure_has_flathub (BzFlatpakInstance *self,
                                         GCancellable      *cancellable);
 
+DexFuture *
+bz_flatpak_instance_commit_fingerprints (BzFlatpakInstance *self);
+
+void
+bz_flatpak_instance_set_cached_checksums (BzFlatpakInstance *self,
+                                          GHashTable        *checksums);
+
 G_END_DECLS
@@ -21,10 +21,14 @@
 #include "bz-gnome-shell-search-provider.h"
 #include "bz-entry-group.h"
 #include "bz-finished-search-query.h"
-#include "bz-search-result.h"
+#include "bz-search-result-list.h"
 #include "bz-util.h"
 #include "gs-shell-search-provider-generated.h"
 
+/* The shell only ever shows a handful of results, leave some headroom for
+   installed groups, which are skipped */
+#define MAX_RESULTS 64
+
 struct _BzGnomeShellSearchProvider
 {
   GObject parent_instance;
@@ -34,6 +38,7 @@ struct _BzGnomeShellSearchProvider
 
   BzShellSearchProvider2 *skeleton;
   DexFuture              *task;
+  GCancellable           *cancellable;
 
   GHashTable *last_results;
 };
@@ -76,6 +81,9 @@ bz_gnome_shell_search_provider_dispose (GObject *object)
   BzGnomeShellSearchProvider *self = BZ_GNOME_SHELL_SEARCH_PROVIDER (object);
 
   dex_clear (&self->task);
+  if (self->cancellable != NULL)
+    g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
 
   g_clear_object (&self->engine);
   g_clear_object (&self->connection);
@@ -372,24 +380,24 @@ request_finally (DexFuture   *future,
   g_autoptr (GError) local_error         = NULL;
   const GValue          *value           = NULL;
   BzFinishedSearchQuery *finished        = NULL;
-  GPtrArray             *results         = NULL;
+  GListModel            *results         = NULL;
+  guint                  n_results       = 0;
   g_autoptr (GVariantBuilder) builder    = NULL;
 
   value = dex_future_get_value (future, &local_error);
   if (value != NULL)
     {
-      finished = g_value_get_object (value);
-      results  = bz_finished_search_query_get_results (finished);
-      builder  = g_variant_builder_new (G_VARIANT_TYPE ("as"));
+      finished  = g_value_get_object (value);
+      results   = bz_finished_search_query_get_results (finished);
+      n_results = g_list_model_get_n_items (results);
+      builder   = g_variant_builder_new (G_VARIANT_TYPE ("as"));
 
-      for (guint i = 0; i < results->len; i++)
+      for (guint i = 0; i < n_results; i++)
         {
-          BzSearchResult *result = NULL;
-          BzEntryGroup   *group  = NULL;
-          const char     *id     = NULL;
+          BzEntryGroup *group = NULL;
+          const char   *id    = NULL;
 
-          result = g_ptr_array_index (results, i);
-          group  = bz_search_result_get_group (result);
+          group = bz_search_result_list_get_group (BZ_SEARCH_RESULT_LIST (results), i);
           if (bz_entry_group_get_removable (group) > 0)
             /* Skip already installed groups */
             continue;
@@ -408,9 +416,11 @@ request_finally (DexFuture   *future,
     }
   else
     {
-      g_warning ("search engine reported an error to the search provider, "
-                 "returning an empty response to invocation: %s",
-                 local_error->message);
+      /* Superseded by a newer request */
+      if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("search engine reported an error to the search provider, "
+                   "returning an empty response to invocation: %s",
+                   local_error->message);
       g_dbus_method_invocation_return_value (invocation, g_variant_new ("(as)", NULL));
     }
 
@@ -426,6 +436,9 @@ start_request (BzGnomeShellSearchProvider *self,
   g_autoptr (DexFuture) future = NULL;
 
   dex_clear (&self->task);
+  if (self->cancellable != NULL)
+    g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
   g_hash_table_remove_all (self->last_results);
 
   if (g_strv_length ((gchar **) terms) == 1 &&
@@ -453,7 +466,9 @@ start_request (BzGnomeShellSearchProvider *self,
   data->application = g_application_get_default ();
   g_application_hold (data->application);
 
-  future = bz_search_engine_query (self->engine, terms);
+  self->cancellable = g_cancellable_new ();
+
+  future = bz_search_engine_query (self->engine, terms, MAX_RESULTS, self->cancellable);
   future = dex_future_finally (
       future, (DexFutureCallback) request_finally,
       request_data_ref (data), request_data_unref);
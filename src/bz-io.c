@@ -18,6 +18,12 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+
 #include "bz-io.h"
 #include "bz-env.h"
 #include "bz-size-result.h"
@@ -61,6 +67,150 @@ bz_get_io_scheduler (void)
   return scheduler;
 }
 
+static gboolean
+set_errno_error (GError    **error,
+                 int         errsv,
+                 const char *what,
+                 const char *path)
+{
+  g_set_error (
+      error,
+      G_IO_ERROR,
+      g_io_error_from_errno (errsv),
+      "Failed to %s %s: %s",
+      what, path, g_strerror (errsv));
+  return FALSE;
+}
+
+/* These must be called from a fiber. The transfers go through the AIO
+ * backend of libdex, which submits them in batches through io_uring when
+ * the kernel allows it and otherwise falls back to blocking calls on a
+ * thread pool, so concurrent cache and texture loads share submissions
+ * instead of each making their own round of syscalls */
+GBytes *
+bz_read_path_bytes (const char *path,
+                    GError    **error)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autofd int fd                = -1;
+  struct stat  st                = { 0 };
+  g_autofree guint8 *buffer      = NULL;
+  gsize              size        = 0;
+  gsize              offset      = 0;
+
+  g_return_val_if_fail (path != NULL, NULL);
+
+  fd = g_open (path, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0)
+    {
+      set_errno_error (error, errno, "open", path);
+      return NULL;
+    }
+  if (fstat (fd, &st) != 0)
+    {
+      set_errno_error (error, errno, "stat", path);
+      return NULL;
+    }
+  if (!S_ISREG (st.st_mode))
+    {
+      g_set_error (
+          error,
+          G_IO_ERROR,
+          G_IO_ERROR_NOT_REGULAR_FILE,
+          "Failed to read %s: not a regular file",
+          path);
+      return NULL;
+    }
+
+  size   = st.st_size;
+  buffer = g_malloc (MAX (size, 1));
+
+  while (offset < size)
+    {
+      gint64 n_read = 0;
+
+      n_read = dex_await_int64 (
+          dex_aio_read (NULL, fd, buffer + offset, size - offset, offset),
+          &local_error);
+      if (local_error != NULL)
+        {
+          g_propagate_prefixed_error (error, g_steal_pointer (&local_error),
+                                      "Failed to read %s: ", path);
+          return NULL;
+        }
+      /* Truncated underneath us */
+      if (n_read <= 0)
+        break;
+
+      offset += n_read;
+    }
+
+  return g_bytes_new_take (g_steal_pointer (&buffer), offset);
+}
+
+/* Replaces `path` atomically, but without syncing, so only use this for
+ * data which can be regenerated */
+gboolean
+bz_write_path_bytes (const char *path,
+                     GBytes     *bytes,
+                     GError    **error)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autofree char *tmp_path      = NULL;
+  g_autofd int fd                = -1;
+  gconstpointer data             = NULL;
+  gsize         size             = 0;
+  gsize         offset           = 0;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (bytes != NULL, FALSE);
+
+  tmp_path = g_strdup_printf ("%s.XXXXXX", path);
+  fd       = g_mkstemp_full (tmp_path, O_WRONLY | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return set_errno_error (error, errno, "create temporary file for", path);
+
+  data = g_bytes_get_data (bytes, &size);
+  while (offset < size)
+    {
+      gint64 n_written = 0;
+
+      n_written = dex_await_int64 (
+          dex_aio_write (NULL, fd, (const guint8 *) data + offset, size - offset, offset),
+          &local_error);
+      if (local_error != NULL || n_written <= 0)
+        {
+          g_unlink (tmp_path);
+          if (local_error != NULL)
+            g_propagate_prefixed_error (error, g_steal_pointer (&local_error),
+                                        "Failed to write %s: ", path);
+          else
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                         "Failed to write %s: short write", path);
+          return FALSE;
+        }
+
+      offset += n_written;
+    }
+
+  if (!g_close (g_steal_fd (&fd), NULL))
+    {
+      int errsv = errno;
+
+      g_unlink (tmp_path);
+      return set_errno_error (error, errsv, "close", path);
+    }
+  if (g_rename (tmp_path, path) != 0)
+    {
+      int errsv = errno;
+
+      g_unlink (tmp_path);
+      return set_errno_error (error, errsv, "replace", path);
+    }
+
+  return TRUE;
+}
+
 void
 bz_reap_file (GFile *file)
 {
@@ -456,6 +606,44 @@ bz_dup_cache_dir (const char *submodule)
   return g_build_filename (root_cache_dir, submodule, NULL);
 }
 
+/* Catalogs imported from another machine still reference files in that
+ * machine's cache dir until the next refresh rewrites them, so paths read
+ * back from the cache should be passed through this */
+char *
+bz_rebase_cache_path (const char *path)
+{
+  static char *origin = NULL;
+  static char *root   = NULL;
+  gsize        len    = 0;
+
+  g_return_val_if_fail (path != NULL, NULL);
+
+  if (g_once_init_enter_pointer (&root))
+    {
+      g_autofree char *dir         = NULL;
+      g_autofree char *origin_path = NULL;
+
+      dir         = bz_dup_root_cache_dir ();
+      origin_path = g_build_filename (dir, BZ_CATALOG_ORIGIN_FILE, NULL);
+      if (!g_file_get_contents (origin_path, &origin, NULL, NULL))
+        origin = NULL;
+      else if (g_strcmp0 (origin, dir) == 0)
+        g_clear_pointer (&origin, g_free);
+
+      g_once_init_leave_pointer (&root, g_steal_pointer (&dir));
+    }
+
+  if (origin == NULL)
+    return g_strdup (path);
+
+  len = strlen (origin);
+  if (strncmp (path, origin, len) == 0 &&
+      path[len] == G_DIR_SEPARATOR)
+    return g_strconcat (root, path + len, NULL);
+
+  return g_strdup (path);
+}
+
 static DexFuture *
 reap_file_fiber (GFile *file)
 {
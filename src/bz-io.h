@@ -34,6 +34,15 @@ bz_dup_user_cache_path (const char *app_id);
 DexScheduler *
 bz_get_io_scheduler (void);
 
+GBytes *
+bz_read_path_bytes (const char *path,
+                    GError    **error);
+
+gboolean
+bz_write_path_bytes (const char *path,
+                     GBytes     *bytes,
+                     GError    **error);
+
 void
 bz_reap_file (GFile *file);
 
@@ -64,6 +73,12 @@ bz_dup_root_cache_dir (void);
 char *
 bz_dup_cache_dir (const char *submodule);
 
+char *
+bz_rebase_cache_path (const char *path);
+
+/* Written into the root cache dir by catalog imports */
+#define BZ_CATALOG_ORIGIN_FILE "catalog-origin"
+
 #define bz_dup_module_dir() bz_dup_cache_dir (BAZAAR_MODULE)
 
 #define bz_discard_path(_path)                          \
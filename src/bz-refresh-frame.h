@@ -0,0 +1,40 @@
+/* bz-refresh-frame.h
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The refresh worker streams entries to the application over its stdout.
+ * Frames are a little endian 32 bit header followed by that many bytes of
+ * a serialized entry. An empty frame ends the stream */
+
+/* Set in the header when the bytes are instead the unique ID of an entry
+ * which is gone */
+#define BZ_REFRESH_FRAME_TOMBSTONE (1u << 31)
+
+/* Whatever is left of the header once flags are masked off */
+#define BZ_REFRESH_FRAME_LENGTH_MASK (BZ_REFRESH_FRAME_TOMBSTONE - 1)
+
+G_END_DECLS
+
+/* End of bz-refresh-frame.h */
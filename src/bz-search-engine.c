@@ -24,7 +24,8 @@
 #include "bz-entry-group.h"
 #include "bz-env.h"
 #include "bz-finished-search-query.h"
-#include "bz-search-result.h"
+#include "bz-search-result-list.h"
+#include "bz-substring.h"
 #include "bz-util.h"
 
 struct _BzSearchEngine
@@ -33,8 +34,30 @@ struct _BzSearchEngine
 
   GListModel *model;
   GListModel *biases;
-
-  GPtrArray *biases_mirror;
+  guint       max_threads;
+
+  GPtrArray  *biases_mirror;
+  GRegex     *biases_matcher;
+  GPtrArray  *biases_loose;
+  GHashTable *boost_chains;
+
+  /* Everything below is only touched on the main thread. `mirror` borrows
+     from `indexed` and follows the order of `model` */
+  GPtrArray  *mirror;
+  GHashTable *indexed;
+  GPtrArray  *slots;
+  GArray     *free_slots;
+  GHashTable *trigrams;
+  GHashTable *ids;
+  GHashTable *titles;
+  GPtrArray  *dirty;
+  guint       flush_source;
+
+  /* Bumped whenever positions or records change, which invalidates the
+     matches a previous query left behind */
+  guint64               generation;
+  struct _MatchSetData *pending;
+  struct _MatchSetData *refinement;
 };
 
 G_DEFINE_FINAL_TYPE (BzSearchEngine, bz_search_engine, G_TYPE_OBJECT);
@@ -45,6 +68,7 @@ enum
 
   PROP_MODEL,
   PROP_BIASES,
+  PROP_MAX_THREADS,
 
   LAST_PROP
 };
@@ -57,21 +81,98 @@ biases_changed (BzSearchEngine *self,
                 guint           added,
                 GListModel     *model);
 
+static void
+model_changed (BzSearchEngine *self,
+               guint           position,
+               guint           removed,
+               guint           added,
+               GListModel     *model);
+
+typedef struct
+{
+  guint32 offset;
+  guint32 n_bytes;
+  guint32 n_chars;
+} Token;
+
+enum
+{
+  FIELD_TITLE,
+  FIELD_DEVELOPER,
+  FIELD_DESCRIPTION,
+  FIELD_SEARCH_TOKENS,
+  N_FIELDS,
+};
+
+/* Immutable copy of everything scoring needs to know about a group, built
+   on the main thread whenever the group changes. Every string lives back to
+   back in `text`, with the searchable fields already case-folded and split
+   into tokens, so sub tasks can share records without locking anything */
+BZ_DEFINE_DATA (
+    search_record,
+    SearchRecord,
+    {
+      BzEntryGroup *group;
+      gboolean      searchable;
+      const char   *id;
+      const char   *title;
+      char         *text;
+      Token        *tokens;
+      guint         field_tokens[N_FIELDS + 1];
+    },
+    BZ_RELEASE_DATA (group, g_object_unref);
+    BZ_RELEASE_DATA (text, g_free);
+    BZ_RELEASE_DATA (tokens, g_free));
+static SearchRecordData *
+build_search_record (BzEntryGroup *group);
+
+BZ_DEFINE_DATA (
+    folded_query,
+    FoldedQuery,
+    {
+      char  *text;
+      Token *tokens;
+      guint  n_tokens;
+    },
+    BZ_RELEASE_DATA (text, g_free);
+    BZ_RELEASE_DATA (tokens, g_free));
+static FoldedQueryData *
+fold_query (const char *query_utf8);
+
+static void
+append_folded (GString    *text,
+               GArray     *tokens,
+               const char *s);
+
 static double
-test_strings (const char *query,
-              const char *against,
-              gssize      accept_min_size);
+test_tokens (const char  *query,
+             const Token *query_tokens,
+             guint        n_query_tokens,
+             const char  *against,
+             const Token *against_tokens,
+             guint        n_against_tokens,
+             gssize       accept_min_size);
 
 typedef struct
 {
-  guint  idx;
-  double val;
+  guint    idx;
+  double   val;
+  gboolean accepted;
+  gboolean matched;
 } Score;
 
 static gint
 cmp_scores (Score *a,
             Score *b);
 
+static void
+select_top_scores (GArray *scores,
+                   guint   limit);
+
+static inline gboolean
+score_is_better (const Score *a,
+                 const Score *b);
+
 enum
 {
   LINEAR,
@@ -105,37 +206,180 @@ BZ_DEFINE_DATA (
     BZ_RELEASE_DATA (convert_to, g_free);
     BZ_RELEASE_DATA (boost, g_hash_table_unref));
 
+/* Which biases of a query boost its snapshot's records, so scoring a
+   record never has to look at biases which don't concern it. `chains` is
+   built once per set of biases and maps each boosted app id to the
+   positions in `biases` which boost it, in the order they apply; `active`
+   has an entry per position telling whether the query enabled it */
+BZ_DEFINE_DATA (
+    boost_table,
+    BoostTable,
+    {
+      GHashTable *chains;
+      GPtrArray  *biases;
+      gboolean   *active;
+    },
+    BZ_RELEASE_DATA (chains, g_hash_table_unref);
+    BZ_RELEASE_DATA (biases, g_ptr_array_unref);
+    BZ_RELEASE_DATA (active, g_free));
+
+/* Model positions of every group whose text matched `query_utf8` at all,
+   before biases and thresholds. Any query extending `query_utf8` can only
+   match a subset of these, so it only has to rescore them as long as the
+   catalog hasn't changed in between. `matched` is filled in by the query
+   fiber, and must not be read before `complete` is set */
+BZ_DEFINE_DATA (
+    match_set,
+    MatchSet,
+    {
+      char   *query_utf8;
+      guint64 generation;
+      GArray *matched;
+      int     complete;
+    },
+    BZ_RELEASE_DATA (query_utf8, g_free);
+    BZ_RELEASE_DATA (matched, g_array_unref));
+
+/* Where a streaming query delivers its early results. `func` only ever
+   runs on the main thread, and never once the final results are out */
+BZ_DEFINE_DATA (
+    partial_sink,
+    PartialSink,
+    {
+      BzSearchEnginePartialFunc func;
+      gpointer                  user_data;
+      GDestroyNotify            destroy_data;
+      GCancellable             *cancellable;
+      BzFinishedSearchQuery    *partial;
+      int                       superseded;
+    },
+    if (self->destroy_data != NULL)
+      self->destroy_data (self->user_data);
+    BZ_RELEASE_DATA (cancellable, g_object_unref);
+    BZ_RELEASE_DATA (partial, g_object_unref));
+static gboolean
+deliver_partial (PartialSinkData *sink);
+
 BZ_DEFINE_DATA (
     query_task,
     QueryTask,
     {
-      char     **terms;
-      GPtrArray *snapshot;
-      GPtrArray *biases;
+      char            *query_utf8;
+      FoldedQueryData *folded;
+      GPtrArray       *snapshot;
+      GArray          *stale;
+      GArray          *indices;
+      GArray          *exact;
+      BoostTableData  *boosts;
+      MatchSetData    *match_set;
+      guint            limit;
+      guint            max_threads;
+      GCancellable    *cancellable;
+      PartialSinkData *partial_sink;
     },
-    BZ_RELEASE_DATA (terms, g_strfreev);
+    BZ_RELEASE_DATA (query_utf8, g_free);
+    BZ_RELEASE_DATA (folded, folded_query_data_unref);
     BZ_RELEASE_DATA (snapshot, g_ptr_array_unref);
-    BZ_RELEASE_DATA (biases, g_ptr_array_unref))
+    BZ_RELEASE_DATA (stale, g_array_unref);
+    BZ_RELEASE_DATA (indices, g_array_unref);
+    BZ_RELEASE_DATA (exact, g_array_unref);
+    BZ_RELEASE_DATA (boosts, boost_table_data_unref);
+    BZ_RELEASE_DATA (match_set, match_set_data_unref);
+    BZ_RELEASE_DATA (cancellable, g_object_unref);
+    BZ_RELEASE_DATA (partial_sink, partial_sink_data_unref))
 static DexFuture *
 query_task_fiber (QueryTaskData *data);
 
+static BzFinishedSearchQuery *
+build_finished_query (QueryTaskData *data,
+                      GArray        *scores,
+                      double         elapsed);
+
+/* Records are scored in chunks of this size, which workers claim one at a
+   time from a shared cursor. Slow chunks, such as runs of groups with long
+   descriptions, then no longer hold up a single sub task while the others
+   sit idle */
+#define CHUNK_SIZE 128
+
+typedef struct
+{
+  guint worker;
+  guint offset;
+  guint length;
+} ChunkSpan;
+
+/* When streaming, the first `n_priority_chunks` chunks are handed out
+   before any other and scored into `priority_scores` instead of a worker's
+   buffer, so the query fiber can read them while the rest is still being
+   scored. `priority_done` resolves once all of them are in */
+#define PRIORITY_WORKER G_MAXUINT
+
+/* Shared by every worker of a query. Each chunk's span is only written by
+   the worker which claimed it, and only read once all workers are done */
+BZ_DEFINE_DATA (
+    scan_job,
+    ScanJob,
+    {
+      char            *query_utf8;
+      FoldedQueryData *folded;
+      GPtrArray       *shallow_mirror;
+      double           threshold;
+      BoostTableData  *boosts;
+      GCancellable    *cancellable;
+      guint            n_chunks;
+      ChunkSpan       *spans;
+      int              cursor;
+      guint            n_priority_chunks;
+      Score           *priority_scores;
+      int              n_priority_done;
+      DexPromise      *priority_done;
+    },
+    BZ_RELEASE_DATA (query_utf8, g_free);
+    BZ_RELEASE_DATA (folded, folded_query_data_unref);
+    BZ_RELEASE_DATA (shallow_mirror, g_ptr_array_unref);
+    BZ_RELEASE_DATA (boosts, boost_table_data_unref);
+    BZ_RELEASE_DATA (cancellable, g_object_unref);
+    BZ_RELEASE_DATA (spans, g_free);
+    BZ_RELEASE_DATA (priority_scores, g_free);
+    BZ_RELEASE_DATA (priority_done, dex_unref));
+
 BZ_DEFINE_DATA (
     query_sub_task,
     QuerySubTask,
     {
-      char      *query_utf8;
-      GPtrArray *shallow_mirror;
-      double     threshold;
-      guint      work_offset;
-      guint      work_length;
-      GPtrArray *active_biases;
+      ScanJobData *job;
+      guint        worker;
+      GArray      *scores_out;
     },
-    BZ_RELEASE_DATA (query_utf8, g_free);
-    BZ_RELEASE_DATA (shallow_mirror, g_ptr_array_unref);
-    BZ_RELEASE_DATA (active_biases, g_ptr_array_unref));
+    BZ_RELEASE_DATA (job, scan_job_data_unref);
+    BZ_RELEASE_DATA (scores_out, g_array_unref));
 static DexFuture *
 query_sub_task_fiber (QuerySubTaskData *data);
 
+static void
+scan_chunks (ScanJobData *job,
+             guint        worker,
+             GArray      *scores_out);
+
+static inline gboolean
+score_record (ScanJobData *job,
+              guint        idx,
+              Score       *out);
+
+static void
+publish_partial (QueryTaskData *data,
+                 ScanJobData   *job,
+                 GTimer        *timer);
+
+static GMutex     score_buffers_mutex = { 0 };
+static GPtrArray *score_buffers       = NULL;
+
+static GArray *
+acquire_score_buffer (void);
+
+static void
+release_score_buffer (GArray *buffer);
+
 static inline GUnicodeType
 utf8_char_class (const char *s,
                  gunichar   *ch_out);
@@ -145,18 +389,165 @@ utf8_skip_to_next_of_class (const char **s,
                             GUnicodeType class,
                             gsize       *read_utf8);
 
+static GRegex *
+compile_biases_matcher (GPtrArray *biases,
+                        GPtrArray *loose);
+
+static GHashTable *
+index_bias_boosts (GPtrArray *biases);
+
+static GPtrArray *
+resolve_biases (GPtrArray *biases,
+                GRegex    *matcher,
+                GPtrArray *loose,
+                char     **query_utf8);
+
+/* Trigram index used to narrow down which groups need to be scored at
+   all. A group can only receive a nonzero score if every query token is a
+   substring of one of its tokens, so any group missing one of the query's
+   trigrams can be skipped. Trigrams never span across space separators,
+   just like the tokens `test_tokens` compares */
+#define TRIGRAM_LEN      3
+#define FLUSH_BATCH_SIZE 256
+
+BZ_DEFINE_DATA (
+    indexed_group,
+    IndexedGroup,
+    {
+      BzEntryGroup     *group;
+      gulong            notify_handler;
+      guint32           slot;
+      guint             position;
+      guint             n_positions;
+      gboolean          dirty;
+      SearchRecordData *record;
+      GArray           *trigrams;
+    },
+    BZ_RELEASE_DATA (group, g_object_unref);
+    BZ_RELEASE_DATA (record, search_record_data_unref);
+    BZ_RELEASE_DATA (trigrams, g_array_unref));
+
+static void
+group_notify (BzSearchEngine *self,
+              GParamSpec     *pspec,
+              BzEntryGroup   *group);
+
+static IndexedGroupData *
+track_group (BzSearchEngine *self,
+             BzEntryGroup   *group);
+
+static void
+untrack_group (BzSearchEngine   *self,
+               IndexedGroupData *data);
+
+static void
+invalidate_group (BzSearchEngine   *self,
+                  IndexedGroupData *data);
+
+static void
+index_group (BzSearchEngine   *self,
+             IndexedGroupData *data);
+
+static void
+unindex_group (BzSearchEngine   *self,
+               IndexedGroupData *data);
+
+static void
+clear_index (BzSearchEngine *self);
+
+static gboolean
+flush_dirty (BzSearchEngine *self,
+             guint           max);
+
+static gboolean
+flush_idle (BzSearchEngine *self);
+
+static void
+append_dirty_candidates (BzSearchEngine *self,
+                         GArray         *positions);
+
+static SearchRecordData *
+dup_snapshot_record (IndexedGroupData *indexed,
+                     guint             idx,
+                     GArray           *stale);
+
+static GArray *
+find_candidates (BzSearchEngine  *self,
+                 const char      *query_utf8,
+                 FoldedQueryData *folded,
+                 GPtrArray       *active_biases);
+
+static GArray *
+refine_candidates (BzSearchEngine *self,
+                   MatchSetData   *previous,
+                   const char     *query_utf8,
+                   GPtrArray      *active_biases);
+
+static void
+append_exact_candidates (BzSearchEngine *self,
+                         const char     *query_utf8,
+                         GArray         *positions);
+
+static void
+append_boosted_candidates (BzSearchEngine *self,
+                           GPtrArray      *active_biases,
+                           GArray         *positions);
+
+static BoostTableData *
+build_boost_table (BzSearchEngine *self,
+                   GPtrArray      *active_biases);
+
+static void
+collect_trigrams (const char *s,
+                  const char *end,
+                  GArray     *out);
+
+static void
+sort_unique (GArray *array);
+
+static gboolean
+posting_lower_bound (GArray  *posting,
+                     guint32  slot,
+                     guint   *idx_out);
+
+static void
+intersect_sorted (GArray *inout,
+                  GArray *with);
+
+static gint
+cmp_uint32 (const guint32 *a,
+            const guint32 *b);
+
+static gint
+cmp_posting_length (GArray **a,
+                    GArray **b);
+
 static void
 bz_search_engine_dispose (GObject *object)
 {
   BzSearchEngine *self = BZ_SEARCH_ENGINE (object);
 
+  if (self->model != NULL)
+    g_signal_handlers_disconnect_by_func (self->model, model_changed, self);
   if (self->biases != NULL)
     g_signal_handlers_disconnect_by_func (self->biases, biases_changed, self);
+  clear_index (self);
 
   g_clear_object (&self->model);
   g_clear_object (&self->biases);
 
   g_clear_pointer (&self->biases_mirror, g_ptr_array_unref);
+  g_clear_pointer (&self->biases_matcher, g_regex_unref);
+  g_clear_pointer (&self->biases_loose, g_ptr_array_unref);
+  g_clear_pointer (&self->boost_chains, g_hash_table_unref);
+  g_clear_pointer (&self->mirror, g_ptr_array_unref);
+  g_clear_pointer (&self->indexed, g_hash_table_unref);
+  g_clear_pointer (&self->slots, g_ptr_array_unref);
+  g_clear_pointer (&self->free_slots, g_array_unref);
+  g_clear_pointer (&self->trigrams, g_hash_table_unref);
+  g_clear_pointer (&self->ids, g_hash_table_unref);
+  g_clear_pointer (&self->titles, g_hash_table_unref);
+  g_clear_pointer (&self->dirty, g_ptr_array_unref);
 
   G_OBJECT_CLASS (bz_search_engine_parent_class)->dispose (object);
 }
@@ -177,6 +568,9 @@ bz_search_engine_get_property (GObject    *object,
     case PROP_BIASES:
       g_value_set_object (value, bz_search_engine_get_biases (self));
       break;
+    case PROP_MAX_THREADS:
+      g_value_set_uint (value, bz_search_engine_get_max_threads (self));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -198,6 +592,9 @@ bz_search_engine_set_property (GObject      *object,
     case PROP_BIASES:
       bz_search_engine_set_biases (self, g_value_get_object (value));
       break;
+    case PROP_MAX_THREADS:
+      bz_search_engine_set_max_threads (self, g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -226,6 +623,15 @@ bz_search_engine_class_init (BzSearchEngineClass *klass)
           G_TYPE_LIST_MODEL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
 
+  /* How many threads a single query may score on at once, or 0 for one per
+     processor */
+  props[PROP_MAX_THREADS] =
+      g_param_spec_uint (
+          "max-threads",
+          NULL, NULL,
+          0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
   g_object_class_install_properties (object_class, LAST_PROP, props);
 }
 
@@ -233,6 +639,20 @@ static void
 bz_search_engine_init (BzSearchEngine *self)
 {
   self->biases_mirror = g_ptr_array_new_with_free_func (bias_data_unref);
+  self->biases_loose  = g_ptr_array_new_with_free_func (bias_data_unref);
+  self->boost_chains  = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_array_unref);
+
+  self->mirror  = g_ptr_array_new ();
+  self->indexed = g_hash_table_new_full (
+      g_direct_hash, g_direct_equal, NULL, indexed_group_data_unref);
+  self->slots      = g_ptr_array_new ();
+  self->free_slots = g_array_new (FALSE, FALSE, sizeof (guint32));
+  self->trigrams   = g_hash_table_new_full (
+      g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) g_array_unref);
+  self->ids    = g_hash_table_new (g_str_hash, g_str_equal);
+  self->titles = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_array_unref);
+  self->dirty = g_ptr_array_new_with_free_func (indexed_group_data_unref);
 }
 
 BzSearchEngine *
@@ -258,7 +678,13 @@ bz_search_engine_set_biases (BzSearchEngine *self,
   if (self->biases != NULL)
     g_signal_handlers_disconnect_by_func (self->biases, biases_changed, self);
   g_clear_object (&self->biases);
-  g_ptr_array_set_size (self->biases_mirror, 0);
+  /* Queries in flight may still hold on to the old mirror */
+  g_clear_pointer (&self->biases_mirror, g_ptr_array_unref);
+  self->biases_mirror = g_ptr_array_new_with_free_func (bias_data_unref);
+  g_clear_pointer (&self->biases_matcher, g_regex_unref);
+  g_ptr_array_set_size (self->biases_loose, 0);
+  g_clear_pointer (&self->boost_chains, g_hash_table_unref);
+  self->boost_chains = index_bias_boosts (self->biases_mirror);
 
   if (biases != NULL)
     {
@@ -277,6 +703,26 @@ bz_search_engine_set_biases (BzSearchEngine *self,
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_BIASES]);
 }
 
+guint
+bz_search_engine_get_max_threads (BzSearchEngine *self)
+{
+  g_return_val_if_fail (BZ_IS_SEARCH_ENGINE (self), 0);
+  return self->max_threads;
+}
+
+void
+bz_search_engine_set_max_threads (BzSearchEngine *self,
+                                  guint           max_threads)
+{
+  g_return_if_fail (BZ_IS_SEARCH_ENGINE (self));
+
+  if (max_threads == self->max_threads)
+    return;
+
+  self->max_threads = max_threads;
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_MAX_THREADS]);
+}
+
 GListModel *
 bz_search_engine_get_model (BzSearchEngine *self)
 {
@@ -291,21 +737,75 @@ bz_search_engine_set_model (BzSearchEngine *self,
   g_return_if_fail (BZ_IS_SEARCH_ENGINE (self));
   g_return_if_fail (model == NULL || G_IS_LIST_MODEL (model));
 
+  if (self->model != NULL)
+    g_signal_handlers_disconnect_by_func (self->model, model_changed, self);
+  clear_index (self);
   g_clear_object (&self->model);
+
   if (model != NULL)
-    self->model = g_object_ref (model);
+    {
+      guint n_groups = 0;
+
+      self->model = g_object_ref (model);
+
+      n_groups = g_list_model_get_n_items (model);
+      model_changed (self, 0, 0, n_groups, model);
+
+      g_signal_connect_swapped (
+          model, "items-changed",
+          G_CALLBACK (model_changed), self);
+    }
 
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_MODEL]);
 }
 
+/* When `limit` is nonzero, only the best `limit` results are kept.
+   Cancelling `cancellable` makes the workers stop at their next chunk and
+   the future reject with G_IO_ERROR_CANCELLED, so callers should cancel
+   whenever they drop a query they no longer care about */
 DexFuture *
 bz_search_engine_query (BzSearchEngine    *self,
-                        const char *const *terms)
+                        const char *const *terms,
+                        guint              limit,
+                        GCancellable      *cancellable)
+{
+  return bz_search_engine_query_streaming (
+      self, terms, limit, cancellable,
+      NULL, NULL, NULL);
+}
+
+/* Like `bz_search_engine_query`, but large catalogs first get a quick pass
+   over exact id and title matches plus the first few chunks. If that
+   yields anything before the full scan is done, `partial_func` receives it
+   on the main thread, at most once. The ranking of the partial results is
+   provisional; only the future's results are final. `destroy_data` is
+   called on `user_data` from whichever thread drops the query last */
+DexFuture *
+bz_search_engine_query_streaming (BzSearchEngine           *self,
+                                  const char *const        *terms,
+                                  guint                     limit,
+                                  GCancellable             *cancellable,
+                                  BzSearchEnginePartialFunc partial_func,
+                                  gpointer                  user_data,
+                                  GDestroyNotify            destroy_data)
 {
-  guint n_groups = 0;
+  g_autoptr (PartialSinkData) partial_sink = NULL;
+  guint n_groups                           = 0;
+
+  if (partial_func != NULL)
+    {
+      partial_sink               = partial_sink_data_new ();
+      partial_sink->func         = partial_func;
+      partial_sink->user_data    = user_data;
+      partial_sink->destroy_data = destroy_data;
+      partial_sink->cancellable  = bz_object_maybe_ref (cancellable);
+    }
+  else if (destroy_data != NULL)
+    destroy_data (user_data);
 
   dex_return_error_if_fail (BZ_IS_SEARCH_ENGINE (self));
   dex_return_error_if_fail (terms != NULL && *terms != NULL);
+  dex_return_error_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 
   if (self->model != NULL)
     n_groups = g_list_model_get_n_items (self->model);
@@ -314,48 +814,141 @@ bz_search_engine_query (BzSearchEngine    *self,
       n_groups == 0 ||
       **terms == '\0')
     {
-      g_autoptr (GPtrArray) results              = NULL;
+      guint n_results                            = 0;
+      g_autoptr (GPtrArray) groups               = NULL;
+      g_autoptr (GArray) original_indices        = NULL;
+      g_autoptr (GArray) scores                  = NULL;
+      g_autoptr (BzSearchResultList) results     = NULL;
       g_autoptr (BzFinishedSearchQuery) finished = NULL;
 
-      results = g_ptr_array_new_with_free_func (g_object_unref);
-      g_ptr_array_set_size (results, n_groups);
-
-      for (guint i = 0; i < results->len; i++)
-        {
-          g_autoptr (BzEntryGroup) group    = NULL;
-          g_autoptr (BzSearchResult) result = NULL;
+      n_results = limit > 0 ? MIN (limit, n_groups) : n_groups;
 
-          group = g_list_model_get_item (self->model, i);
+      groups           = g_ptr_array_new_full (n_results, g_object_unref);
+      original_indices = g_array_sized_new (FALSE, FALSE, sizeof (guint), n_results);
+      scores           = g_array_sized_new (FALSE, TRUE, sizeof (double), n_results);
+      g_array_set_size (scores, n_results);
 
-          result = bz_search_result_new ();
-          bz_search_result_set_group (result, group);
-          bz_search_result_set_original_index (result, i);
-          g_ptr_array_index (results, i) = g_steal_pointer (&result);
+      for (guint i = 0; i < n_results; i++)
+        {
+          g_ptr_array_add (groups, g_list_model_get_item (self->model, i));
+          g_array_append_val (original_indices, i);
         }
+      results = bz_search_result_list_new (groups, original_indices, scores);
 
       finished = bz_finished_search_query_new ();
       bz_finished_search_query_set_interpreted_query (finished, "");
-      bz_finished_search_query_set_results (finished, results);
-      bz_finished_search_query_set_n_results (finished, n_groups);
+      bz_finished_search_query_set_results (finished, G_LIST_MODEL (results));
+      bz_finished_search_query_set_n_results (finished, n_results);
       bz_finished_search_query_set_elapsed (finished, 0.0);
 
       return dex_future_new_for_object (finished);
     }
   else
     {
-      g_autoptr (GPtrArray) snapshot = NULL;
-      g_autoptr (QueryTaskData) data = NULL;
+      g_autofree char *query_utf8         = NULL;
+      g_autoptr (GPtrArray) active_biases = NULL;
+      g_autoptr (FoldedQueryData) folded  = NULL;
+      g_autoptr (GArray) candidates       = NULL;
+      g_autoptr (GArray) exact            = NULL;
+      g_autoptr (GPtrArray) snapshot      = NULL;
+      g_autoptr (GArray) stale            = NULL;
+      g_autoptr (MatchSetData) match_set  = NULL;
+      g_autoptr (QueryTaskData) data      = NULL;
+
+      /* Indexing a freshly loaded catalog all at once would hold up the
+         keystroke, so only a batch is done here. Whatever is still dirty is
+         scanned linearly instead, see `append_dirty_candidates` */
+      flush_dirty (self, FLUSH_BATCH_SIZE);
+
+      query_utf8    = g_strjoinv (" ", (gchar **) terms);
+      active_biases = resolve_biases (self->biases_mirror, self->biases_matcher, self->biases_loose, &query_utf8);
+      folded        = fold_query (query_utf8);
+
+      /* The user is usually typing, so every query tends to extend the last
+         one. Only pick up the previous results once that query finished */
+      if (self->pending != NULL &&
+          g_atomic_int_get (&self->pending->complete))
+        {
+          g_clear_pointer (&self->refinement, match_set_data_unref);
+          self->refinement = g_steal_pointer (&self->pending);
+        }
+
+      if (self->refinement != NULL &&
+          self->refinement->generation == self->generation &&
+          g_str_has_prefix (query_utf8, self->refinement->query_utf8))
+        candidates = refine_candidates (self, self->refinement, query_utf8, active_biases);
+      else
+        candidates = find_candidates (self, query_utf8, folded, active_biases);
+      if (candidates != NULL)
+        append_dirty_candidates (self, candidates);
+
+      stale    = g_array_new (FALSE, FALSE, sizeof (guint));
+      snapshot = g_ptr_array_new_with_free_func (search_record_data_unref);
+      if (candidates != NULL)
+        {
+          g_ptr_array_set_size (snapshot, candidates->len);
+          for (guint i = 0; i < snapshot->len; i++)
+            {
+              IndexedGroupData *indexed = NULL;
+
+              indexed = g_ptr_array_index (self->mirror, g_array_index (candidates, guint32, i));
+              g_ptr_array_index (snapshot, i) = dup_snapshot_record (indexed, i, stale);
+            }
+        }
+      else
+        {
+          g_ptr_array_set_size (snapshot, self->mirror->len);
+          for (guint i = 0; i < snapshot->len; i++)
+            {
+              IndexedGroupData *indexed = NULL;
+
+              indexed = g_ptr_array_index (self->mirror, i);
+              g_ptr_array_index (snapshot, i) = dup_snapshot_record (indexed, i, stale);
+            }
+        }
+
+      if (partial_sink != NULL)
+        {
+          /* Exact hits are what the user most likely wants, so the partial
+             results include them no matter where they are in the snapshot */
+          exact = g_array_new (FALSE, FALSE, sizeof (guint32));
+          append_exact_candidates (self, query_utf8, exact);
+          sort_unique (exact);
 
-      snapshot = g_ptr_array_new_with_free_func (g_object_unref);
-      g_ptr_array_set_size (snapshot, n_groups);
+          if (candidates != NULL)
+            {
+              guint n_exact = 0;
+
+              for (guint i = 0; i < exact->len; i++)
+                {
+                  guint idx = 0;
 
-      for (guint i = 0; i < snapshot->len; i++)
-        g_ptr_array_index (snapshot, i) = g_list_model_get_item (self->model, i);
+                  if (posting_lower_bound (candidates, g_array_index (exact, guint32, i), &idx))
+                    g_array_index (exact, guint32, n_exact++) = idx;
+                }
+              g_array_set_size (exact, n_exact);
+            }
+        }
 
-      data           = query_task_data_new ();
-      data->terms    = g_strdupv ((gchar **) terms);
-      data->snapshot = g_steal_pointer (&snapshot);
-      data->biases   = g_ptr_array_ref (self->biases_mirror);
+      match_set             = match_set_data_new ();
+      match_set->query_utf8 = g_strdup (query_utf8);
+      match_set->generation = self->generation;
+      g_clear_pointer (&self->pending, match_set_data_unref);
+      self->pending = match_set_data_ref (match_set);
+
+      data                = query_task_data_new ();
+      data->query_utf8    = g_steal_pointer (&query_utf8);
+      data->folded        = g_steal_pointer (&folded);
+      data->snapshot      = g_steal_pointer (&snapshot);
+      data->stale         = g_steal_pointer (&stale);
+      data->indices       = g_steal_pointer (&candidates);
+      data->exact         = g_steal_pointer (&exact);
+      data->boosts        = build_boost_table (self, active_biases);
+      data->match_set     = g_steal_pointer (&match_set);
+      data->limit         = limit;
+      data->max_threads   = self->max_threads > 0 ? self->max_threads : g_get_num_processors ();
+      data->cancellable   = bz_object_maybe_ref (cancellable);
+      data->partial_sink  = g_steal_pointer (&partial_sink);
 
       return dex_scheduler_spawn (
           dex_thread_pool_scheduler_get_default (),
@@ -509,33 +1102,135 @@ biases_changed (BzSearchEngine *self,
 
   g_clear_pointer (&self->biases_mirror, g_ptr_array_unref);
   self->biases_mirror = g_steal_pointer (&new_mirror);
+
+  g_clear_pointer (&self->biases_matcher, g_regex_unref);
+  g_ptr_array_set_size (self->biases_loose, 0);
+  self->biases_matcher = compile_biases_matcher (self->biases_mirror, self->biases_loose);
+
+  g_clear_pointer (&self->boost_chains, g_hash_table_unref);
+  self->boost_chains = index_bias_boosts (self->biases_mirror);
 }
 
-static DexFuture *
-query_task_fiber (QueryTaskData *data)
+/* All bias patterns as alternatives of a single regex. Most queries don't
+   concern any bias, and this rules that out in one pass. Patterns with
+   capture groups can't be combined, since their backreferences would end
+   up pointing at the wrong groups; those are added to `loose` instead, to
+   be tried one by one. If the rest can't be combined either, they all
+   end up in `loose` */
+static GRegex *
+compile_biases_matcher (GPtrArray *biases,
+                        GPtrArray *loose)
 {
-  char     **terms                           = data->terms;
-  GPtrArray *shallow_mirror                  = data->snapshot;
-  GPtrArray *biases                          = data->biases;
-  g_autoptr (GError) local_error             = NULL;
-  gboolean result                            = FALSE;
-  g_autoptr (GTimer) timer                   = NULL;
-  g_autofree char *query_utf8                = NULL;
-  guint            n_sub_tasks               = 0;
-  guint            scores_per_task           = 0;
-  g_autoptr (GPtrArray) active_biases        = NULL;
-  g_autoptr (GPtrArray) sub_futures          = NULL;
-  g_autoptr (GArray) scores                  = NULL;
-  g_autoptr (GPtrArray) results              = NULL;
-  g_autoptr (BzFinishedSearchQuery) finished = NULL;
+  g_autoptr (GString) pattern    = NULL;
+  g_autoptr (GPtrArray) combined = NULL;
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GRegex) matcher     = NULL;
 
-  timer = g_timer_new ();
+  pattern  = g_string_new (NULL);
+  combined = g_ptr_array_new ();
+  for (guint i = 0; i < biases->len; i++)
+    {
+      BiasData *bias = NULL;
+
+      bias = g_ptr_array_index (biases, i);
+      if (bias->invalid)
+        continue;
+      if (g_regex_get_capture_count (bias->regex) > 0)
+        {
+          g_ptr_array_add (loose, bias_data_ref (bias));
+          continue;
+        }
+
+      if (pattern->len > 0)
+        g_string_append_c (pattern, '|');
+      g_string_append_printf (pattern, "(?:%s)", g_regex_get_pattern (bias->regex));
+      g_ptr_array_add (combined, bias);
+    }
+  if (pattern->len == 0)
+    return NULL;
+
+  matcher = g_regex_new (
+      pattern->str,
+      G_REGEX_OPTIMIZE,
+      G_REGEX_MATCH_DEFAULT,
+      &local_error);
+  if (matcher == NULL)
+    {
+      g_debug ("Could not combine search biases, matching them one by one: %s",
+               local_error->message);
+      for (guint i = 0; i < combined->len; i++)
+        g_ptr_array_add (loose, bias_data_ref (g_ptr_array_index (combined, i)));
+    }
+
+  return g_steal_pointer (&matcher);
+}
+
+/* Maps every app id boosted by `biases` to the positions of the biases
+   boosting it, in ascending order. This only changes along with the
+   biases, so queries merely pick the positions they enabled */
+static GHashTable *
+index_bias_boosts (GPtrArray *biases)
+{
+  g_autoptr (GHashTable) chains = NULL;
+
+  chains = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_array_unref);
+  for (guint i = 0; i < biases->len; i++)
+    {
+      BiasData      *bias = NULL;
+      GHashTableIter iter = { 0 };
+
+      bias = g_ptr_array_index (biases, i);
+      if (bias->invalid || bias->boost == NULL)
+        continue;
+
+      g_hash_table_iter_init (&iter, bias->boost);
+      for (;;)
+        {
+          const char *appid = NULL;
+          GArray     *chain = NULL;
+
+          if (!g_hash_table_iter_next (&iter, (gpointer *) &appid, NULL))
+            break;
+
+          chain = g_hash_table_lookup (chains, appid);
+          if (chain == NULL)
+            {
+              chain = g_array_new (FALSE, FALSE, sizeof (guint));
+              g_hash_table_replace (chains, g_strdup (appid), chain);
+            }
+          g_array_append_val (chain, i);
+        }
+    }
+
+  return g_steal_pointer (&chains);
+}
 
-  query_utf8      = g_strjoinv (" ", terms);
-  n_sub_tasks     = MAX (1, MIN (shallow_mirror->len / 512, g_get_num_processors ()));
-  scores_per_task = shallow_mirror->len / n_sub_tasks;
+static GPtrArray *
+resolve_biases (GPtrArray *biases,
+                GRegex    *matcher,
+                GPtrArray *loose,
+                char     **query_utf8)
+{
+  g_autoptr (GPtrArray) active_biases = NULL;
+  gboolean any_match                  = FALSE;
 
   active_biases = g_ptr_array_new_with_free_func (bias_data_unref);
+
+  /* Biases only rewrite the query once one of them matched it, so if none
+     matches the original query, none will match at all. Only the biases
+     which couldn't be combined have to be tried separately for that */
+  any_match = matcher != NULL &&
+              g_regex_match (matcher, *query_utf8, G_REGEX_MATCH_DEFAULT, NULL);
+  for (guint i = 0; !any_match && i < loose->len; i++)
+    {
+      BiasData *bias = NULL;
+
+      bias      = g_ptr_array_index (loose, i);
+      any_match = g_regex_match (bias->regex, *query_utf8, G_REGEX_MATCH_DEFAULT, NULL);
+    }
+  if (!any_match)
+    return g_steal_pointer (&active_biases);
+
   for (guint i = 0; i < biases->len; i++)
     {
       BiasData *bias = NULL;
@@ -544,7 +1239,7 @@ query_task_fiber (QueryTaskData *data)
       if (bias->invalid)
         continue;
 
-      if (!g_regex_match (bias->regex, query_utf8, G_REGEX_MATCH_DEFAULT, NULL))
+      if (!g_regex_match (bias->regex, *query_utf8, G_REGEX_MATCH_DEFAULT, NULL))
         continue;
 
       if (bias->convert_to != NULL)
@@ -552,185 +1247,479 @@ query_task_fiber (QueryTaskData *data)
           g_autofree char *tmp = NULL;
 
           tmp = g_regex_replace (
-              bias->regex, query_utf8,
+              bias->regex, *query_utf8,
               -1, 0, bias->convert_to,
               G_REGEX_MATCH_DEFAULT, NULL);
           if (tmp != NULL)
             {
-              g_clear_pointer (&query_utf8, g_free);
-              query_utf8 = g_steal_pointer (&tmp);
+              g_clear_pointer (query_utf8, g_free);
+              *query_utf8 = g_steal_pointer (&tmp);
             }
         }
 
       g_ptr_array_add (active_biases, bias_data_ref (bias));
     }
 
-  sub_futures = g_ptr_array_new_with_free_func (dex_unref);
-  for (guint i = 0; i < n_sub_tasks; i++)
-    {
-      g_autoptr (QuerySubTaskData) sub_data = NULL;
-      g_autoptr (DexFuture) future          = NULL;
+  return g_steal_pointer (&active_biases);
+}
 
-      sub_data                 = query_sub_task_data_new ();
-      sub_data->query_utf8     = g_strdup (query_utf8);
-      sub_data->shallow_mirror = g_ptr_array_ref (shallow_mirror);
-      sub_data->threshold      = 1.0;
-      sub_data->work_offset    = i * scores_per_task;
-      sub_data->work_length    = scores_per_task;
-      sub_data->active_biases  = g_ptr_array_ref (active_biases);
+static DexFuture *
+query_task_fiber (QueryTaskData *data)
+{
+  char            *query_utf8                = data->query_utf8;
+  FoldedQueryData *folded                    = data->folded;
+  GPtrArray       *shallow_mirror            = data->snapshot;
+  GArray    *indices                         = data->indices;
+  MatchSetData *match_set                    = data->match_set;
+  guint         limit                        = data->limit;
+  GCancellable *cancellable                  = data->cancellable;
+  g_autoptr (GError) local_error             = NULL;
+  gboolean result                            = FALSE;
+  g_autoptr (GTimer) timer                   = NULL;
+  g_autoptr (ScanJobData) job                = NULL;
+  guint n_workers                            = 0;
+  g_autoptr (GPtrArray) buffers              = NULL;
+  g_autoptr (GPtrArray) sub_futures          = NULL;
+  g_autoptr (DexFuture) all                  = NULL;
+  g_autoptr (GArray) scores                  = NULL;
+  g_autoptr (GArray) matched                 = NULL;
+  g_autoptr (BzFinishedSearchQuery) finished = NULL;
 
-      if (i >= n_sub_tasks - 1)
-        sub_data->work_length += shallow_mirror->len % n_sub_tasks;
+  timer = g_timer_new ();
 
-      future = dex_scheduler_spawn (
-          dex_thread_pool_scheduler_get_default (),
-          bz_get_dex_stack_size (),
-          (DexFiberFunc) query_sub_task_fiber,
-          query_sub_task_data_ref (sub_data),
-          query_sub_task_data_unref);
+  /* These groups weren't indexed yet when the query was made, so their
+     records are built here rather than on the main thread */
+  for (guint i = 0; i < data->stale->len; i++)
+    {
+      g_autoptr (GMutexLocker) locker = NULL;
+      guint             idx           = 0;
+      SearchRecordData *record        = NULL;
+
+      idx    = g_array_index (data->stale, guint, i);
+      record = g_ptr_array_index (shallow_mirror, idx);
+      locker = bz_entry_group_lock (record->group);
 
-      g_ptr_array_add (sub_futures, g_steal_pointer (&future));
+      g_ptr_array_index (shallow_mirror, idx) = build_search_record (record->group);
+      search_record_data_unref (record);
     }
 
-  result = dex_await (dex_future_allv (
-                          (DexFuture *const *) sub_futures->pdata, sub_futures->len),
-                      &local_error);
-  if (!result)
-    return dex_future_new_for_error (g_steal_pointer (&local_error));
+  job                 = scan_job_data_new ();
+  job->query_utf8     = g_strdup (query_utf8);
+  job->folded         = folded_query_data_ref (folded);
+  job->shallow_mirror = g_ptr_array_ref (shallow_mirror);
+  job->threshold      = 1.0;
+  job->boosts         = bz_maybe_ref (data->boosts, boost_table_data_ref);
+  job->cancellable    = bz_object_maybe_ref (cancellable);
+  job->n_chunks       = (shallow_mirror->len + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  job->spans          = g_new0 (ChunkSpan, job->n_chunks);
+
+  n_workers = MAX (1, MIN (job->n_chunks, data->max_threads));
+  buffers   = g_ptr_array_new_with_free_func ((GDestroyNotify) release_score_buffer);
+  for (guint i = 0; i < n_workers; i++)
+    g_ptr_array_add (buffers, acquire_score_buffer ());
+
+  /* Only worth it if the first round of chunks is a small part of the
+     whole scan; otherwise the final results are just as close */
+  if (data->partial_sink != NULL &&
+      job->n_chunks > n_workers * 4)
+    {
+      job->n_priority_chunks = n_workers;
+      job->priority_scores   = g_new (Score, job->n_priority_chunks * CHUNK_SIZE);
+      job->priority_done     = dex_promise_new ();
+    }
 
-  scores = g_array_new (FALSE, FALSE, sizeof (Score));
-  for (guint i = 0; i < sub_futures->len; i++)
+  if (n_workers == 1)
+    /* Not worth a round trip through the thread pool */
+    scan_chunks (job, 0, g_ptr_array_index (buffers, 0));
+  else
     {
-      DexFuture *future     = NULL;
-      GArray    *scores_out = NULL;
+      sub_futures = g_ptr_array_new_with_free_func (dex_unref);
+      for (guint i = 0; i < n_workers; i++)
+        {
+          g_autoptr (QuerySubTaskData) sub_data = NULL;
+          g_autoptr (DexFuture) future          = NULL;
+
+          sub_data             = query_sub_task_data_new ();
+          sub_data->job        = scan_job_data_ref (job);
+          sub_data->worker     = i;
+          sub_data->scores_out = g_array_ref (g_ptr_array_index (buffers, i));
+
+          future = dex_scheduler_spawn (
+              dex_thread_pool_scheduler_get_default (),
+              bz_get_dex_stack_size (),
+              (DexFiberFunc) query_sub_task_fiber,
+              query_sub_task_data_ref (sub_data),
+              query_sub_task_data_unref);
+
+          g_ptr_array_add (sub_futures, g_steal_pointer (&future));
+        }
+      all = dex_future_allv (
+          (DexFuture *const *) sub_futures->pdata, sub_futures->len);
 
-      future     = g_ptr_array_index (sub_futures, i);
-      scores_out = g_value_get_boxed (dex_future_get_value (future, NULL));
+      if (job->priority_done != NULL)
+        {
+          /* Workers which stop early never finish their priority chunk, so
+             don't wait on the promise alone */
+          dex_await (dex_future_first (
+                         dex_ref (job->priority_done),
+                         dex_ref (all),
+                         NULL),
+                     NULL);
+          if (dex_future_is_pending (all) &&
+              !g_cancellable_is_cancelled (cancellable))
+            publish_partial (data, job, timer);
+        }
 
-      if (scores_out->len > 0)
-        g_array_append_vals (scores, scores_out->data, scores_out->len);
+      result = dex_await (g_steal_pointer (&all), &local_error);
+      if (!result)
+        return dex_future_new_for_error (g_steal_pointer (&local_error));
     }
-  if (scores->len > 0)
-    g_array_sort (scores, (GCompareFunc) cmp_scores);
 
-  results = g_ptr_array_new_with_free_func (g_object_unref);
-  g_ptr_array_set_size (results, scores->len);
-  for (guint i = 0; i < scores->len; i++)
+  if (data->partial_sink != NULL)
+    g_atomic_int_set (&data->partial_sink->superseded, TRUE);
+
+  if (g_cancellable_is_cancelled (cancellable))
+    return dex_future_new_reject (
+        G_IO_ERROR, G_IO_ERROR_CANCELLED,
+        "Search query was cancelled");
+
+  /* Walking the chunks in order restores the original record order */
+  scores  = g_array_new (FALSE, FALSE, sizeof (Score));
+  matched = g_array_new (FALSE, FALSE, sizeof (guint32));
+  for (guint i = 0; i < job->n_chunks; i++)
     {
-      Score        *score                      = NULL;
-      BzEntryGroup *group                      = NULL;
-      g_autoptr (BzSearchResult) search_result = NULL;
+      ChunkSpan *span       = NULL;
+      Score     *span_start = NULL;
 
-      score = &g_array_index (scores, Score, i);
-      group = g_ptr_array_index (shallow_mirror, score->idx);
+      span = &job->spans[i];
+      if (span->worker == PRIORITY_WORKER)
+        span_start = job->priority_scores + span->offset;
+      else
+        span_start = &g_array_index (g_ptr_array_index (buffers, span->worker), Score, span->offset);
 
-      search_result = bz_search_result_new ();
-      bz_search_result_set_group (search_result, group);
-      bz_search_result_set_original_index (search_result, score->idx);
-      bz_search_result_set_score (search_result, score->val);
+      for (guint j = 0; j < span->length; j++)
+        {
+          Score  *score    = NULL;
+          guint32 position = 0;
 
-      g_ptr_array_index (results, i) = g_steal_pointer (&search_result);
+          score = &span_start[j];
+          if (score->matched)
+            {
+              position = indices != NULL
+                             ? g_array_index (indices, guint32, score->idx)
+                             : score->idx;
+              g_array_append_val (matched, position);
+            }
+          if (score->accepted)
+            g_array_append_val (scores, *score);
+        }
     }
 
-  finished = bz_finished_search_query_new ();
-  bz_finished_search_query_set_interpreted_query (finished, query_utf8);
-  bz_finished_search_query_set_results (finished, results);
-  bz_finished_search_query_set_n_results (finished, results->len);
-  bz_finished_search_query_set_elapsed (finished, g_timer_elapsed (timer, NULL));
+  /* Chunks cover ascending ranges, so this is already sorted */
+  match_set->matched = g_steal_pointer (&matched);
+  g_atomic_int_set (&match_set->complete, TRUE);
 
+  if (limit > 0 && scores->len > limit)
+    select_top_scores (scores, limit);
+
+  finished = build_finished_query (data, scores, g_timer_elapsed (timer, NULL));
   return dex_future_new_for_object (finished);
 }
 
-static DexFuture *
-query_sub_task_fiber (QuerySubTaskData *data)
+/* Sorts `scores` in place and wraps them up. Result objects are only
+   created once the UI asks for them */
+static BzFinishedSearchQuery *
+build_finished_query (QueryTaskData *data,
+                      GArray        *scores,
+                      double         elapsed)
 {
-  GPtrArray *shallow_mirror     = data->shallow_mirror;
-  char      *query_utf8         = data->query_utf8;
-  double     threshold          = data->threshold;
-  guint      work_offset        = data->work_offset;
-  guint      work_length        = data->work_length;
-  GPtrArray *active_biases      = data->active_biases;
-  g_autoptr (GArray) scores_out = NULL;
+  GPtrArray *shallow_mirror                  = data->snapshot;
+  GArray    *indices                         = data->indices;
+  g_autoptr (GPtrArray) groups               = NULL;
+  g_autoptr (GArray) original_indices        = NULL;
+  g_autoptr (GArray) values                  = NULL;
+  g_autoptr (BzSearchResultList) results     = NULL;
+  g_autoptr (BzFinishedSearchQuery) finished = NULL;
 
-  scores_out = g_array_new (FALSE, FALSE, sizeof (Score));
+  if (scores->len > 0)
+    g_array_sort (scores, (GCompareFunc) cmp_scores);
 
-  for (guint i = 0; i < work_length; i++)
+  groups           = g_ptr_array_new_full (scores->len, g_object_unref);
+  original_indices = g_array_sized_new (FALSE, FALSE, sizeof (guint), scores->len);
+  values           = g_array_sized_new (FALSE, FALSE, sizeof (double), scores->len);
+  for (guint i = 0; i < scores->len; i++)
     {
-      g_autoptr (GMutexLocker) locker = NULL;
-      BzEntryGroup *group             = NULL;
-      const char   *id                = NULL;
-      const char   *title             = NULL;
-      double        score             = 0.0;
+      Score            *score          = NULL;
+      SearchRecordData *record         = NULL;
+      guint             original_index = 0;
+
+      score          = &g_array_index (scores, Score, i);
+      record         = g_ptr_array_index (shallow_mirror, score->idx);
+      original_index = indices != NULL
+                           ? g_array_index (indices, guint32, score->idx)
+                           : score->idx;
+
+      g_ptr_array_add (groups, g_object_ref (record->group));
+      g_array_append_val (original_indices, original_index);
+      g_array_append_val (values, score->val);
+    }
+  results = bz_search_result_list_new (groups, original_indices, values);
 
-      group  = g_ptr_array_index (shallow_mirror, work_offset + i);
-      locker = bz_entry_group_lock (group);
+  finished = bz_finished_search_query_new ();
+  bz_finished_search_query_set_interpreted_query (finished, data->query_utf8);
+  bz_finished_search_query_set_results (finished, G_LIST_MODEL (results));
+  bz_finished_search_query_set_n_results (finished, scores->len);
+  bz_finished_search_query_set_elapsed (finished, elapsed);
 
-      if (!bz_entry_group_is_searchable (group))
-        continue;
+  return g_steal_pointer (&finished);
+}
 
-      id    = bz_entry_group_get_id (group);
-      title = bz_entry_group_get_title (group);
-      if ((id != NULL && g_strcmp0 (query_utf8, id) == 0) ||
-          (title != NULL && strcasecmp (query_utf8, title) == 0))
-        score = (double) G_MAXINT;
-      else
+/* Called once the priority chunks are in, while the other chunks are still
+   being scored. Exact hits outside of the priority range are scored here
+   directly, which costs next to nothing */
+static void
+publish_partial (QueryTaskData *data,
+                 ScanJobData   *job,
+                 GTimer        *timer)
+{
+  PartialSinkData *sink         = data->partial_sink;
+  guint            priority_end = 0;
+  g_autoptr (GArray) scores     = NULL;
+
+  priority_end = job->n_priority_chunks * CHUNK_SIZE;
+  scores       = g_array_new (FALSE, FALSE, sizeof (Score));
+
+  if (data->exact != NULL)
+    {
+      for (guint i = 0; i < data->exact->len; i++)
         {
-          const char *developer     = NULL;
-          const char *description   = NULL;
-          const char *search_tokens = NULL;
+          guint idx    = 0;
+          Score append = { 0 };
 
-          developer     = bz_entry_group_get_developer (group);
-          description   = bz_entry_group_get_description (group);
-          search_tokens = bz_entry_group_get_search_tokens (group);
+          idx = g_array_index (data->exact, guint32, i);
+          if (idx >= priority_end &&
+              score_record (job, idx, &append) &&
+              append.accepted)
+            g_array_append_val (scores, append);
+        }
+    }
 
-#define EVALUATE_STRING(_s, _accept_min_size)                  \
-  ((_s) != NULL                                                \
-       ? (test_strings (query_utf8, (_s), (_accept_min_size))) \
-       : 0.0)
+  for (guint i = 0; i < job->n_priority_chunks; i++)
+    {
+      ChunkSpan *span = NULL;
 
-          score += EVALUATE_STRING (title, 2) * 2.0;
-          score += EVALUATE_STRING (developer, 2) * 1.0;
-          score += EVALUATE_STRING (description, 3) * 1.0;
-          score += EVALUATE_STRING (search_tokens, -1) * 1.5;
+      span = &job->spans[i];
+      for (guint j = 0; j < span->length; j++)
+        {
+          Score *score = NULL;
 
-#undef EVALUATE_STRING
+          score = &job->priority_scores[span->offset + j];
+          if (score->accepted)
+            g_array_append_val (scores, *score);
         }
+    }
+
+  if (scores->len == 0)
+    return;
+  if (data->limit > 0 && scores->len > data->limit)
+    select_top_scores (scores, data->limit);
+
+  sink->partial = build_finished_query (data, scores, g_timer_elapsed (timer, NULL));
+  g_idle_add_full (
+      G_PRIORITY_DEFAULT,
+      (GSourceFunc) deliver_partial,
+      partial_sink_data_ref (sink),
+      partial_sink_data_unref);
+}
+
+static gboolean
+deliver_partial (PartialSinkData *sink)
+{
+  /* The final results might have made it to the main thread first */
+  if (!g_atomic_int_get (&sink->superseded) &&
+      !g_cancellable_is_cancelled (sink->cancellable))
+    sink->func (sink->partial, sink->user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static DexFuture *
+query_sub_task_fiber (QuerySubTaskData *data)
+{
+  scan_chunks (data->job, data->worker, data->scores_out);
+  return dex_future_new_true ();
+}
+
+static void
+scan_chunks (ScanJobData *job,
+             guint        worker,
+             GArray      *scores_out)
+{
+  GPtrArray *shallow_mirror = job->shallow_mirror;
+
+  for (;;)
+    {
+      guint      chunk       = 0;
+      ChunkSpan *span        = NULL;
+      guint      work_offset = 0;
+      guint      work_length = 0;
+
+      /* Checked once per chunk, which keeps an abandoned query from holding
+         on to the thread pool for more than a fraction of a millisecond */
+      if (g_cancellable_is_cancelled (job->cancellable))
+        break;
 
-      for (guint j = 0; j < active_biases->len; j++)
+      chunk = (guint) g_atomic_int_add (&job->cursor, 1);
+      if (chunk >= job->n_chunks)
+        break;
+
+      work_offset = chunk * CHUNK_SIZE;
+      work_length = MIN (CHUNK_SIZE, shallow_mirror->len - work_offset);
+      span        = &job->spans[chunk];
+
+      if (chunk < job->n_priority_chunks)
         {
-          BiasData *bias = NULL;
+          span->worker = PRIORITY_WORKER;
+          span->offset = work_offset;
 
-          bias = g_ptr_array_index (active_biases, j);
-          if (bias->boost == NULL)
-            continue;
+          for (guint i = 0; i < work_length; i++)
+            {
+              if (score_record (job, work_offset + i, &job->priority_scores[span->offset + span->length]))
+                span->length++;
+            }
 
-          if (!g_hash_table_contains (bias->boost, id))
-            continue;
+          if (g_atomic_int_add (&job->n_priority_done, 1) + 1 == (int) job->n_priority_chunks)
+            dex_promise_resolve_boolean (job->priority_done, TRUE);
+        }
+      else
+        {
+          span->worker = worker;
+          span->offset = scores_out->len;
 
-          switch (bias->boost_kind)
+          for (guint i = 0; i < work_length; i++)
             {
-            case LINEAR:
-              score = bias->linear_boost.slope * score + bias->linear_boost.y_intercept;
-              break;
-            case EXPONENTIAL:
-              score = pow (bias->exponential_boost.factor, score) * bias->exponential_boost.y_intercept;
-              break;
-            default:
-              break;
+              Score append = { 0 };
+
+              if (score_record (job, work_offset + i, &append))
+                g_array_append_val (scores_out, append);
             }
+
+          span->length = scores_out->len - span->offset;
         }
+    }
+}
 
-      if (score > threshold)
-        {
-          Score append = { 0 };
+/* Returns whether `out` should be kept, either because it passed the
+   threshold or because its text matched and refinement needs to know */
+static inline gboolean
+score_record (ScanJobData *job,
+              guint        idx,
+              Score       *out)
+{
+  char             *query_utf8 = job->query_utf8;
+  FoldedQueryData  *folded     = job->folded;
+  double            threshold  = job->threshold;
+  SearchRecordData *record     = NULL;
+  const char       *id         = NULL;
+  double            score      = 0.0;
+  gboolean          matched    = FALSE;
+  GArray           *chain      = NULL;
+
+  record = g_ptr_array_index (job->shallow_mirror, idx);
+  if (!record->searchable)
+    return FALSE;
+
+  id = record->id;
+  if ((id != NULL && g_strcmp0 (query_utf8, id) == 0) ||
+      (record->title != NULL && strcasecmp (query_utf8, record->title) == 0))
+    score = (double) G_MAXINT;
+  else
+    {
+#define EVALUATE_FIELD(_field, _accept_min_size)                 \
+  (test_tokens (folded->text, folded->tokens, folded->n_tokens,  \
+                record->text,                                    \
+                record->tokens + record->field_tokens[(_field)], \
+                record->field_tokens[(_field) + 1] -             \
+                    record->field_tokens[(_field)],              \
+                (_accept_min_size)))
+
+      score += EVALUATE_FIELD (FIELD_TITLE, 2) * 2.0;
+      score += EVALUATE_FIELD (FIELD_DEVELOPER, 2) * 1.0;
+      score += EVALUATE_FIELD (FIELD_DESCRIPTION, 3) * 1.0;
+      score += EVALUATE_FIELD (FIELD_SEARCH_TOKENS, -1) * 1.5;
+
+#undef EVALUATE_FIELD
+    }
+  matched = score != 0.0;
+
+  if (job->boosts != NULL && id != NULL)
+    chain = g_hash_table_lookup (job->boosts->chains, id);
+
+  for (guint j = 0; chain != NULL && j < chain->len; j++)
+    {
+      guint     position = 0;
+      BiasData *bias     = NULL;
+
+      position = g_array_index (chain, guint, j);
+      if (!job->boosts->active[position])
+        continue;
 
-          append.idx = work_offset + i;
-          append.val = score;
-          g_array_append_val (scores_out, append);
+      bias = g_ptr_array_index (job->boosts->biases, position);
+      switch (bias->boost_kind)
+        {
+        case LINEAR:
+          score = bias->linear_boost.slope * score + bias->linear_boost.y_intercept;
+          break;
+        case EXPONENTIAL:
+          score = pow (bias->exponential_boost.factor, score) * bias->exponential_boost.y_intercept;
+          break;
+        default:
+          break;
         }
     }
 
-  return dex_future_new_take_boxed (G_TYPE_ARRAY, g_steal_pointer (&scores_out));
+  out->idx      = idx;
+  out->val      = score;
+  out->accepted = score > threshold;
+  out->matched  = matched;
+
+  return out->accepted || matched;
+}
+
+/* Score buffers are kept around between queries, since they are refilled
+   on every keystroke */
+static GArray *
+acquire_score_buffer (void)
+{
+  GArray *buffer = NULL;
+
+  g_mutex_lock (&score_buffers_mutex);
+  if (score_buffers != NULL && score_buffers->len > 0)
+    buffer = g_ptr_array_steal_index_fast (score_buffers, score_buffers->len - 1);
+  g_mutex_unlock (&score_buffers_mutex);
+
+  if (buffer == NULL)
+    buffer = g_array_sized_new (FALSE, FALSE, sizeof (Score), CHUNK_SIZE);
+  return buffer;
+}
+
+static void
+release_score_buffer (GArray *buffer)
+{
+  g_array_set_size (buffer, 0);
+
+  g_mutex_lock (&score_buffers_mutex);
+  if (score_buffers == NULL)
+    score_buffers = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+  if (score_buffers->len < 2 * g_get_num_processors ())
+    {
+      g_ptr_array_add (score_buffers, buffer);
+      buffer = NULL;
+    }
+  g_mutex_unlock (&score_buffers_mutex);
+
+  if (buffer != NULL)
+    g_array_unref (buffer);
 }
 
 #define UTF8_FOREACH_FORWARD(_var, _s) \
@@ -754,74 +1743,76 @@ query_sub_task_fiber (QuerySubTaskData *data)
        _start_var = _end_var, _end_var = utf8_skip_to_next_of_class (&_start_var, G_UNICODE_SPACE_SEPARATOR, (_token_len)))
 
 static double
-test_strings (const char *query,
-              const char *against,
-              gssize      accept_min_size)
+test_tokens (const char  *query,
+             const Token *query_tokens,
+             guint        n_query_tokens,
+             const char  *against,
+             const Token *against_tokens,
+             guint        n_against_tokens,
+             gssize       accept_min_size)
 {
-  double score                = 0.0;
-  gsize  query_tok_utf8_len   = 0;
-  gsize  against_tok_utf8_len = 0;
-
-  UTF8_FOREACH_TOKEN_FORWARDS (query_tok_start, query_tok_end, query, &query_tok_utf8_len)
-  {
-    gboolean query_token_has_match = FALSE;
-
-    UTF8_FOREACH_TOKEN_FORWARDS (against_tok_start, against_tok_end, against, &against_tok_utf8_len)
+  double       score      = 0.0;
+  const char  *field      = NULL;
+  const char  *field_end  = NULL;
+  const Token *last_token = NULL;
+
+  if (n_query_tokens == 0 || n_against_tokens == 0)
+    return 0.0;
+
+  /* The tokens of a field are laid out back to back in `against`, only
+     separated by spaces, which query tokens never contain. So instead of
+     trying every token on its own, the whole field is scanned at once and
+     each hit is attributed to the token it landed in */
+  last_token = &against_tokens[n_against_tokens - 1];
+  field      = against + against_tokens[0].offset;
+  field_end  = against + last_token->offset + last_token->n_bytes;
+
+  for (guint i = 0; i < n_query_tokens; i++)
     {
-      gboolean match    = FALSE;
-      gsize    consumed = 0;
-
-      if (accept_min_size > 0 &&
-          against_tok_utf8_len < accept_min_size)
-        continue;
-
-      UTF8_FOREACH_FORWARD_WITH_END (against_ptr, against_tok_start, against_tok_end)
-      {
-        const char *against_check_ptr = NULL;
-        gunichar    against_ch        = 0;
-
-        if (query_tok_utf8_len > against_tok_utf8_len - consumed)
-          break;
+      const Token *query_tok             = &query_tokens[i];
+      const char  *query_tok_start       = query + query_tok->offset;
+      gboolean     query_token_has_match = FALSE;
+      const char  *cursor                = field;
+      guint        j                     = 0;
 
-        match = TRUE;
-
-        against_check_ptr = against_ptr;
-        against_ch        = g_unichar_tolower (g_utf8_get_char (against_ptr));
-        UTF8_FOREACH_FORWARD_WITH_END (query_ptr, query_tok_start, query_tok_end)
+      while (cursor < field_end)
         {
-          gunichar query_ch = 0;
+          const char  *hit         = NULL;
+          const Token *against_tok = NULL;
+          const char  *against_end = NULL;
+
+          hit = bz_find_substring (
+              cursor, field_end - cursor,
+              query_tok_start, query_tok->n_bytes);
+          if (hit == NULL)
+            break;
 
-          query_ch = g_unichar_tolower (g_utf8_get_char (query_ptr));
-          if (against_ch != query_ch)
+          for (;;)
             {
-              match = FALSE;
-              break;
+              against_tok = &against_tokens[j];
+              against_end = against + against_tok->offset + against_tok->n_bytes;
+              if (hit < against_end)
+                break;
+              j++;
             }
 
-          against_check_ptr = g_utf8_next_char (against_check_ptr);
-          against_ch        = g_unichar_tolower (g_utf8_get_char (against_check_ptr));
+          /* Each token counts once, no matter how often it matches */
+          if (accept_min_size <= 0 ||
+              against_tok->n_chars >= accept_min_size)
+            {
+              score += (double) ((gsize) query_tok->n_chars * query_tok->n_chars) / (double) against_tok->n_chars;
+              query_token_has_match = TRUE;
+            }
+          cursor = against_end;
         }
 
-        if (match)
-          break;
-        else
-          consumed++;
-      }
-
-      if (match)
+      if (!query_token_has_match)
         {
-          score += (double) (query_tok_utf8_len * query_tok_utf8_len) / (double) against_tok_utf8_len;
-          query_token_has_match = TRUE;
+          score = 0.0;
+          break;
         }
     }
 
-    if (!query_token_has_match)
-      {
-        score = 0.0;
-        break;
-      }
-  }
-
   return score;
 }
 
@@ -879,4 +1870,845 @@ cmp_scores (Score *a,
   return (b->val - a->val < 0.0) ? -1 : 1;
 }
 
+/* Partially orders `scores` so that it only holds the best `limit` of
+   them, in no particular order, without sorting everything. The first
+   `limit` elements are kept as a heap with the worst score at the root */
+static void
+select_top_scores (GArray *scores,
+                   guint   limit)
+{
+  Score *heap = (Score *) scores->data;
+
+#define SIFT_DOWN(_root)                                       \
+  G_STMT_START                                                 \
+  {                                                            \
+    guint _parent = (_root);                                   \
+                                                               \
+    for (;;)                                                   \
+      {                                                        \
+        guint _worst = _parent;                                \
+        guint _left  = 2 * _parent + 1;                        \
+        guint _right = 2 * _parent + 2;                        \
+        Score _tmp   = { 0 };                                  \
+                                                               \
+        if (_left < limit &&                                   \
+            score_is_better (&heap[_worst], &heap[_left]))     \
+          _worst = _left;                                      \
+        if (_right < limit &&                                  \
+            score_is_better (&heap[_worst], &heap[_right]))    \
+          _worst = _right;                                     \
+        if (_worst == _parent)                                 \
+          break;                                               \
+                                                               \
+        _tmp          = heap[_parent];                         \
+        heap[_parent] = heap[_worst];                          \
+        heap[_worst]  = _tmp;                                  \
+        _parent       = _worst;                                \
+      }                                                        \
+  }                                                            \
+  G_STMT_END
+
+  for (guint i = limit / 2; i > 0; i--)
+    SIFT_DOWN (i - 1);
+
+  for (guint i = limit; i < scores->len; i++)
+    {
+      if (score_is_better (&heap[i], &heap[0]))
+        {
+          heap[0] = heap[i];
+          SIFT_DOWN (0);
+        }
+    }
+
+#undef SIFT_DOWN
+
+  g_array_set_size (scores, limit);
+}
+
+/* Ties are broken by position so the selection is deterministic */
+static inline gboolean
+score_is_better (const Score *a,
+                 const Score *b)
+{
+  return a->val > b->val || (a->val == b->val && a->idx < b->idx);
+}
+
+static void
+model_changed (BzSearchEngine *self,
+               guint           position,
+               guint           removed,
+               guint           added,
+               GListModel     *model)
+{
+  g_autoptr (GPtrArray) removed_groups = NULL;
+  guint old_length                     = 0;
+
+  self->generation++;
+
+  removed_groups = g_ptr_array_new ();
+  for (guint i = 0; i < removed; i++)
+    {
+      IndexedGroupData *data = NULL;
+
+      data = g_ptr_array_index (self->mirror, position + i);
+      data->n_positions--;
+      g_ptr_array_add (removed_groups, data);
+    }
+  g_ptr_array_remove_range (self->mirror, position, removed);
+
+  old_length = self->mirror->len;
+  g_ptr_array_set_size (self->mirror, old_length + added);
+  memmove (self->mirror->pdata + position + added,
+           self->mirror->pdata + position,
+           (old_length - position) * sizeof (gpointer));
+
+  /* Groups which are removed and re-added in the same emission, which
+     happens a lot when the filter is invalidated, keep their index data */
+  for (guint i = 0; i < added; i++)
+    {
+      g_autoptr (BzEntryGroup) group = NULL;
+      IndexedGroupData *data         = NULL;
+
+      group = g_list_model_get_item (model, position + i);
+      data  = g_hash_table_lookup (self->indexed, group);
+      if (data == NULL)
+        data = track_group (self, group);
+
+      data->n_positions++;
+      g_ptr_array_index (self->mirror, position + i) = data;
+    }
+
+  for (guint i = position; i < self->mirror->len; i++)
+    {
+      IndexedGroupData *data = NULL;
+
+      data           = g_ptr_array_index (self->mirror, i);
+      data->position = i;
+    }
+
+  for (guint i = 0; i < removed_groups->len; i++)
+    {
+      IndexedGroupData *data = NULL;
+
+      data = g_ptr_array_index (removed_groups, i);
+      if (data->n_positions == 0)
+        untrack_group (self, data);
+    }
+}
+
+static void
+group_notify (BzSearchEngine *self,
+              GParamSpec     *pspec,
+              BzEntryGroup   *group)
+{
+  const char *const searchable_props[] = {
+    "id",
+    "title",
+    "developer",
+    "description",
+    "search-tokens",
+    "searchable",
+  };
+  IndexedGroupData *data = NULL;
+
+  /* The group's mutex is held during most notifications, so just mark the
+     group and read the new values later */
+  for (guint i = 0; i < G_N_ELEMENTS (searchable_props); i++)
+    {
+      if (g_strcmp0 (pspec->name, searchable_props[i]) != 0)
+        continue;
+
+      data = g_hash_table_lookup (self->indexed, group);
+      if (data != NULL)
+        invalidate_group (self, data);
+      break;
+    }
+}
+
+static IndexedGroupData *
+track_group (BzSearchEngine *self,
+             BzEntryGroup   *group)
+{
+  g_autoptr (IndexedGroupData) data = NULL;
+
+  data        = indexed_group_data_new ();
+  data->group = g_object_ref (group);
+
+  if (self->free_slots->len > 0)
+    {
+      data->slot = g_array_index (self->free_slots, guint32, self->free_slots->len - 1);
+      g_array_set_size (self->free_slots, self->free_slots->len - 1);
+      g_ptr_array_index (self->slots, data->slot) = data;
+    }
+  else
+    {
+      data->slot = self->slots->len;
+      g_ptr_array_add (self->slots, data);
+    }
+
+  data->notify_handler = g_signal_connect_swapped (
+      group, "notify",
+      G_CALLBACK (group_notify), self);
+
+  g_hash_table_replace (self->indexed, group, indexed_group_data_ref (data));
+  invalidate_group (self, data);
+
+  return data;
+}
+
+static void
+untrack_group (BzSearchEngine   *self,
+               IndexedGroupData *data)
+{
+  g_clear_signal_handler (&data->notify_handler, data->group);
+  unindex_group (self, data);
+
+  g_ptr_array_index (self->slots, data->slot) = NULL;
+  g_array_append_val (self->free_slots, data->slot);
+
+  g_hash_table_remove (self->indexed, data->group);
+}
+
+static void
+invalidate_group (BzSearchEngine   *self,
+                  IndexedGroupData *data)
+{
+  self->generation++;
+
+  if (!data->dirty)
+    {
+      data->dirty = TRUE;
+      g_ptr_array_add (self->dirty, indexed_group_data_ref (data));
+    }
+
+  if (self->flush_source == 0)
+    self->flush_source = g_idle_add_full (
+        G_PRIORITY_LOW,
+        (GSourceFunc) flush_idle,
+        self, NULL);
+}
+
+static void
+index_group (BzSearchEngine   *self,
+             IndexedGroupData *data)
+{
+  g_autoptr (SearchRecordData) record = NULL;
+  g_autoptr (GArray) trigrams         = NULL;
+  guint n_tokens                      = 0;
+
+  unindex_group (self, data);
+
+  record   = build_search_record (data->group);
+  n_tokens = record->field_tokens[N_FIELDS];
+
+  trigrams = g_array_new (FALSE, FALSE, sizeof (guint32));
+  for (guint i = 0; i < n_tokens; i++)
+    {
+      const Token *token = &record->tokens[i];
+
+      if (token->n_chars >= TRIGRAM_LEN)
+        collect_trigrams (
+            record->text + token->offset,
+            record->text + token->offset + token->n_bytes,
+            trigrams);
+    }
+  sort_unique (trigrams);
+
+  for (guint i = 0; i < trigrams->len; i++)
+    {
+      guint32 trigram = 0;
+      GArray *posting = NULL;
+      guint   idx     = 0;
+
+      trigram = g_array_index (trigrams, guint32, i);
+      posting = g_hash_table_lookup (self->trigrams, GUINT_TO_POINTER (trigram));
+      if (posting == NULL)
+        {
+          posting = g_array_new (FALSE, FALSE, sizeof (guint32));
+          g_hash_table_replace (self->trigrams, GUINT_TO_POINTER (trigram), posting);
+        }
+
+      if (!posting_lower_bound (posting, data->slot, &idx))
+        g_array_insert_val (posting, idx, data->slot);
+    }
+  data->trigrams = g_steal_pointer (&trigrams);
+
+  if (record->id != NULL)
+    g_hash_table_replace (self->ids, (gpointer) record->id, data);
+  if (record->title != NULL)
+    {
+      g_autofree char *key    = NULL;
+      GArray          *bucket = NULL;
+
+      key    = g_ascii_strdown (record->title, -1);
+      bucket = g_hash_table_lookup (self->titles, key);
+      if (bucket == NULL)
+        {
+          bucket = g_array_new (FALSE, FALSE, sizeof (guint32));
+          g_hash_table_replace (self->titles, g_steal_pointer (&key), bucket);
+        }
+      g_array_append_val (bucket, data->slot);
+    }
+  data->record = g_steal_pointer (&record);
+}
+
+static void
+unindex_group (BzSearchEngine   *self,
+               IndexedGroupData *data)
+{
+  if (data->trigrams != NULL)
+    {
+      for (guint i = 0; i < data->trigrams->len; i++)
+        {
+          guint32 trigram = 0;
+          GArray *posting = NULL;
+          guint   idx     = 0;
+
+          trigram = g_array_index (data->trigrams, guint32, i);
+          posting = g_hash_table_lookup (self->trigrams, GUINT_TO_POINTER (trigram));
+          if (posting == NULL)
+            continue;
+
+          if (posting_lower_bound (posting, data->slot, &idx))
+            g_array_remove_index (posting, idx);
+          if (posting->len == 0)
+            g_hash_table_remove (self->trigrams, GUINT_TO_POINTER (trigram));
+        }
+      g_clear_pointer (&data->trigrams, g_array_unref);
+    }
+
+  if (data->record != NULL)
+    {
+      if (data->record->id != NULL &&
+          g_hash_table_lookup (self->ids, data->record->id) == data)
+        g_hash_table_remove (self->ids, data->record->id);
+      if (data->record->title != NULL)
+        {
+          g_autofree char *key    = NULL;
+          GArray          *bucket = NULL;
+
+          key    = g_ascii_strdown (data->record->title, -1);
+          bucket = g_hash_table_lookup (self->titles, key);
+          if (bucket != NULL)
+            {
+              for (guint i = 0; i < bucket->len; i++)
+                {
+                  if (g_array_index (bucket, guint32, i) == data->slot)
+                    {
+                      g_array_remove_index_fast (bucket, i);
+                      break;
+                    }
+                }
+              if (bucket->len == 0)
+                g_hash_table_remove (self->titles, key);
+            }
+        }
+      g_clear_pointer (&data->record, search_record_data_unref);
+    }
+}
+
+static void
+clear_index (BzSearchEngine *self)
+{
+  GHashTableIter iter = { 0 };
+
+  if (self->indexed == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, self->indexed);
+  for (;;)
+    {
+      IndexedGroupData *data = NULL;
+
+      if (!g_hash_table_iter_next (&iter, NULL, (gpointer *) &data))
+        break;
+      g_clear_signal_handler (&data->notify_handler, data->group);
+    }
+
+  g_clear_handle_id (&self->flush_source, g_source_remove);
+  g_ptr_array_set_size (self->mirror, 0);
+  g_hash_table_remove_all (self->indexed);
+  g_ptr_array_set_size (self->slots, 0);
+  g_array_set_size (self->free_slots, 0);
+  g_hash_table_remove_all (self->trigrams);
+  g_hash_table_remove_all (self->ids);
+  g_hash_table_remove_all (self->titles);
+  g_ptr_array_set_size (self->dirty, 0);
+  g_clear_pointer (&self->pending, match_set_data_unref);
+  g_clear_pointer (&self->refinement, match_set_data_unref);
+}
+
+static gboolean
+flush_dirty (BzSearchEngine *self,
+             guint           max)
+{
+  for (guint i = 0; i < max && self->dirty->len > 0; i++)
+    {
+      g_autoptr (IndexedGroupData) data = NULL;
+
+      data        = g_ptr_array_steal_index_fast (self->dirty, self->dirty->len - 1);
+      data->dirty = FALSE;
+
+      /* This group has since been removed from the model */
+      if (data->n_positions == 0)
+        continue;
+
+      index_group (self, data);
+    }
+
+  return self->dirty->len > 0;
+}
+
+static gboolean
+flush_idle (BzSearchEngine *self)
+{
+  if (flush_dirty (self, FLUSH_BATCH_SIZE))
+    return G_SOURCE_CONTINUE;
+
+  self->flush_source = 0;
+  return G_SOURCE_REMOVE;
+}
+
+/* Dirty groups have no trigrams, or outdated ones, so they can't be ruled
+   out and are all scored */
+static void
+append_dirty_candidates (BzSearchEngine *self,
+                         GArray         *positions)
+{
+  if (self->dirty->len == 0)
+    return;
+
+  for (guint i = 0; i < self->dirty->len; i++)
+    {
+      IndexedGroupData *data = NULL;
+
+      data = g_ptr_array_index (self->dirty, i);
+      if (data->n_positions > 0)
+        g_array_append_val (positions, data->position);
+    }
+  sort_unique (positions);
+}
+
+/* Records of dirty groups are left for the query task to build, see
+   `query_task_fiber`. Until then the snapshot holds an empty record which
+   only references the group */
+static SearchRecordData *
+dup_snapshot_record (IndexedGroupData *indexed,
+                     guint             idx,
+                     GArray           *stale)
+{
+  SearchRecordData *record = NULL;
+
+  if (!indexed->dirty && indexed->record != NULL)
+    return search_record_data_ref (indexed->record);
+
+  record        = search_record_data_new ();
+  record->group = g_object_ref (indexed->group);
+  g_array_append_val (stale, idx);
+
+  return record;
+}
+
+/* Returns the sorted model positions of all groups which could possibly
+   score above zero, be an exact match, or be boosted by an active bias, or
+   NULL if the query cannot be narrowed down */
+static GArray *
+find_candidates (BzSearchEngine  *self,
+                 const char      *query_utf8,
+                 FoldedQueryData *folded,
+                 GPtrArray       *active_biases)
+{
+  g_autoptr (GArray) query_trigrams = NULL;
+  g_autoptr (GPtrArray) postings    = NULL;
+  g_autoptr (GArray) slots          = NULL;
+  g_autoptr (GArray) positions      = NULL;
+
+  query_trigrams = g_array_new (FALSE, FALSE, sizeof (guint32));
+  for (guint i = 0; i < folded->n_tokens; i++)
+    {
+      const Token *token = &folded->tokens[i];
+
+      if (token->n_chars >= TRIGRAM_LEN)
+        collect_trigrams (
+            folded->text + token->offset,
+            folded->text + token->offset + token->n_bytes,
+            query_trigrams);
+    }
+  if (query_trigrams->len == 0)
+    return NULL;
+  sort_unique (query_trigrams);
+
+  slots    = g_array_new (FALSE, FALSE, sizeof (guint32));
+  postings = g_ptr_array_sized_new (query_trigrams->len);
+  for (guint i = 0; i < query_trigrams->len; i++)
+    {
+      guint32 trigram = 0;
+      GArray *posting = NULL;
+
+      trigram = g_array_index (query_trigrams, guint32, i);
+      posting = g_hash_table_lookup (self->trigrams, GUINT_TO_POINTER (trigram));
+      if (posting == NULL)
+        {
+          g_ptr_array_set_size (postings, 0);
+          break;
+        }
+      g_ptr_array_add (postings, posting);
+    }
+
+  if (postings->len > 0)
+    {
+      GArray *smallest = NULL;
+
+      /* Start with the rarest trigram to keep the intersections short */
+      g_ptr_array_sort (postings, (GCompareFunc) cmp_posting_length);
+      smallest = g_ptr_array_index (postings, 0);
+      g_array_append_vals (slots, smallest->data, smallest->len);
+
+      for (guint i = 1; i < postings->len && slots->len > 0; i++)
+        intersect_sorted (slots, g_ptr_array_index (postings, i));
+    }
+
+  positions = g_array_sized_new (FALSE, FALSE, sizeof (guint32), slots->len);
+  for (guint i = 0; i < slots->len; i++)
+    {
+      IndexedGroupData *data = NULL;
+
+      data = g_ptr_array_index (self->slots, g_array_index (slots, guint32, i));
+      g_array_append_val (positions, data->position);
+    }
+  append_exact_candidates (self, query_utf8, positions);
+  append_boosted_candidates (self, active_biases, positions);
+
+  /* Keep the original model order so ties are ranked identically to a
+     full scan */
+  sort_unique (positions);
+
+  return g_steal_pointer (&positions);
+}
+
+/* Like `find_candidates`, but narrowed down to whatever matched a query
+   which `query_utf8` extends. Every token of that query is a substring of
+   a token in `query_utf8`, so nothing outside `previous` can match now */
+static GArray *
+refine_candidates (BzSearchEngine *self,
+                   MatchSetData   *previous,
+                   const char     *query_utf8,
+                   GPtrArray      *active_biases)
+{
+  g_autoptr (GArray) positions = NULL;
+
+  positions = g_array_sized_new (FALSE, FALSE, sizeof (guint32), previous->matched->len);
+  g_array_append_vals (positions, previous->matched->data, previous->matched->len);
+  append_exact_candidates (self, query_utf8, positions);
+  append_boosted_candidates (self, active_biases, positions);
+  sort_unique (positions);
+
+  return g_steal_pointer (&positions);
+}
+
+/* Exact matches and boosted groups can pass the threshold without any of
+   their text matching the query, so they always need to be scored */
+static void
+append_exact_candidates (BzSearchEngine *self,
+                         const char     *query_utf8,
+                         GArray         *positions)
+{
+  IndexedGroupData *exact    = NULL;
+  g_autofree char  *title    = NULL;
+  GArray           *by_title = NULL;
+
+  exact = g_hash_table_lookup (self->ids, query_utf8);
+  if (exact != NULL)
+    g_array_append_val (positions, exact->position);
+
+  title    = g_ascii_strdown (query_utf8, -1);
+  by_title = g_hash_table_lookup (self->titles, title);
+  if (by_title != NULL)
+    {
+      for (guint i = 0; i < by_title->len; i++)
+        {
+          IndexedGroupData *data = NULL;
+
+          data = g_ptr_array_index (self->slots, g_array_index (by_title, guint32, i));
+          g_array_append_val (positions, data->position);
+        }
+    }
+}
+
+static void
+append_boosted_candidates (BzSearchEngine *self,
+                           GPtrArray      *active_biases,
+                           GArray         *positions)
+{
+  for (guint i = 0; i < active_biases->len; i++)
+    {
+      BiasData      *bias = NULL;
+      GHashTableIter iter = { 0 };
+
+      bias = g_ptr_array_index (active_biases, i);
+      if (bias->boost == NULL)
+        continue;
+
+      g_hash_table_iter_init (&iter, bias->boost);
+      for (;;)
+        {
+          const char       *appid = NULL;
+          IndexedGroupData *data  = NULL;
+
+          if (!g_hash_table_iter_next (&iter, (gpointer *) &appid, NULL))
+            break;
+
+          data = g_hash_table_lookup (self->ids, appid);
+          if (data != NULL)
+            g_array_append_val (positions, data->position);
+        }
+    }
+}
+
+/* Returns NULL if none of `active_biases` boosts anything, which is the
+   case for most queries */
+static BoostTableData *
+build_boost_table (BzSearchEngine *self,
+                   GPtrArray      *active_biases)
+{
+  g_autoptr (BoostTableData) table = NULL;
+
+  for (guint i = 0; i < self->biases_mirror->len; i++)
+    {
+      BiasData *bias = NULL;
+
+      bias = g_ptr_array_index (self->biases_mirror, i);
+      if (bias->boost == NULL ||
+          !g_ptr_array_find (active_biases, bias, NULL))
+        continue;
+
+      if (table == NULL)
+        {
+          table         = boost_table_data_new ();
+          table->chains = g_hash_table_ref (self->boost_chains);
+          table->biases = g_ptr_array_ref (self->biases_mirror);
+          table->active = g_new0 (gboolean, self->biases_mirror->len);
+        }
+      table->active[i] = TRUE;
+    }
+
+  return g_steal_pointer (&table);
+}
+
+/* `s` must be a single, already folded token */
+static void
+collect_trigrams (const char *s,
+                  const char *end,
+                  GArray     *out)
+{
+  gunichar window[TRIGRAM_LEN] = { 0 };
+  guint    run                 = 0;
+
+  UTF8_FOREACH_FORWARD_WITH_END (ptr, s, end)
+  {
+    guint64 packed  = 0;
+    guint32 trigram = 0;
+
+    window[0] = window[1];
+    window[1] = window[2];
+    window[2] = g_utf8_get_char (ptr);
+    if (++run < TRIGRAM_LEN)
+      continue;
+
+    /* Codepoints fit in 21 bits; folding the packed value down to 32 bits
+       is lossless for ASCII, and a collision elsewhere only ever produces
+       extra candidates */
+    packed  = ((guint64) window[0] << 42) | ((guint64) window[1] << 21) | (guint64) window[2];
+    trigram = (guint32) (packed ^ (packed >> 32));
+    g_array_append_val (out, trigram);
+  }
+}
+
+static void
+sort_unique (GArray *array)
+{
+  guint n_unique = 0;
+
+  if (array->len == 0)
+    return;
+
+  g_array_sort (array, (GCompareFunc) cmp_uint32);
+  for (guint i = 1; i < array->len; i++)
+    {
+      if (g_array_index (array, guint32, i) != g_array_index (array, guint32, n_unique))
+        g_array_index (array, guint32, ++n_unique) = g_array_index (array, guint32, i);
+    }
+  g_array_set_size (array, n_unique + 1);
+}
+
+static gboolean
+posting_lower_bound (GArray  *posting,
+                     guint32  slot,
+                     guint   *idx_out)
+{
+  guint lo = 0;
+  guint hi = 0;
+
+  hi = posting->len;
+  while (lo < hi)
+    {
+      guint mid = 0;
+
+      mid = lo + (hi - lo) / 2;
+      if (g_array_index (posting, guint32, mid) < slot)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  *idx_out = lo;
+  return lo < posting->len && g_array_index (posting, guint32, lo) == slot;
+}
+
+static void
+intersect_sorted (GArray *inout,
+                  GArray *with)
+{
+  guint n_kept = 0;
+  guint j      = 0;
+
+  for (guint i = 0; i < inout->len; i++)
+    {
+      guint32 slot = 0;
+
+      slot = g_array_index (inout, guint32, i);
+      while (j < with->len && g_array_index (with, guint32, j) < slot)
+        j++;
+      if (j >= with->len)
+        break;
+
+      if (g_array_index (with, guint32, j) == slot)
+        g_array_index (inout, guint32, n_kept++) = slot;
+    }
+  g_array_set_size (inout, n_kept);
+}
+
+static gint
+cmp_uint32 (const guint32 *a,
+            const guint32 *b)
+{
+  return (*a > *b) - (*a < *b);
+}
+
+static gint
+cmp_posting_length (GArray **a,
+                    GArray **b)
+{
+  return ((*a)->len > (*b)->len) - ((*a)->len < (*b)->len);
+}
+
+static SearchRecordData *
+build_search_record (BzEntryGroup *group)
+{
+  g_autoptr (SearchRecordData) record = NULL;
+  g_autoptr (GString) text            = NULL;
+  g_autoptr (GArray) tokens           = NULL;
+  const char *id                      = NULL;
+  const char *title                   = NULL;
+  gssize      id_offset               = -1;
+  gssize      title_offset            = -1;
+  const char *fields[N_FIELDS]        = { 0 };
+
+  record        = search_record_data_new ();
+  record->group = g_object_ref (group);
+
+  text   = g_string_new (NULL);
+  tokens = g_array_new (FALSE, FALSE, sizeof (Token));
+
+  record->searchable = bz_entry_group_is_searchable (group);
+
+  /* The exact match check compares against the raw strings */
+  id = bz_entry_group_get_id (group);
+  if (id != NULL)
+    {
+      id_offset = text->len;
+      g_string_append_len (text, id, strlen (id) + 1);
+    }
+  title = bz_entry_group_get_title (group);
+  if (title != NULL)
+    {
+      title_offset = text->len;
+      g_string_append_len (text, title, strlen (title) + 1);
+    }
+
+  fields[FIELD_TITLE]         = title;
+  fields[FIELD_DEVELOPER]     = bz_entry_group_get_developer (group);
+  fields[FIELD_DESCRIPTION]   = bz_entry_group_get_description (group);
+  fields[FIELD_SEARCH_TOKENS] = bz_entry_group_get_search_tokens (group);
+
+  for (guint i = 0; i < N_FIELDS; i++)
+    {
+      record->field_tokens[i] = tokens->len;
+      if (fields[i] != NULL)
+        append_folded (text, tokens, fields[i]);
+    }
+  record->field_tokens[N_FIELDS] = tokens->len;
+
+  record->text   = g_string_free (g_steal_pointer (&text), FALSE);
+  record->tokens = (Token *) g_array_free (g_steal_pointer (&tokens), FALSE);
+  if (id_offset >= 0)
+    record->id = record->text + id_offset;
+  if (title_offset >= 0)
+    record->title = record->text + title_offset;
+
+  return g_steal_pointer (&record);
+}
+
+static FoldedQueryData *
+fold_query (const char *query_utf8)
+{
+  g_autoptr (FoldedQueryData) folded = NULL;
+  g_autoptr (GString) text           = NULL;
+  g_autoptr (GArray) tokens          = NULL;
+
+  text   = g_string_new (NULL);
+  tokens = g_array_new (FALSE, FALSE, sizeof (Token));
+  append_folded (text, tokens, query_utf8);
+
+  folded           = folded_query_data_new ();
+  folded->n_tokens = tokens->len;
+  folded->text     = g_string_free (g_steal_pointer (&text), FALSE);
+  folded->tokens   = (Token *) g_array_free (g_steal_pointer (&tokens), FALSE);
+
+  return g_steal_pointer (&folded);
+}
+
+/* Appends the lowercase version of `s` to `text`, followed by a NUL
+   terminator. The tokens are split exactly like they would be on the
+   original string, since case mapping never changes a character's class
+   nor the amount of characters */
+static void
+append_folded (GString    *text,
+               GArray     *tokens,
+               const char *s)
+{
+  g_autoptr (GString) folded = NULL;
+  gsize base                 = 0;
+  gsize tok_utf8_len         = 0;
+
+  folded = g_string_sized_new (strlen (s));
+  UTF8_FOREACH_FORWARD (ptr, s)
+  {
+    g_string_append_unichar (folded, g_unichar_tolower (g_utf8_get_char (ptr)));
+  }
+
+  base = text->len;
+  UTF8_FOREACH_TOKEN_FORWARDS (tok_start, tok_end, folded->str, &tok_utf8_len)
+  {
+    Token token = { 0 };
+
+    token.offset  = base + (tok_start - folded->str);
+    token.n_bytes = tok_end - tok_start;
+    token.n_chars = tok_utf8_len;
+    g_array_append_val (tokens, token);
+  }
+
+  g_string_append_len (text, folded->str, folded->len + 1);
+}
+
 /* End of bz-search-engine.c */
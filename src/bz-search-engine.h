@@ -23,11 +23,16 @@
 #include <gtk/gtk.h>
 #include <libdex.h>
 
+#include "bz-finished-search-query.h"
+
 G_BEGIN_DECLS
 
 #define BZ_TYPE_SEARCH_ENGINE (bz_search_engine_get_type ())
 G_DECLARE_FINAL_TYPE (BzSearchEngine, bz_search_engine, BZ, SEARCH_ENGINE, GObject)
 
+typedef void (*BzSearchEnginePartialFunc) (BzFinishedSearchQuery *partial,
+                                           gpointer               user_data);
+
 BzSearchEngine *
 bz_search_engine_new (void);
 
@@ -45,9 +50,27 @@ void
 bz_search_engine_set_biases (BzSearchEngine *self,
                              GListModel     *biases);
 
+guint
+bz_search_engine_get_max_threads (BzSearchEngine *self);
+
+void
+bz_search_engine_set_max_threads (BzSearchEngine *self,
+                                  guint           max_threads);
+
 DexFuture *
 bz_search_engine_query (BzSearchEngine    *self,
-                        const char *const *terms);
+                        const char *const *terms,
+                        guint              limit,
+                        GCancellable      *cancellable);
+
+DexFuture *
+bz_search_engine_query_streaming (BzSearchEngine           *self,
+                                  const char *const        *terms,
+                                  guint                     limit,
+                                  GCancellable             *cancellable,
+                                  BzSearchEnginePartialFunc partial_func,
+                                  gpointer                  user_data,
+                                  GDestroyNotify            destroy_data);
 
 G_END_DECLS
 
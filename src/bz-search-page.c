@@ -32,6 +32,7 @@
 #include "bz-search-filter-popover.h"
 #include "bz-search-page.h"
 #include "bz-search-pill-list.h"
+#include "bz-search-result-list.h"
 #include "bz-search-result.h"
 #include "bz-template-callbacks.h"
 #include "bz-util.h"
@@ -48,10 +49,11 @@ struct _BzSearchPage
 
   BzContentProvider *blocklists_provider;
   BzContentProvider *txt_blocklists_provider;
-  GListStore        *search_model;
-  GtkSelectionModel *selection_model;
+  BzSearchResultList *search_model;
+  GtkSelectionModel  *selection_model;
   guint              search_update_timeout;
   DexFuture         *search_query;
+  GCancellable      *search_cancellable;
 
   /* Template widgets */
   GtkText               *search_bar;
@@ -102,6 +104,30 @@ blocklists_items_changed (BzSearchPage *self,
                           guint         added,
                           GListModel   *model);
 
+typedef struct
+{
+  BzCategoryFlags categories;
+  gboolean        only_verified;
+  gboolean        only_free;
+  gboolean        only_non_eol;
+} ResultFilter;
+
+static gboolean
+filter_result_group (BzEntryGroup *group,
+                     ResultFilter *filter);
+
+static void
+set_search_model (BzSearchPage       *self,
+                  BzSearchResultList *model);
+
+static BzSearchResultList *
+filter_results (BzSearchPage          *self,
+                BzFinishedSearchQuery *finished);
+
+static void
+search_query_partial (BzFinishedSearchQuery *partial,
+                      GWeakRef              *wr);
+
 static DexFuture *
 search_query_then (DexFuture *future,
                    GWeakRef  *wr);
@@ -128,6 +154,9 @@ bz_search_page_dispose (GObject *object)
 
   g_clear_handle_id (&self->search_update_timeout, g_source_remove);
   dex_clear (&self->search_query);
+  if (self->search_cancellable != NULL)
+    g_cancellable_cancel (self->search_cancellable);
+  g_clear_object (&self->search_cancellable);
 
   g_clear_object (&self->state);
   g_clear_object (&self->selected);
@@ -449,14 +478,11 @@ bz_search_page_class_init (BzSearchPageClass *klass)
 static void
 bz_search_page_init (BzSearchPage *self)
 {
-  self->search_model = g_list_store_new (BZ_TYPE_SEARCH_RESULT);
-
   gtk_widget_init_template (GTK_WIDGET (self));
 
   /* TODO: move all this to blueprint */
 
   self->selection_model = GTK_SELECTION_MODEL (gtk_no_selection_new (NULL));
-  gtk_no_selection_set_model (GTK_NO_SELECTION (self->selection_model), G_LIST_MODEL (self->search_model));
   gtk_grid_view_set_model (self->grid_view, self->selection_model);
 
   g_signal_connect (self->search_bar, "changed", G_CALLBACK (search_changed), self);
@@ -713,65 +739,72 @@ blocklists_items_changed (BzSearchPage *self,
   update_filter (self);
 }
 
-static DexFuture *
-search_query_then (DexFuture *future,
-                   GWeakRef  *wr)
+static BzSearchResultList *
+filter_results (BzSearchPage          *self,
+                BzFinishedSearchQuery *finished)
 {
-  g_autoptr (BzSearchPage) self        = NULL;
-  g_autoptr (GPtrArray) filtered       = NULL;
-  BzFinishedSearchQuery *finished      = NULL;
-  GPtrArray             *results       = NULL;
-  guint                  old_length    = 0;
-  const char            *page_name     = NULL;
-  BzCategoryFlags        categories    = BZ_CATEGORY_FLAGS_NONE;
-  gboolean               only_verified = FALSE;
-  gboolean               only_free     = FALSE;
-  gboolean               only_non_eol  = FALSE;
+  g_autoptr (BzSearchResultList) filtered = NULL;
+  BzSearchResultList *results             = NULL;
+  ResultFilter        filter              = { 0 };
 
-  bz_weak_get_or_return_reject (self, wr);
+  results              = BZ_SEARCH_RESULT_LIST (bz_finished_search_query_get_results (finished));
+  filter.categories    = bz_search_filter_popover_get_selected_categories (self->filter_popover);
+  filter.only_verified = bz_search_filter_popover_get_only_verified (self->filter_popover);
+  filter.only_free     = bz_search_filter_popover_get_only_free (self->filter_popover);
+  filter.only_non_eol  = bz_search_filter_popover_get_only_non_eol (self->filter_popover);
 
-  finished      = g_value_get_object (dex_future_get_value (future, NULL));
-  results       = bz_finished_search_query_get_results (finished);
-  categories    = bz_search_filter_popover_get_selected_categories (self->filter_popover);
-  only_verified = bz_search_filter_popover_get_only_verified (self->filter_popover);
-  only_free     = bz_search_filter_popover_get_only_free (self->filter_popover);
-  only_non_eol  = bz_search_filter_popover_get_only_non_eol (self->filter_popover);
+  /* Only the groups are looked at here, the result objects themselves are
+     created once the grid view gets to them */
+  filtered = bz_search_result_list_filter (
+      results, (BzSearchResultListFilterFunc) filter_result_group, &filter);
+  if (self->state != NULL)
+    /* This is for debug mode */
+    bz_search_result_list_set_state (filtered, self->state);
 
-  filtered = g_ptr_array_new_with_free_func (g_object_unref);
+  return g_steal_pointer (&filtered);
+}
 
-  for (guint i = 0; i < results->len; i++)
-    {
-      BzSearchResult *result = g_ptr_array_index (results, i);
-      BzEntryGroup   *group  = bz_search_result_get_group (result);
+/* Early results for large catalogs, replaced once the query finishes. The
+   spinner stays up and nothing is shown if there is no hit yet, since the
+   final results may well have some */
+static void
+search_query_partial (BzFinishedSearchQuery *partial,
+                      GWeakRef              *wr)
+{
+  g_autoptr (BzSearchPage) self           = NULL;
+  g_autoptr (BzSearchResultList) filtered = NULL;
 
-      if (self->state != NULL)
-        /* This is for debug mode */
-        bz_search_result_set_state (result, self->state);
+  self = g_weak_ref_get (wr);
+  if (self == NULL)
+    return;
 
-      if (categories != BZ_CATEGORY_FLAGS_NONE &&
-          !(bz_entry_group_get_categories (group) & categories))
-        continue;
+  filtered = filter_results (self, partial);
+  if (g_list_model_get_n_items (G_LIST_MODEL (filtered)) == 0)
+    return;
 
-      if (only_verified && !bz_entry_group_get_is_verified (group))
-        continue;
+  set_search_model (self, filtered);
+  gtk_widget_activate_action (GTK_WIDGET (self->grid_view), "list.scroll-to-item", "u", 0);
+  gtk_stack_set_visible_child_name (self->search_stack, "results");
+}
 
-      if (only_free && !bz_entry_group_get_is_floss (group))
-        continue;
+static DexFuture *
+search_query_then (DexFuture *future,
+                   GWeakRef  *wr)
+{
+  g_autoptr (BzSearchPage) self           = NULL;
+  g_autoptr (BzSearchResultList) filtered = NULL;
+  BzFinishedSearchQuery *finished         = NULL;
+  const char            *page_name        = NULL;
 
-      if (only_non_eol && bz_entry_group_get_eol (group))
-        continue;
+  bz_weak_get_or_return_reject (self, wr);
 
-      g_ptr_array_add (filtered, g_object_ref (result));
-    }
+  finished = g_value_get_object (dex_future_get_value (future, NULL));
+  filtered = filter_results (self, finished);
 
-  old_length = g_list_model_get_n_items (G_LIST_MODEL (self->search_model));
-  g_list_store_splice (
-      self->search_model,
-      0, old_length,
-      (gpointer *) filtered->pdata, filtered->len);
+  set_search_model (self, filtered);
   gtk_widget_set_visible (GTK_WIDGET (self->search_busy), FALSE);
 
-  if (filtered->len > 0)
+  if (g_list_model_get_n_items (G_LIST_MODEL (filtered)) > 0)
     {
       page_name = "results";
       gtk_widget_activate_action (GTK_WIDGET (self->grid_view), "list.scroll-to-item", "u", 0);
@@ -790,9 +823,40 @@ search_query_then (DexFuture *future,
   gtk_stack_set_visible_child_name (self->search_stack, page_name);
 
   dex_clear (&self->search_query);
+  g_clear_object (&self->search_cancellable);
   return NULL;
 }
 
+static gboolean
+filter_result_group (BzEntryGroup *group,
+                     ResultFilter *filter)
+{
+  if (filter->categories != BZ_CATEGORY_FLAGS_NONE &&
+      !(bz_entry_group_get_categories (group) & filter->categories))
+    return FALSE;
+
+  if (filter->only_verified && !bz_entry_group_get_is_verified (group))
+    return FALSE;
+
+  if (filter->only_free && !bz_entry_group_get_is_floss (group))
+    return FALSE;
+
+  if (filter->only_non_eol && bz_entry_group_get_eol (group))
+    return FALSE;
+
+  return TRUE;
+}
+
+static void
+set_search_model (BzSearchPage       *self,
+                  BzSearchResultList *model)
+{
+  g_set_object (&self->search_model, model);
+  gtk_no_selection_set_model (
+      GTK_NO_SELECTION (self->selection_model),
+      G_LIST_MODEL (model));
+}
+
 static void
 update_filter (BzSearchPage *self)
 {
@@ -806,6 +870,11 @@ update_filter (BzSearchPage *self)
 
   g_clear_handle_id (&self->search_update_timeout, g_source_remove);
   dex_clear (&self->search_query);
+  /* Dropping the future alone would leave the engine scoring the whole
+     catalog for a query nobody is waiting for anymore */
+  if (self->search_cancellable != NULL)
+    g_cancellable_cancel (self->search_cancellable);
+  g_clear_object (&self->search_cancellable);
 
   g_clear_object (&self->current_query);
   self->current_query = bz_finished_search_query_new ();
@@ -823,7 +892,7 @@ update_filter (BzSearchPage *self)
 
   if (search_text == NULL || *search_text == '\0')
     {
-      g_list_store_remove_all (self->search_model);
+      set_search_model (self, NULL);
       gtk_stack_set_visible_child_name (self->search_stack, "empty");
       return;
     }
@@ -844,7 +913,7 @@ update_filter (BzSearchPage *self)
 
   if (n_terms == 0)
     {
-      g_list_store_remove_all (self->search_model);
+      set_search_model (self, NULL);
       gtk_stack_set_visible_child_name (self->search_stack, "empty");
       return;
     }
@@ -852,10 +921,15 @@ update_filter (BzSearchPage *self)
   terms = g_strv_builder_end (builder);
 
   self->search_in_progress = TRUE;
+  self->search_cancellable = g_cancellable_new ();
 
-  future = bz_search_engine_query (
+  future = bz_search_engine_query_streaming (
       engine,
-      (const char *const *) terms);
+      (const char *const *) terms,
+      0,
+      self->search_cancellable,
+      (BzSearchEnginePartialFunc) search_query_partial,
+      bz_track_weak (self), bz_weak_release);
   gtk_widget_set_visible (
       GTK_WIDGET (self->search_busy),
       dex_future_is_pending (future));
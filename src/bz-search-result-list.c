@@ -0,0 +1,229 @@
+/* bz-search-result-list.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "bz-search-result-list.h"
+#include "bz-search-result.h"
+
+/* Immutable list of ranked search hits. The search engine builds these in
+   worker threads from plain arrays, and `BzSearchResult` objects are only
+   created once something asks for a specific item, which has to happen on
+   the main thread */
+struct _BzSearchResultList
+{
+  GObject parent_instance;
+
+  GPtrArray   *groups;
+  GArray      *original_indices;
+  GArray      *scores;
+  BzStateInfo *state;
+
+  GPtrArray *results;
+};
+
+static void list_model_iface_init (GListModelInterface *iface);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (
+    BzSearchResultList,
+    bz_search_result_list,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, list_model_iface_init))
+
+static void
+bz_search_result_list_dispose (GObject *object)
+{
+  BzSearchResultList *self = BZ_SEARCH_RESULT_LIST (object);
+
+  g_clear_pointer (&self->groups, g_ptr_array_unref);
+  g_clear_pointer (&self->original_indices, g_array_unref);
+  g_clear_pointer (&self->scores, g_array_unref);
+  g_clear_object (&self->state);
+  g_clear_pointer (&self->results, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (bz_search_result_list_parent_class)->dispose (object);
+}
+
+static void
+bz_search_result_list_class_init (BzSearchResultListClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = bz_search_result_list_dispose;
+}
+
+static void
+bz_search_result_list_init (BzSearchResultList *self)
+{
+}
+
+static GType
+list_model_get_item_type (GListModel *list)
+{
+  return BZ_TYPE_SEARCH_RESULT;
+}
+
+static guint
+list_model_get_n_items (GListModel *list)
+{
+  BzSearchResultList *self = BZ_SEARCH_RESULT_LIST (list);
+  return self->groups->len;
+}
+
+static gpointer
+list_model_get_item (GListModel *list,
+                     guint       position)
+{
+  BzSearchResultList *self          = BZ_SEARCH_RESULT_LIST (list);
+  BzSearchResult     *search_result = NULL;
+
+  if (position >= self->groups->len)
+    return NULL;
+
+  search_result = g_ptr_array_index (self->results, position);
+  if (search_result == NULL)
+    {
+      search_result = bz_search_result_new ();
+      bz_search_result_set_group (search_result, g_ptr_array_index (self->groups, position));
+      bz_search_result_set_original_index (search_result, g_array_index (self->original_indices, guint, position));
+      bz_search_result_set_score (search_result, g_array_index (self->scores, double, position));
+      if (self->state != NULL)
+        bz_search_result_set_state (search_result, self->state);
+
+      g_ptr_array_index (self->results, position) = search_result;
+    }
+
+  return g_object_ref (search_result);
+}
+
+static void
+list_model_iface_init (GListModelInterface *iface)
+{
+  iface->get_item_type = list_model_get_item_type;
+  iface->get_n_items   = list_model_get_n_items;
+  iface->get_item      = list_model_get_item;
+}
+
+/* `groups` must hold references to `BzEntryGroup`s, and `original_indices`
+   and `scores` are arrays of `guint` and `double` of the same length */
+BzSearchResultList *
+bz_search_result_list_new (GPtrArray *groups,
+                           GArray    *original_indices,
+                           GArray    *scores)
+{
+  BzSearchResultList *list = NULL;
+
+  g_return_val_if_fail (groups != NULL, NULL);
+  g_return_val_if_fail (original_indices != NULL, NULL);
+  g_return_val_if_fail (scores != NULL, NULL);
+  g_return_val_if_fail (original_indices->len == groups->len, NULL);
+  g_return_val_if_fail (scores->len == groups->len, NULL);
+
+  list                   = g_object_new (BZ_TYPE_SEARCH_RESULT_LIST, NULL);
+  list->groups           = g_ptr_array_ref (groups);
+  list->original_indices = g_array_ref (original_indices);
+  list->scores           = g_array_ref (scores);
+
+  list->results = g_ptr_array_new_with_free_func (g_object_unref);
+  g_ptr_array_set_size (list->results, groups->len);
+
+  return list;
+}
+
+/* Unlike `g_list_model_get_item`, this never creates a result object */
+BzEntryGroup *
+bz_search_result_list_get_group (BzSearchResultList *self,
+                                 guint               position)
+{
+  g_return_val_if_fail (BZ_IS_SEARCH_RESULT_LIST (self), NULL);
+  g_return_val_if_fail (position < self->groups->len, NULL);
+
+  return g_ptr_array_index (self->groups, position);
+}
+
+/* Applied to every result, including those created later */
+void
+bz_search_result_list_set_state (BzSearchResultList *self,
+                                 BzStateInfo        *state)
+{
+  g_return_if_fail (BZ_IS_SEARCH_RESULT_LIST (self));
+  g_return_if_fail (state == NULL || BZ_IS_STATE_INFO (state));
+
+  g_set_object (&self->state, state);
+
+  for (guint i = 0; i < self->results->len; i++)
+    {
+      BzSearchResult *search_result = NULL;
+
+      search_result = g_ptr_array_index (self->results, i);
+      if (search_result != NULL)
+        bz_search_result_set_state (search_result, state);
+    }
+}
+
+/* Returns a new list of the results for which `func` returns TRUE,
+   sharing any result objects which were already created */
+BzSearchResultList *
+bz_search_result_list_filter (BzSearchResultList          *self,
+                              BzSearchResultListFilterFunc func,
+                              gpointer                     user_data)
+{
+  g_autoptr (GPtrArray) groups          = NULL;
+  g_autoptr (GArray) original_indices   = NULL;
+  g_autoptr (GArray) scores             = NULL;
+  g_autoptr (GPtrArray) results         = NULL;
+  g_autoptr (BzSearchResultList) subset = NULL;
+
+  g_return_val_if_fail (BZ_IS_SEARCH_RESULT_LIST (self), NULL);
+  g_return_val_if_fail (func != NULL, NULL);
+
+  groups           = g_ptr_array_new_with_free_func (g_object_unref);
+  original_indices = g_array_new (FALSE, FALSE, sizeof (guint));
+  scores           = g_array_new (FALSE, FALSE, sizeof (double));
+  results          = g_ptr_array_new ();
+
+  for (guint i = 0; i < self->groups->len; i++)
+    {
+      BzEntryGroup *group = NULL;
+
+      group = g_ptr_array_index (self->groups, i);
+      if (!func (group, user_data))
+        continue;
+
+      g_ptr_array_add (groups, g_object_ref (group));
+      g_array_append_val (original_indices, g_array_index (self->original_indices, guint, i));
+      g_array_append_val (scores, g_array_index (self->scores, double, i));
+      g_ptr_array_add (results, g_ptr_array_index (self->results, i));
+    }
+
+  subset = bz_search_result_list_new (groups, original_indices, scores);
+  g_set_object (&subset->state, self->state);
+
+  for (guint i = 0; i < results->len; i++)
+    {
+      BzSearchResult *search_result = NULL;
+
+      search_result = g_ptr_array_index (results, i);
+      if (search_result != NULL)
+        g_ptr_array_index (subset->results, i) = g_object_ref (search_result);
+    }
+
+  return g_steal_pointer (&subset);
+}
+
+/* End of bz-search-result-list.c */
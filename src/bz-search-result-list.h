@@ -0,0 +1,54 @@
+/* bz-search-result-list.h
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "bz-entry-group.h"
+#include "bz-state-info.h"
+
+G_BEGIN_DECLS
+
+#define BZ_TYPE_SEARCH_RESULT_LIST (bz_search_result_list_get_type ())
+G_DECLARE_FINAL_TYPE (BzSearchResultList, bz_search_result_list, BZ, SEARCH_RESULT_LIST, GObject)
+
+typedef gboolean (*BzSearchResultListFilterFunc) (BzEntryGroup *group,
+                                                  gpointer      user_data);
+
+BzSearchResultList *
+bz_search_result_list_new (GPtrArray *groups,
+                           GArray    *original_indices,
+                           GArray    *scores);
+
+BzEntryGroup *
+bz_search_result_list_get_group (BzSearchResultList *self,
+                                 guint               position);
+
+void
+bz_search_result_list_set_state (BzSearchResultList *self,
+                                 BzStateInfo        *state);
+
+BzSearchResultList *
+bz_search_result_list_filter (BzSearchResultList          *self,
+                              BzSearchResultListFilterFunc func,
+                              gpointer                     user_data);
+
+G_END_DECLS
+
+/* End of bz-search-result-list.h */
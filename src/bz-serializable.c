@@ -18,8 +18,19 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <gio/gio.h>
+
 #include "bz-serializable.h"
 
+/* Prefixed to packed data written by `bz_serializable_dup_bytes`. A legacy
+ * vardict can never start with this since its first key would have to
+ * begin with a DEL character. The length keeps the payload 8-aligned */
+#define PACKED_MAGIC        "\x7f" "BZPACK"
+#define PACKED_MAGIC_LENGTH 8
+#define PACKED_ENVELOPE     "(qv)"
+
+G_STATIC_ASSERT (sizeof (PACKED_MAGIC) == PACKED_MAGIC_LENGTH);
+
 G_DEFINE_INTERFACE (BzSerializable, bz_serializable, G_TYPE_OBJECT)
 
 static void
@@ -40,8 +51,11 @@ bz_serializable_real_deserialize (BzSerializable *self,
 static void
 bz_serializable_default_init (BzSerializableInterface *iface)
 {
-  iface->serialize   = bz_serializable_real_serialize;
-  iface->deserialize = bz_serializable_real_deserialize;
+  iface->serialize      = bz_serializable_real_serialize;
+  iface->deserialize    = bz_serializable_real_deserialize;
+  iface->packed_version = 0;
+  iface->pack           = NULL;
+  iface->unpack         = NULL;
 }
 
 void
@@ -69,3 +83,138 @@ bz_serializable_deserialize (BzSerializable *self,
       import,
       error);
 }
+
+gboolean
+bz_serializable_can_pack (BzSerializable *self)
+{
+  BzSerializableInterface *iface = NULL;
+
+  g_return_val_if_fail (BZ_IS_SERIALIZABLE (self), FALSE);
+
+  iface = BZ_SERIALIZABLE_GET_IFACE (self);
+  return iface->pack != NULL && iface->unpack != NULL;
+}
+
+/* Returns the bare tuple, for embedding in another object's packed form */
+GVariant *
+bz_serializable_pack (BzSerializable *self)
+{
+  g_return_val_if_fail (BZ_IS_SERIALIZABLE (self), NULL);
+  g_return_val_if_fail (bz_serializable_can_pack (self), NULL);
+
+  return BZ_SERIALIZABLE_GET_IFACE (self)->pack (self);
+}
+
+gboolean
+bz_serializable_unpack (BzSerializable *self,
+                        GVariant       *packed,
+                        GError        **error)
+{
+  g_return_val_if_fail (BZ_IS_SERIALIZABLE (self), FALSE);
+  g_return_val_if_fail (bz_serializable_can_pack (self), FALSE);
+  g_return_val_if_fail (packed != NULL, FALSE);
+
+  return BZ_SERIALIZABLE_GET_IFACE (self)->unpack (
+      self,
+      packed,
+      error);
+}
+
+/* Encodes `self` for storage, tagged with the implementation's packed
+ * version. Falls back to a legacy vardict if packing isn't supported */
+GBytes *
+bz_serializable_dup_bytes (BzSerializable *self)
+{
+  g_autoptr (GVariant) packed   = NULL;
+  g_autoptr (GVariant) variant  = NULL;
+  g_autoptr (GByteArray) buffer = NULL;
+  gsize size                    = 0;
+
+  g_return_val_if_fail (BZ_IS_SERIALIZABLE (self), NULL);
+
+  if (!bz_serializable_can_pack (self))
+    {
+      g_autoptr (GVariantBuilder) builder = NULL;
+
+      builder = g_variant_builder_new (G_VARIANT_TYPE_VARDICT);
+      bz_serializable_serialize (self, builder);
+      variant = g_variant_ref_sink (g_variant_builder_end (builder));
+      return g_variant_get_data_as_bytes (variant);
+    }
+
+  packed  = g_variant_ref_sink (bz_serializable_pack (self));
+  variant = g_variant_ref_sink (g_variant_new (
+      PACKED_ENVELOPE,
+      BZ_SERIALIZABLE_GET_IFACE (self)->packed_version,
+      packed));
+
+  size   = g_variant_get_size (variant);
+  buffer = g_byte_array_sized_new (PACKED_MAGIC_LENGTH + size);
+  g_byte_array_append (buffer, (const guint8 *) PACKED_MAGIC, PACKED_MAGIC_LENGTH);
+  g_byte_array_set_size (buffer, PACKED_MAGIC_LENGTH + size);
+  g_variant_store (variant, buffer->data + PACKED_MAGIC_LENGTH);
+
+  return g_byte_array_free_to_bytes (g_steal_pointer (&buffer));
+}
+
+/* Decodes data written by `bz_serializable_dup_bytes`. Legacy vardicts are
+ * still accepted so old caches can be migrated, in which case `was_legacy`
+ * is set. Nothing is copied up front, so the unpacked tuple references
+ * `bytes` directly */
+gboolean
+bz_serializable_load_bytes (BzSerializable *self,
+                            GBytes         *bytes,
+                            gboolean       *was_legacy,
+                            GError        **error)
+{
+  BzSerializableInterface *iface = NULL;
+  gconstpointer data             = NULL;
+  gsize         size             = 0;
+  g_autoptr (GBytes) payload     = NULL;
+  g_autoptr (GVariant) envelope  = NULL;
+  g_autoptr (GVariant) packed    = NULL;
+  guint16 version                = 0;
+
+  g_return_val_if_fail (BZ_IS_SERIALIZABLE (self), FALSE);
+  g_return_val_if_fail (bytes != NULL, FALSE);
+
+  iface = BZ_SERIALIZABLE_GET_IFACE (self);
+  data  = g_bytes_get_data (bytes, &size);
+
+  if (size < PACKED_MAGIC_LENGTH ||
+      memcmp (data, PACKED_MAGIC, PACKED_MAGIC_LENGTH) != 0)
+    {
+      g_autoptr (GVariant) import = NULL;
+
+      if (was_legacy != NULL)
+        *was_legacy = TRUE;
+
+      import = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, bytes, FALSE));
+      return bz_serializable_deserialize (self, import, error);
+    }
+
+  if (was_legacy != NULL)
+    *was_legacy = FALSE;
+
+  if (!bz_serializable_can_pack (self))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "%s cannot be unpacked",
+                   G_OBJECT_TYPE_NAME (self));
+      return FALSE;
+    }
+
+  payload  = g_bytes_new_from_bytes (bytes, PACKED_MAGIC_LENGTH, size - PACKED_MAGIC_LENGTH);
+  envelope = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (PACKED_ENVELOPE), payload, FALSE));
+  g_variant_get (envelope, PACKED_ENVELOPE, &version, &packed);
+
+  if (version != iface->packed_version)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Packed %s has version %u, expected %u",
+                   G_OBJECT_TYPE_NAME (self), version, iface->packed_version);
+      return FALSE;
+    }
+
+  return bz_serializable_unpack (self, packed, error);
+}
@@ -37,6 +37,17 @@ struct _BzSerializableInterface
   gboolean (*deserialize) (BzSerializable *self,
                            GVariant       *import,
                            GError        **error);
+
+  /* Optional fixed layout encoding. `pack` returns a floating tuple which
+   * `unpack` consumes positionally, so bump `packed_version` whenever the
+   * meaning of a member changes without the type changing */
+  guint16 packed_version;
+
+  GVariant *(*pack) (BzSerializable *self);
+
+  gboolean (*unpack) (BzSerializable *self,
+                      GVariant       *packed,
+                      GError        **error);
 };
 
 void
@@ -48,4 +59,24 @@ bz_serializable_deserialize (BzSerializable *self,
                              GVariant       *import,
                              GError        **error);
 
+gboolean
+bz_serializable_can_pack (BzSerializable *self);
+
+GVariant *
+bz_serializable_pack (BzSerializable *self);
+
+gboolean
+bz_serializable_unpack (BzSerializable *self,
+                        GVariant       *packed,
+                        GError        **error);
+
+GBytes *
+bz_serializable_dup_bytes (BzSerializable *self);
+
+gboolean
+bz_serializable_load_bytes (BzSerializable *self,
+                            GBytes         *bytes,
+                            gboolean       *was_legacy,
+                            GError        **error);
+
 G_END_DECLS
@@ -0,0 +1,168 @@
+/* bz-substring.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "bz-substring.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+typedef const char *(*FindFunc) (const char *haystack,
+                                 gsize       haystack_len,
+                                 const char *needle,
+                                 gsize       needle_len);
+
+#ifdef HAVE_X86_KERNELS
+static const char *
+find_sse2 (const char *haystack,
+           gsize       haystack_len,
+           const char *needle,
+           gsize       needle_len);
+
+static const char *
+find_avx2 (const char *haystack,
+           gsize       haystack_len,
+           const char *needle,
+           gsize       needle_len);
+#endif
+
+/* Byte-wise substring search, returning the first occurrence of `needle`
+   in `haystack` or NULL. Since UTF-8 is self synchronizing, a match of a
+   valid UTF-8 needle in a valid UTF-8 haystack always starts on a
+   character boundary, so this works just as well for non-ASCII text.
+
+   On x86_64 this compares the first and last byte of the needle against
+   16 or 32 positions at once and only verifies the rest of the needle
+   where both match, picking AVX2 at runtime when the CPU has it */
+const char *
+bz_find_substring (const char *haystack,
+                   gsize       haystack_len,
+                   const char *needle,
+                   gsize       needle_len)
+{
+  static gsize    init = 0;
+  static FindFunc find = NULL;
+
+  if (g_once_init_enter (&init))
+    {
+#ifdef HAVE_X86_KERNELS
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        find = find_avx2;
+      else
+        find = find_sse2;
+#else
+      find = bz_find_substring_scalar;
+#endif
+      g_once_init_leave (&init, 1);
+    }
+
+  return find (haystack, haystack_len, needle, needle_len);
+}
+
+const char *
+bz_find_substring_scalar (const char *haystack,
+                          gsize       haystack_len,
+                          const char *needle,
+                          gsize       needle_len)
+{
+  const char *last = NULL;
+
+  if (needle_len == 0)
+    return haystack;
+  if (needle_len > haystack_len)
+    return NULL;
+
+  last = haystack + (haystack_len - needle_len);
+  for (const char *p = haystack; p <= last; p++)
+    {
+      p = memchr (p, needle[0], last - p + 1);
+      if (p == NULL)
+        return NULL;
+      if (memcmp (p + 1, needle + 1, needle_len - 1) == 0)
+        return p;
+    }
+
+  return NULL;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+#define DEFINE_FIND_KERNEL(_name, _target, _width, _vec, _set1, _loadu, _cmpeq, _and, _movemask) \
+  __attribute__ ((target (_target))) static const char *                                         \
+  _name (const char *haystack,                                                                   \
+         gsize       haystack_len,                                                               \
+         const char *needle,                                                                     \
+         gsize       needle_len)                                                                 \
+  {                                                                                              \
+    _vec  first  = { 0 };                                                                        \
+    _vec  last   = { 0 };                                                                        \
+    gsize offset = 0;                                                                            \
+    const char *tail = NULL;                                                                     \
+                                                                                                 \
+    if (needle_len <= 1 || needle_len > haystack_len)                                            \
+      return bz_find_substring_scalar (haystack, haystack_len, needle, needle_len);              \
+                                                                                                 \
+    first = _set1 (needle[0]);                                                                   \
+    last  = _set1 (needle[needle_len - 1]);                                                      \
+                                                                                                 \
+    for (; offset + (_width) + needle_len - 1 <= haystack_len; offset += (_width))               \
+      {                                                                                          \
+        _vec    block_first = { 0 };                                                             \
+        _vec    block_last  = { 0 };                                                             \
+        guint32 mask        = 0;                                                                 \
+                                                                                                 \
+        block_first = _loadu ((const void *) (haystack + offset));                               \
+        block_last  = _loadu ((const void *) (haystack + offset + needle_len - 1));              \
+        mask        = (guint32) _movemask (                                                      \
+            _and (_cmpeq (first, block_first), _cmpeq (last, block_last)));                      \
+                                                                                                 \
+        while (mask != 0)                                                                        \
+          {                                                                                      \
+            const char *candidate = NULL;                                                        \
+                                                                                                 \
+            candidate = haystack + offset + __builtin_ctz (mask);                                \
+            if (memcmp (candidate + 1, needle + 1, needle_len - 2) == 0)                         \
+              return candidate;                                                                  \
+            mask &= mask - 1;                                                                    \
+          }                                                                                      \
+      }                                                                                          \
+                                                                                                 \
+    tail = bz_find_substring_scalar (                                                            \
+        haystack + offset, haystack_len - offset, needle, needle_len);                           \
+    return tail;                                                                                 \
+  }
+
+DEFINE_FIND_KERNEL (find_sse2, "sse2", 16, __m128i,
+                    _mm_set1_epi8, _mm_loadu_si128,
+                    _mm_cmpeq_epi8, _mm_and_si128, _mm_movemask_epi8)
+
+DEFINE_FIND_KERNEL (find_avx2, "avx2", 32, __m256i,
+                    _mm256_set1_epi8, _mm256_loadu_si256,
+                    _mm256_cmpeq_epi8, _mm256_and_si256, _mm256_movemask_epi8)
+
+#undef DEFINE_FIND_KERNEL
+
+#endif
+
+/* End of bz-substring.c */
@@ -0,0 +1,41 @@
+/* bz-substring.h
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+const char *
+bz_find_substring (const char *haystack,
+                   gsize       haystack_len,
+                   const char *needle,
+                   gsize       needle_len);
+
+const char *
+bz_find_substring_scalar (const char *haystack,
+                          gsize       haystack_len,
+                          const char *needle,
+                          gsize       needle_len);
+
+G_END_DECLS
+
+/* End of bz-substring.h */
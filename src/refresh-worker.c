@@ -20,11 +20,15 @@
 
 #define G_LOG_DOMAIN "BAZAAR::REFRESH-WORKER"
 
+#include <signal.h>
+
 #include "bz-backend-notification.h"
 #include "bz-backend.h"
 #include "bz-entry-cache-manager.h"
 #include "bz-env.h"
 #include "bz-flatpak-instance.h"
+#include "bz-refresh-frame.h"
+#include "bz-serializable.h"
 #include "bz-util.h"
 
 BZ_DEFINE_DATA (
@@ -41,6 +45,26 @@ BZ_DEFINE_DATA (
 static DexFuture *
 run (MainData *data);
 
+static void
+stream_entry (MainData *data,
+              BzEntry  *entry);
+
+static gboolean
+write_frame (GIOChannel *channel,
+             guint32     flags,
+             GBytes     *bytes,
+             GError    **error);
+
+static gboolean
+write_all (GIOChannel *channel,
+           const char *buf,
+           gsize       size,
+           GError    **error);
+
+static DexFuture *
+close_channel_finally (DexFuture  *future,
+                       DexChannel *channel);
+
 int
 main (int   argc,
       char *argv[])
@@ -51,6 +75,8 @@ main (int   argc,
   g_autoptr (DexFuture) future          = NULL;
 
   g_log_writer_default_set_use_stderr (TRUE);
+  /* Let the application going away show up as a write error */
+  signal (SIGPIPE, SIG_IGN);
   dex_init ();
 
   stdout_channel = g_io_channel_unix_new (STDOUT_FILENO);
@@ -83,11 +109,20 @@ run (MainData *data)
   g_autoptr (BzFlatpakInstance) flatpak = NULL;
   g_autoptr (DexChannel) channel        = NULL;
   g_autoptr (GHashTable) installed_set  = NULL;
-  g_autoptr (DexFuture) all_notifs      = NULL;
-  guint n_notifs                        = 0;
+  g_autoptr (GHashTable) cached_set     = NULL;
+  g_autoptr (DexFuture) retrieval       = NULL;
   g_autoptr (GPtrArray) write_backs     = NULL;
+  g_autoptr (GPtrArray) held            = NULL;
+  g_autoptr (GHashTable) seen           = NULL;
+  guint n_replaced                      = 0;
+  guint n_kept                          = 0;
+  guint n_removed                       = 0;
+  guint n_failed                        = 0;
 
   cache = bz_entry_cache_manager_new ();
+  /* Nothing becomes visible to the application until the
+   * whole refresh is published by the compaction below */
+  bz_entry_cache_manager_begin_generation (cache);
 
   flatpak = dex_await_object (
       bz_flatpak_instance_new (),
@@ -99,13 +134,22 @@ run (MainData *data)
   if (channel == NULL)
     goto err;
 
-  result = dex_await (
-      bz_backend_retrieve_remote_entries (
-          BZ_BACKEND (flatpak), NULL),
+  /* Whatever went missing from the cache since the last refresh, say
+   * because writing it failed, is built again instead of being kept */
+  cached_set = dex_await_boxed (
+      bz_entry_cache_manager_enumerate_disk (cache),
       &local_error);
-  if (!result)
-    goto err;
+  if (cached_set == NULL)
+    {
+      g_warning ("Unable to enumerate cached entries, "
+                 "all entries will be rebuilt: %s",
+                 local_error->message);
+      g_clear_error (&local_error);
+      cached_set = g_hash_table_new (g_str_hash, g_str_equal);
+    }
+  bz_flatpak_instance_set_cached_checksums (flatpak, cached_set);
 
+  /* Entries are marked as installed as they come in */
   installed_set = dex_await_boxed (
       bz_backend_retrieve_install_ids (
           BZ_BACKEND (flatpak), NULL),
@@ -113,22 +157,25 @@ run (MainData *data)
   if (installed_set == NULL)
     goto err;
 
-  all_notifs = dex_channel_receive_all (channel);
-  n_notifs   = dex_future_set_get_size (DEX_FUTURE_SET (all_notifs));
+  /* The channel is unbounded, so once retrieval is done every notification
+   * is already queued. Closing it then ends the loop below after the last */
+  retrieval = dex_future_finally (
+      bz_backend_retrieve_remote_entries (
+          BZ_BACKEND (flatpak), NULL),
+      (DexFutureCallback) close_channel_finally,
+      dex_ref (channel), dex_unref);
 
   write_backs = g_ptr_array_new_with_free_func (dex_unref);
-  for (guint i = 0; i < n_notifs; i++)
+  held        = g_ptr_array_new_with_free_func (g_object_unref);
+  seen        = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  for (;;)
     {
-      DexFuture *future                       = NULL;
       g_autoptr (BzBackendNotification) notif = NULL;
       BzBackendNotificationKind kind          = 0;
 
-      future = dex_future_set_get_future_at (
-          DEX_FUTURE_SET (all_notifs), i);
-
-      notif = dex_await_object (dex_ref (future), NULL);
+      notif = dex_await_object (dex_channel_receive (channel), NULL);
       if (notif == NULL)
-        continue;
+        break;
 
       kind = bz_backend_notification_get_kind (notif);
       if (kind == BZ_BACKEND_NOTIFICATION_KIND_REPLACE_ENTRY)
@@ -139,19 +186,107 @@ run (MainData *data)
           entry     = bz_backend_notification_get_entry (notif);
           unique_id = bz_entry_get_unique_id (entry);
           bz_entry_set_installed (entry, g_hash_table_contains (installed_set, unique_id));
+          g_hash_table_add (seen, g_strdup (bz_entry_get_unique_id_checksum (entry)));
+
+          /* Remotes are retrieved concurrently, so only the order within
+           * each one holds here. An application can rely on the addons and
+           * runtimes of any remote, so it waits until all of them are in */
+          if (bz_entry_is_of_kinds (entry, BZ_ENTRY_KIND_APPLICATION))
+            g_ptr_array_add (held, g_object_ref (entry));
+          else
+            stream_entry (data, entry);
 
           g_ptr_array_add (
               write_backs,
               bz_entry_cache_manager_add (cache, entry));
+          n_replaced++;
+        }
+      else if (kind == BZ_BACKEND_NOTIFICATION_KIND_KEEP_ENTRY)
+        {
+          const char *unique_id = NULL;
+
+          /* Already cached and already known to the application, so all
+           * we need to do is keep it out of the next compaction's way */
+          unique_id = bz_backend_notification_get_unique_id (notif);
+          g_hash_table_add (seen, g_compute_checksum_for_string (G_CHECKSUM_MD5, unique_id, -1));
+          n_kept++;
+        }
+      else if (kind == BZ_BACKEND_NOTIFICATION_KIND_REMOVE_ENTRY)
+        {
+          const char *unique_id    = NULL;
+          g_autoptr (GBytes) bytes = NULL;
+
+          /* Left out of `seen`, so the cache lets go of it in due time. The
+           * application has it loaded though, so tell it to drop it */
+          unique_id = bz_backend_notification_get_unique_id (notif);
+          bytes     = g_bytes_new (unique_id, strlen (unique_id));
+          if (data->stdout_channel != NULL &&
+              !write_frame (data->stdout_channel, BZ_REFRESH_FRAME_TOMBSTONE, bytes, &local_error))
+            {
+              g_warning ("Unable to stream entries, the application "
+                         "will read them from the cache instead: %s",
+                         local_error->message);
+              g_clear_error (&local_error);
+              g_clear_pointer (&data->stdout_channel, g_io_channel_unref);
+            }
+          n_removed++;
+        }
+    }
+
+  result = dex_await (g_steal_pointer (&retrieval), &local_error);
+  if (!result)
+    goto err;
+
+  g_debug ("Refresh found %u new or changed entries, %u unchanged and %u removed",
+           n_replaced, n_kept, n_removed);
+
+  for (guint i = 0; i < held->len; i++)
+    stream_entry (data, g_ptr_array_index (held, i));
+  if (data->stdout_channel != NULL &&
+      !write_frame (data->stdout_channel, 0, NULL, &local_error))
+    {
+      g_warning ("Unable to finish entry stream: %s", local_error->message);
+      g_clear_error (&local_error);
+      g_clear_pointer (&data->stdout_channel, g_io_channel_unref);
+    }
+  for (guint i = 0; i < write_backs->len; i++)
+    {
+      if (!dex_await (dex_ref (g_ptr_array_index (write_backs, i)), &local_error))
+        {
+          if (n_failed == 0)
+            g_warning ("Unable to cache entry: %s", local_error->message);
+          g_clear_error (&local_error);
+          n_failed++;
         }
     }
-  if (write_backs->len > 0)
-    dex_await (
-        dex_future_allv (
-            (DexFuture *const *) write_backs->pdata,
-            write_backs->len),
-        NULL);
 
+  /* Publish everything we just wrote as a single new pack, letting go of
+   * whatever hasn't been part of the catalog for a while. If this fails
+   * the previous generation stays in place untouched */
+  result = dex_await (bz_entry_cache_manager_compact (cache, seen), &local_error);
+  if (!result)
+    goto err;
+
+  /* Only now is it safe for the next refresh to skip what didn't change,
+   * and only if every entry made it into the cache */
+  if (n_failed > 0)
+    {
+      g_warning ("%u entries could not be cached, the next refresh "
+                 "will rebuild everything that changed since the last one",
+                 n_failed);
+      goto done;
+    }
+
+  result = dex_await (bz_flatpak_instance_commit_fingerprints (flatpak), &local_error);
+  if (!result)
+    {
+      g_warning ("Unable to record ref fingerprints, the next refresh "
+                 "will rebuild more entries than it needs to: %s",
+                 local_error->message);
+      g_clear_error (&local_error);
+    }
+
+done:
   data->rv = EXIT_SUCCESS;
   g_main_loop_quit (data->loop);
   return dex_future_new_true ();
@@ -163,3 +298,86 @@ err:
   g_main_loop_quit (data->loop);
   return dex_future_new_false ();
 }
+
+/* Hands the entry to the application right away, so it doesn't have to
+ * wait for the refresh to finish and then read it all back from the cache.
+ * A missing reader only costs it that */
+static void
+stream_entry (MainData *data,
+              BzEntry  *entry)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GBytes) bytes       = NULL;
+
+  if (data->stdout_channel == NULL)
+    return;
+
+  bytes = bz_serializable_dup_bytes (BZ_SERIALIZABLE (entry));
+  if (!write_frame (data->stdout_channel, 0, bytes, &local_error))
+    {
+      g_warning ("Unable to stream entries, the application "
+                 "will read them from the cache instead: %s",
+                 local_error->message);
+      g_clear_pointer (&data->stdout_channel, g_io_channel_unref);
+    }
+}
+
+/* See bz-refresh-frame.h for the layout */
+static gboolean
+write_frame (GIOChannel *channel,
+             guint32     flags,
+             GBytes     *bytes,
+             GError    **error)
+{
+  gconstpointer data   = NULL;
+  gsize         size   = 0;
+  guint32       length = 0;
+
+  if (bytes != NULL)
+    data = g_bytes_get_data (bytes, &size);
+  if (size > BZ_REFRESH_FRAME_LENGTH_MASK)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                   "Entry is too large to stream");
+      return FALSE;
+    }
+
+  length = GUINT32_TO_LE ((guint32) size | flags);
+  if (!write_all (channel, (const char *) &length, sizeof (length), error))
+    return FALSE;
+
+  return write_all (channel, data, size, error);
+}
+
+/* The channel is unbuffered, so a write can take only part of the buffer,
+ * and the reader would lose track of the frames if we didn't finish it */
+static gboolean
+write_all (GIOChannel *channel,
+           const char *buf,
+           gsize       size,
+           GError    **error)
+{
+  while (size > 0)
+    {
+      gsize     written = 0;
+      GIOStatus status  = G_IO_STATUS_NORMAL;
+
+      status = g_io_channel_write_chars (
+          channel, buf, size, &written, error);
+      if (status == G_IO_STATUS_ERROR)
+        return FALSE;
+
+      buf += written;
+      size -= written;
+    }
+
+  return TRUE;
+}
+
+static DexFuture *
+close_channel_finally (DexFuture  *future,
+                       DexChannel *channel)
+{
+  dex_channel_close_send (channel);
+  return dex_ref (future);
+}